@@ -24,12 +24,16 @@ namespace vuk {
 		}
 	};
 
+	/// @brief A point on a timeline semaphore: work signalling up to value has completed once the semaphore reaches it
+	struct TimelineValue {
+		VkSemaphore semaphore;
+		uint64_t value;
+	};
+
 	/// @brief DeviceResource is a polymorphic interface over allocation of GPU resources.
 	/// A DeviceResource must prevent reuse of cross-device resources after deallocation until CPU-GPU timelines are synchronized. GPU-only resources may be
 	/// reused immediately.
 	struct DeviceResource {
-		// missing here: Events (gpu only)
-
 		// gpu only
 		virtual Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_semaphores(std::span<const VkSemaphore> src) = 0;
@@ -37,6 +41,9 @@ namespace vuk {
 		virtual Result<void, AllocateException> allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_fences(std::span<const VkFence> dst) = 0;
 
+		virtual Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) = 0;
+		virtual void deallocate_events(std::span<const VkEvent> dst) = 0;
+
 		virtual Result<void, AllocateException>
 		allocate_command_buffers(std::span<CommandBufferAllocation> dst, std::span<const CommandBufferAllocationCreateInfo> cis, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_command_buffers(std::span<const CommandBufferAllocation> dst) = 0;
@@ -56,6 +63,11 @@ namespace vuk {
 		virtual Result<void, AllocateException> allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_images(std::span<const Image> dst) = 0;
 
+		// gpu only
+		// images allocated together must be deallocated together, the backing memory is shared between them
+		virtual Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) = 0;
+
 		virtual Result<void, AllocateException>
 		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_image_views(std::span<const ImageView> src) = 0;
@@ -86,6 +98,9 @@ namespace vuk {
 		virtual Result<void, AllocateException> allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) = 0;
 
+		// resources handed out so far may be in use until the timeline semaphores reach these values
+		virtual void track_timeline_values(std::span<const TimelineValue> src) = 0;
+
 		virtual Result<void, AllocateException> allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
 		                                                                         std::span<const VkAccelerationStructureCreateInfoKHR> cis,
 		                                                                         SourceLocationAtFrame loc) = 0;
@@ -158,6 +173,22 @@ namespace vuk {
 		/// @param src Span of fences to be deallocated
 		void deallocate(std::span<const VkFence> src);
 
+		/// @brief Allocate events from this Allocator
+		/// @param dst Destination span to place allocated events into
+		/// @param loc Source location information
+		/// @return Result<void, AllocateException> : void or AllocateException if the allocation could not be performed.
+		Result<void, AllocateException> allocate(std::span<VkEvent> dst, SourceLocationAtFrame loc = VUK_HERE_AND_NOW());
+
+		/// @brief Allocate events from this Allocator
+		/// @param dst Destination span to place allocated events into
+		/// @param loc Source location information
+		/// @return Result<void, AllocateException> : void or AllocateException if the allocation could not be performed.
+		Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc = VUK_HERE_AND_NOW());
+
+		/// @brief Deallocate events previously allocated from this Allocator
+		/// @param src Span of events to be deallocated
+		void deallocate(std::span<const VkEvent> src);
+
 		/// @brief Allocate command pools from this Allocator
 		/// @param dst Destination span to place allocated command pools into
 		/// @param cis Per-element construction info
@@ -256,6 +287,16 @@ namespace vuk {
 		/// @param src Span of images to be deallocated
 		void deallocate(std::span<const Image> src);
 
+		/// @brief Allocate images that may share memory with each other from this Allocator
+		/// Images with disjoint use ranges can be placed into the same memory, their contents are undefined at the start of their use range.
+		/// The images must be deallocated together.
+		/// @param dst Destination span to place allocated images into
+		/// @param cis Per-element construction info
+		/// @param loc Source location information
+		/// @return Result<void, AllocateException> : void or AllocateException if the allocation could not be performed.
+		Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc = VUK_HERE_AND_NOW());
+
 		/// @brief Allocate image views from this Allocator
 		/// @param dst Destination span to place allocated image views into
 		/// @param cis Per-element construction info
@@ -389,6 +430,10 @@ namespace vuk {
 		/// @param src Span of timeline semaphores to be deallocated
 		void deallocate(std::span<const TimelineSemaphore> src);
 
+		/// @brief Keep the resources allocated so far from being reused until the timeline semaphores have reached the given values
+		/// @param src Span of semaphore and value pairs to wait for
+		void track_timeline_values(std::span<const TimelineValue> src);
+
 		/// @brief Allocate acceleration structures from this Allocator
 		/// @param dst Destination span to place allocated acceleration structures into
 		/// @param loc Source location information
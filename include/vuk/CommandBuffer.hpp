@@ -10,8 +10,10 @@
 #include "vuk/Types.hpp"
 #include "vuk/vuk_fwd.hpp"
 
+#include <functional>
 #include <optional>
 #include <utility>
+#include <vector>
 
 namespace vuk {
 	class Context;
@@ -254,10 +256,25 @@ namespace vuk {
 		SetBinding set_bindings[VUK_MAX_SETS] = {};
 		Bitset<VUK_MAX_SETS> persistent_sets_to_bind = {};
 		std::pair<VkDescriptorSet, VkDescriptorSetLayout> persistent_sets[VUK_MAX_SETS] = {};
+		Bitset<VUK_MAX_SETS> persistent_sets_used = {};
+		// sets that were bound before the bound state was lost, bound again when a pipeline declaring them is used
+		Bitset<VUK_MAX_SETS> sets_to_rebind = {};
+
+		// Parallel recording
+		// set when recording into a secondary command buffer that continues a render pass
+		// record_parallel then ends it and continues in a new one, and the recorder of the pass executes all of them in order
+		std::optional<VkCommandBufferInheritanceInfo> inheritance;
+		std::vector<VkCommandBuffer> previous_segments;
+		// the pool command_buffer was allocated from, held by the recorder of the pass until it is recorded - continuations come from it too
+		CommandPool segment_pool = {};
+		// set when the command buffer can't be split or execute secondary command buffers: in jobs of record_parallel and in cached passes
+		bool record_jobs_in_order = false;
 
 		// for rendergraph
 		CommandBuffer(ExecutableRenderGraph& rg, Context& ctx, Allocator& allocator, VkCommandBuffer cb);
 		CommandBuffer(ExecutableRenderGraph& rg, Context& ctx, Allocator& allocator, VkCommandBuffer cb, std::optional<RenderPassInfo> ongoing);
+		// for record_parallel: a CommandBuffer starting from the state of parent
+		CommandBuffer(const CommandBuffer& parent, VkCommandBuffer cb);
 
 	public:
 		/// @brief Retrieve parent context
@@ -714,6 +731,19 @@ namespace vuk {
 		/// @param stage the pipeline stage where the timestamp should latch the earliest
 		CommandBuffer& write_timestamp(Query query, PipelineStageFlagBits stage = PipelineStageFlagBits::eBottomOfPipe);
 
+		// parallel recording
+
+		/// @brief Split recording of the current pass into jobs, each recorded into its own secondary command buffer
+		/// @param job_count number of jobs
+		/// @param job callback recording job i into the given CommandBuffer
+		/// @param task_pool TaskPool to record the jobs on, or nullptr to record them on the calling thread
+		///
+		/// Every job starts from the ongoing render pass, pipeline, descriptor set and dynamic state of this CommandBuffer, and the jobs execute in job order
+		/// before anything recorded here afterwards. State set in a job is not seen by other jobs or by this CommandBuffer. Push constants already used by a
+		/// draw or dispatch are not inherited. Inside a render pass, passes are only recorded into secondary command buffers if the graph is executed with a
+		/// TaskPool - otherwise the jobs are recorded in order into this CommandBuffer.
+		CommandBuffer& record_parallel(size_t job_count, std::function<void(CommandBuffer&, size_t)> job, TaskPool* task_pool = nullptr);
+
 		// error handling
 		[[nodiscard]] Result<void> result();
 
@@ -733,6 +763,8 @@ namespace vuk {
 		[[nodiscard]] bool _bind_compute_pipeline_state();
 		[[nodiscard]] bool _bind_graphics_pipeline_state();
 		[[nodiscard]] bool _bind_ray_tracing_pipeline_state();
+		// bound state is undefined after executing secondary command buffers - bind it again on next use
+		void _invalidate_bound_state();
 
 		CommandBuffer& specialize_constants(uint32_t constant_id, void* data, size_t size);
 	};
@@ -20,6 +20,18 @@ namespace std {
 } // namespace std
 
 namespace vuk {
+	/// @brief Size of the memory blocks that images are placed in, per usage class
+	/// Images of the same class and memory type share blocks, instead of each getting a separate device memory allocation. A size of 0 turns pooling off
+	/// for the class. Images that don't fit into half a block are still allocated separately.
+	struct ImagePoolBlockSizes {
+		/// @brief Images with color or depth/stencil attachment usage
+		VkDeviceSize render_targets = 256ull * 1024 * 1024;
+		/// @brief Images with storage usage that aren't render targets
+		VkDeviceSize storage_images = 128ull * 1024 * 1024;
+		/// @brief All other images
+		VkDeviceSize sampled_images = 256ull * 1024 * 1024;
+	};
+
 	/// @brief Parameters used for creating a Context
 	struct ContextCreateParameters {
 		/// @brief Vulkan instance
@@ -56,11 +68,20 @@ namespace vuk {
 		/// @brief Allow vuk to load missing required and optional function pointers dynamically
 		/// If this is false, then you must fill in all required function pointers
 		bool allow_dynamic_loading_of_vk_function_pointers = true;
+		/// @brief Give each queue a dedicated thread that makes the submissions to it
+		/// Submitting then only hands the work over and returns with the timeline value it will signal, the thread submits everything handed over since
+		/// its last wakeup in one call
+		bool use_submission_threads = false;
+		/// @brief Block sizes of the memory pools that vuk suballocates images from
+		ImagePoolBlockSizes image_pool_block_sizes;
+		/// @brief VK_EXT_memory_budget is enabled on the device
+		/// Memory budgets are then read from the driver, instead of being estimated from the heap sizes
+		bool memory_budget_extension = false;
 	};
 
 	/// @brief Abstraction of a device queue in Vulkan
 	struct Queue {
-		Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts);
+		Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts, bool submission_thread = false);
 		~Queue();
 
 		Queue(const Queue&) = delete;
@@ -75,6 +96,21 @@ namespace vuk {
 		Result<void> submit(std::span<VkSubmitInfo> submit_infos, VkFence fence);
 		Result<void> submit(std::span<VkSubmitInfo2KHR> submit_infos, VkFence fence);
 
+		/// @brief Reserve consecutive values on the timeline of this queue
+		/// @return The first value reserved
+		uint64_t reserve_timeline_values(uint64_t count);
+
+		/// @brief If this queue was created with a submission thread, which submit_async hands submissions over to
+		bool has_submission_thread() const noexcept;
+		/// @brief Hand a submission over to the submission thread, returning without waiting for it to be made
+		/// The submission must signal value on the timeline of this queue, and value must have been reserved. Submissions are made in the order of their
+		/// values, so every value reserved must be handed over.
+		void submit_async(uint64_t value, const VkSubmitInfo2KHR& submit_info);
+		/// @brief The first error the submission thread ran into, if there was one
+		Result<void> get_async_submit_result() const;
+		/// @brief Wait until the submission thread has made the submissions for all the values reserved so far
+		void flush();
+
 		struct QueueImpl* impl;
 	};
 
@@ -337,11 +373,13 @@ namespace vuk {
 	/// @param swapchains_with_indexes Swapchains references by the rendergraphs
 	/// @param present_rdy Semaphore used to gate device-side execution
 	/// @param render_complete Semaphore used to gate presentation
+	/// @param options Recording options
 	Result<void> execute_submit(Allocator& allocator,
 	                            std::span<std::pair<Allocator*, ExecutableRenderGraph*>> executable_rendergraphs,
 	                            std::vector<std::pair<SwapchainRef, size_t>> swapchains_with_indexes,
 	                            VkSemaphore present_rdy,
-	                            VkSemaphore render_complete);
+	                            VkSemaphore render_complete,
+	                            RenderGraphExecuteOptions options = {});
 
 	/// @brief Execute given `ExecutableRenderGraph` into API VkCommandBuffers, then submit them to queues, presenting to a single swapchain
 	/// @param allocator Allocator to use for submission resources
@@ -357,7 +395,8 @@ namespace vuk {
 
 	Result<SingleSwapchainRenderBundle> acquire_one(Allocator& allocator, SwapchainRef swapchain);
 	Result<SingleSwapchainRenderBundle> acquire_one(Context& ctx, SwapchainRef swapchain, VkSemaphore present_ready, VkSemaphore render_complete);
-	Result<SingleSwapchainRenderBundle> execute_submit(Allocator& allocator, ExecutableRenderGraph&& rg, SingleSwapchainRenderBundle&& bundle);
+	Result<SingleSwapchainRenderBundle>
+	execute_submit(Allocator& allocator, ExecutableRenderGraph&& rg, SingleSwapchainRenderBundle&& bundle, RenderGraphExecuteOptions options = {});
 	Result<VkResult> present_to_one(Context& ctx, SingleSwapchainRenderBundle&& bundle);
 	Result<VkResult> present(Allocator& allocator, Compiler& compiler, SwapchainRef swapchain, Future&& future, RenderGraphCompileOptions = {});
 
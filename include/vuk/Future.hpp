@@ -134,6 +134,17 @@ namespace vuk {
 		friend struct RenderGraph;
 	};
 
+	/// @brief Submit all pending Futures for execution together, linking their RenderGraphs at once and making a single submission
+	/// @param allocator Allocator to use for submission resources
+	/// @param compiler Compiler to link the RenderGraphs with
+	/// @param futures Futures to submit - the ones already submitted or available on host are skipped
+	Result<void> submit_all(Allocator& allocator, Compiler& compiler, std::span<Future> futures, RenderGraphCompileOptions options = {});
+	/// @brief Submit all pending Futures for execution together, then wait for all of them to complete execution on host
+	/// @param allocator Allocator to use for submission resources
+	/// @param compiler Compiler to link the RenderGraphs with
+	/// @param futures Futures to wait for
+	Result<void> wait_all(Allocator& allocator, Compiler& compiler, std::span<Future> futures, RenderGraphCompileOptions options = {});
+
 	template<class... Args>
 	Result<void> wait_for_futures(Allocator& alloc, Compiler& compiler, Args&&... futs) {
 		std::array controls = { futs.get_control()... };
@@ -169,33 +180,6 @@ namespace vuk {
 	}
 
 	inline Result<void> wait_for_futures_explicit(Allocator& alloc, Compiler& compiler, std::span<Future> futures) {
-		std::vector<std::shared_ptr<RenderGraph>> rgs_to_run;
-		for (uint64_t i = 0; i < futures.size(); i++) {
-			auto control = futures[i].get_control();
-			if (control->status == FutureBase::Status::eInitial && !futures[i].get_render_graph()) {
-				return { expected_error, RenderGraphException{} };
-			} else if (control->status == FutureBase::Status::eHostAvailable || control->status == FutureBase::Status::eSubmitted) {
-				continue;
-			} else {
-				rgs_to_run.emplace_back(futures[i].get_render_graph());
-			}
-		}
-		if (rgs_to_run.size() != 0) {
-			VUK_DO_OR_RETURN(link_execute_submit(alloc, compiler, std::span(rgs_to_run)));
-		}
-
-		std::vector<std::pair<DomainFlags, uint64_t>> waits;
-		for (uint64_t i = 0; i < futures.size(); i++) {
-			auto control = futures[i].get_control();
-			if (control->status != FutureBase::Status::eSubmitted) {
-				continue;
-			}
-			waits.emplace_back(control->initial_domain, control->initial_visibility);
-		}
-		if (waits.size() > 0) {
-			alloc.get_context().wait_for_domains(std::span(waits));
-		}
-
-		return { expected_value };
+		return wait_all(alloc, compiler, futures);
 	}
 } // namespace vuk
\ No newline at end of file
@@ -167,6 +167,15 @@ namespace vuk {
 		using type = ImageCreateInfo;
 	};
 
+	/// @brief Parameters for creating an image that may share memory with other images allocated together with it
+	struct AliasedImageCreateInfo {
+		ImageCreateInfo ici;
+		/// @brief Inclusive range of positions in an ordering of uses (eg. passes) for which the image must keep its memory
+		/// Images with disjoint ranges may be placed into the same memory
+		uint32_t first_use;
+		uint32_t last_use;
+	};
+
 	struct ImageWithIdentity {
 		Image image;
 	};
@@ -10,10 +10,12 @@
 #include "vuk/Swapchain.hpp"
 #include "vuk/vuk_fwd.hpp"
 
+#include <chrono>
 #include <functional>
 #include <optional>
 #include <span>
 #include <string_view>
+#include <type_traits>
 #include <unordered_set>
 #include <vector>
 
@@ -87,10 +89,43 @@ namespace vuk {
 		std::vector<Resource> resources;
 
 		std::function<void(CommandBuffer&)> execute;
+		/// @brief If set, the commands recorded by execute are kept in a secondary command buffer and reused for as long as the key stays the same.
+		/// The key must cover everything execute depends on, except for the render pass and the resources bound to the pass, which vuk adds to it.
+		/// Requires RenderGraphExecuteOptions::recording_cache_resource.
+		std::optional<uint64_t> cache_key;
 		std::byte* arguments; // internal use
 		PassType type = PassType::eUserPass;
 	};
 
+	struct InferenceContext;
+
+	/// @brief Rule that infers parameters of an ImageAttachment or Buffer from other resources
+	template<class T>
+	struct InferenceRule {
+		using Fn = std::function<void(const InferenceContext& ctx, T& target)>;
+
+		InferenceRule() = default;
+
+		/// @brief A rule that may read any resource. These rules are reevaluated until no more progress is made.
+		template<class F>
+		requires(!std::is_same_v<std::remove_cvref_t<F>, InferenceRule> && std::is_invocable_v<F&, const InferenceContext&, T&>)
+		InferenceRule(F&& fn) : fn(std::forward<F>(fn)) {}
+
+		/// @brief A rule that only reads the given resources. These rules are evaluated once, after the rules of their sources.
+		InferenceRule(Fn fn, std::vector<Name> sources) : fn(std::move(fn)), sources(std::move(sources)), sources_declared(true) {}
+
+		void operator()(const InferenceContext& ctx, T& target) const {
+			fn(ctx, target);
+		}
+
+		Fn fn;
+		std::vector<Name> sources;
+		bool sources_declared = false;
+	};
+
+	using IARule = InferenceRule<ImageAttachment>;
+	using BufferRule = InferenceRule<Buffer>;
+
 	// declare these specializations for GCC
 	template<>
 	ConstMapIterator<QualifiedName, const struct AttachmentInfo&>::~ConstMapIterator();
@@ -183,8 +218,10 @@ namespace vuk {
 		/// @param futures Futures to be attached into this rendergraph
 		void attach_in(std::span<Future> futures);
 
-		void inference_rule(Name target, std::function<void(const struct InferenceContext& ctx, ImageAttachment& ia)>);
-		void inference_rule(Name target, std::function<void(const struct InferenceContext& ctx, Buffer& ia)>);
+		/// @brief Add a rule to infer the parameters of an image attachment
+		void inference_rule(Name target, IARule rule);
+		/// @brief Add a rule to infer the parameters of a buffer
+		void inference_rule(Name target, BufferRule rule);
 
 		/// @brief Compute all the unconsumed resource names and return them as Futures
 		std::vector<Future> split();
@@ -227,9 +264,6 @@ namespace vuk {
 		Name prefix;
 	};
 
-	using IARule = std::function<void(const struct InferenceContext& ctx, ImageAttachment& ia)>;
-	using BufferRule = std::function<void(const struct InferenceContext& ctx, Buffer& buffer)>;
-
 	// builtin inference rules for convenience
 
 	/// @brief Inference target has the same extent as the source
@@ -250,6 +284,44 @@ namespace vuk {
 	/// @brief Inference target is the same size as the source
 	BufferRule same_size_as(Name inference_source);
 
+	/// @brief Timings and counts describing the last link, to compare compile options on a graph and to monitor compile cost
+	struct CompileStatistics {
+		/// @brief Wall time spent in each phase of compile and link
+		struct PhaseTimes {
+			std::chrono::nanoseconds inline_rgs{};
+			std::chrono::nanoseconds compute_assigned_names{};
+			std::chrono::nanoseconds build_links{};
+			std::chrono::nanoseconds schedule_intra_queue{};
+			std::chrono::nanoseconds relink_subchains{};
+			std::chrono::nanoseconds fix_subchains{};
+			std::chrono::nanoseconds queue_inference{};
+			std::chrono::nanoseconds generate_barriers_and_waits{};
+			std::chrono::nanoseconds merge_rps{};
+			std::chrono::nanoseconds assign_passes_to_batches{};
+			std::chrono::nanoseconds split_barriers{};
+			std::chrono::nanoseconds coalesce_barriers{};
+			std::chrono::nanoseconds build_renderpasses{};
+		} phase_times;
+		/// @brief The last link reused a cached link, only inlining was timed
+		bool cache_hit = false;
+
+		size_t passes = 0;
+		size_t chains = 0;
+		size_t subgraphs_inlined = 0;
+		size_t image_barriers = 0;
+		size_t memory_barriers = 0;
+		size_t pipeline_barrier_calls = 0; // upper bound, barriers that resolve to nothing are skipped at record time
+		size_t event_sets = 0;             // barriers split into an event set after the source pass and a wait before the destination pass
+		/// @brief Counts as generated, before barriers of neighbouring passes were merged and no-op barriers dropped
+		size_t image_barriers_before_coalescing = 0;
+		size_t memory_barriers_before_coalescing = 0;
+		size_t pipeline_barrier_calls_before_coalescing = 0;
+		size_t render_passes = 0;
+		size_t submit_batches = 0;
+		/// @brief Rounds of attachment and buffer inference, filled in when the linked graph is executed
+		size_t inference_iterations = 0;
+	};
+
 	struct Compiler {
 		Compiler();
 		~Compiler();
@@ -282,11 +354,16 @@ namespace vuk {
 		/// @brief Dump the pass dependency graph in graphviz format
 		std::string dump_graph();
 
+		/// @brief Retrieve statistics of the last compile or link
+		const CompileStatistics& get_statistics() const;
+
+		/// @brief Retrieve the names of passes removed by the last compile, because they had no observable effect
+		std::span<const QualifiedName> get_culled_passes() const;
+
 	private:
 		struct RGCImpl* impl;
 
 		// internal passes
-		Result<void> inline_rgs(std::span<std::shared_ptr<RenderGraph>> rgs);
 		void queue_inference();
 		void pass_partitioning();
 		void resource_linking();
@@ -322,7 +399,7 @@ namespace vuk {
 		ExecutableRenderGraph(ExecutableRenderGraph&&) noexcept;
 		ExecutableRenderGraph& operator=(ExecutableRenderGraph&&) noexcept;
 
-		Result<SubmitBundle> execute(Allocator&, std::vector<std::pair<Swapchain*, size_t>> swp_with_index);
+		Result<SubmitBundle> execute(Allocator&, std::vector<std::pair<Swapchain*, size_t>> swp_with_index, RenderGraphExecuteOptions options = {});
 
 		Result<struct BufferInfo, RenderGraphException> get_resource_buffer(const NameReference&, struct PassInfo*);
 		Result<struct AttachmentInfo, RenderGraphException> get_resource_image(const NameReference&, struct PassInfo*);
@@ -335,7 +412,15 @@ namespace vuk {
 		struct RGCImpl* impl;
 
 		void fill_render_pass_info(struct RenderPassInfo& rpass, const size_t& i, class CommandBuffer& cobuf);
+		Result<void> record_pass(Allocator&,
+		                         struct PassInfo& pass,
+		                         VkCommandBuffer& cbuf,
+		                         const VkCommandBufferInheritanceInfo* inheritance = nullptr,
+		                         std::vector<VkCommandBuffer>* previous_segments = nullptr,
+		                         CommandPool segment_pool = {});
 		Result<SubmitInfo> record_single_submit(Allocator&, std::span<PassInfo*> passes, DomainFlagBits domain);
+		Result<VkCommandBuffer> get_cached_recording(struct PassInfo& pass, DomainFlagBits domain);
+		Result<SubmitInfo> record_single_submit_parallel(Allocator&, std::span<PassInfo*> passes, DomainFlagBits domain, TaskPool& task_pool);
 
 		friend struct InferenceContext;
 	};
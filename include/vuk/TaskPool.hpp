@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace vuk {
+	/// @brief A pool of worker threads that vuk spreads independent work over
+	///
+	/// Work is submitted as fork-join ranges: the submitting thread takes part in the work and returns once all of it has completed.
+	/// Each worker has its own queue, and steals from the other queues when that runs dry.
+	class TaskPool {
+	public:
+		/// @brief Create a pool with the given number of worker threads
+		/// @param thread_count Number of worker threads, in addition to the threads submitting work. 0 picks one less than the hardware concurrency.
+		TaskPool(size_t thread_count = 0);
+		~TaskPool();
+
+		TaskPool(const TaskPool&) = delete;
+		TaskPool& operator=(const TaskPool&) = delete;
+
+		/// @brief Number of threads that can work on a range at the same time, including the submitting thread
+		size_t concurrency() const noexcept;
+
+		/// @brief Invoke fn(i) for every i in [0, count), possibly concurrently and in any order. Returns when all invocations have completed.
+		/// Can be called from inside a running invocation.
+		template<class F>
+		void parallel_for(size_t count, F&& fn) {
+			if (count == 0) {
+				return;
+			}
+			if (count == 1) {
+				fn(size_t(0));
+				return;
+			}
+			run(count, [](void* user, size_t i) { (*static_cast<std::remove_reference_t<F>*>(user))(i); }, const_cast<void*>(static_cast<const void*>(&fn)));
+		}
+
+	private:
+		void run(size_t count, void (*fn)(void*, size_t), void* user);
+
+		struct TaskPoolImpl* impl;
+	};
+} // namespace vuk
@@ -1105,9 +1105,42 @@ namespace vuk {
 		void* user_data = nullptr;
 	};
 
+	/// @brief Heuristic for picking the next pass to schedule among the passes whose dependencies are already scheduled
+	/// All heuristics are deterministic: the same graph always yields the same order
+	enum class PassOrdering {
+		eDefault,                         // the most recently unblocked pass is scheduled first
+		eMinimizeRenderPassSwitches,      // keep passes rendering into the same attachments adjacent, so that they can share a render pass
+		eMinimizeBarriers,                // schedule the pass sharing the most resources with the previous pass next, so that uses of a resource are back to back
+		eCriticalPathFirst,               // schedule passes on the longest dependency path first, for latency
+		eMaximizeProducerConsumerDistance // prefer passes whose inputs were produced earliest, to hide barrier latency
+	};
+
 	/// @brief Control compilation options when compiling the rendergraph
 	struct RenderGraphCompileOptions {
 		ProfilingCallbacks callbacks;
+		/// @brief Heuristic used to order passes
+		PassOrdering pass_ordering = PassOrdering::eDefault;
+		/// @brief If the graphs passed to link are structurally identical to the graphs of the previous link on the same Compiler,
+		/// reuse the previous schedule, barriers and render passes and only rebind per-frame resources
+		bool cache_linked_graphs = false;
+		/// @brief Remove passes that have no effect outside of the graph, and none of whose results are used by other passes
+		bool cull_dead_passes = true;
+		/// @brief Let internal images that are used on a single queue and are not alive at the same time share memory
+		bool alias_transient_images = false;
+		/// @brief If set, the graphs and subgraphs passed in are inlined in parallel on this pool
+		TaskPool* task_pool = nullptr;
+	};
+
+	/// @brief Control how a linked rendergraph is recorded into command buffers
+	struct RenderGraphExecuteOptions {
+		/// @brief If set, the passes of each submission are recorded in parallel on this pool, each thread into command buffers from its own pool.
+		/// Passes inside render passes are recorded into secondary command buffers, other passes into their own primary command buffers.
+		/// Pass callbacks and profiling callbacks are then called from the threads of the pool.
+		TaskPool* task_pool = nullptr;
+		/// @brief Resource that the recordings of cached passes (see Pass::cache_key) are allocated from. Passes are not cached if not set.
+		/// Recordings are deallocated into it when they are replaced or the Compiler is destroyed, so it must defer deallocation until the GPU is done
+		/// with them, like DeviceSuperFrameResource does.
+		DeviceResource* recording_cache_resource = nullptr;
 	};
 
 	enum class DescriptorSetStrategyFlagBits {
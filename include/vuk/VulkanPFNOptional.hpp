@@ -18,6 +18,9 @@ VUK_X(vkDestroyAccelerationStructureKHR)
 VUK_X(vkGetRayTracingShaderGroupHandlesKHR)
 VUK_X(vkCreateRayTracingPipelinesKHR)
 
+// VK_EXT_memory_budget
+VUK_Y(vkGetPhysicalDeviceMemoryProperties2)
+
 // VK_EXT_calibrated_timestamps
 VUK_X(vkGetCalibratedTimestampsEXT)
 VUK_Y(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
\ No newline at end of file
@@ -8,6 +8,7 @@ VUK_X(vkCmdBlitImage)
 VUK_X(vkCmdCopyImage)
 VUK_X(vkCmdClearColorImage)
 VUK_X(vkCmdClearDepthStencilImage)
+VUK_X(vkCmdClearAttachments)
 VUK_X(vkCmdCopyBuffer)
 VUK_X(vkCmdCopyBufferToImage)
 VUK_X(vkCmdCopyImageToBuffer)
@@ -66,6 +67,7 @@ VUK_X(vkCreateRenderPass)
 VUK_X(vkCmdBeginRenderPass)
 VUK_X(vkCmdNextSubpass)
 VUK_X(vkCmdEndRenderPass)
+VUK_X(vkCmdExecuteCommands)
 VUK_X(vkDestroyRenderPass)
 
 VUK_X(vkCreateSampler)
@@ -87,6 +89,10 @@ VUK_X(vkCreateFence)
 VUK_X(vkWaitForFences)
 VUK_X(vkDestroyFence)
 
+VUK_X(vkCreateEvent)
+VUK_X(vkResetEvent)
+VUK_X(vkDestroyEvent)
+
 VUK_X(vkCreateSemaphore)
 VUK_X(vkWaitSemaphores)
 VUK_X(vkDestroySemaphore)
@@ -120,4 +126,6 @@ VUK_X(vkResetQueryPool)
 
 // sync2 or 1.3
 VUK_X(vkCmdPipelineBarrier2KHR)
+VUK_X(vkCmdSetEvent2KHR)
+VUK_X(vkCmdWaitEvents2KHR)
 VUK_X(vkQueueSubmit2KHR)
\ No newline at end of file
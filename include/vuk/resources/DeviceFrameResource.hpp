@@ -9,6 +9,19 @@
 namespace vuk {
 	struct DeviceSuperFrameResource;
 
+	/// @brief Statistics of the persistent buffers of a DeviceSuperFrameResource, for one memory usage
+	///
+	/// Small buffers take slots in slabs of equally sized slots, larger ones are placed in the blocks directly.
+	/// The fragmentation of the slabs is 1 - slab_bytes_in_use / slab_bytes, the one of the blocks is 1 - block_bytes_in_use / block_bytes.
+	struct BufferAllocatorStatistics {
+		uint64_t allocation_count;   ///< Number of buffers allocated so far
+		uint64_t deallocation_count; ///< Number of buffers deallocated so far
+		size_t slab_bytes;           ///< Bytes held by slabs
+		size_t slab_bytes_in_use;    ///< Bytes of the slab slots that are handed out
+		size_t block_bytes;          ///< Bytes of the blocks
+		size_t block_bytes_in_use;   ///< Bytes of the blocks taken by slabs and larger buffers
+	};
+
 	/// @brief Represents "per-frame" resources - temporary allocations that persist through a frame. Handed out by DeviceSuperFrameResource, cannot be
 	/// constructed directly.
 	///
@@ -23,16 +36,23 @@ namespace vuk {
 
 		void deallocate_fences(std::span<const VkFence> src) override; // noop
 
+		/// @brief Events are kept by the frame and reset when it is recycled
+		Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) override;
+
+		void deallocate_events(std::span<const VkEvent> src) override; // no-op, recycled with the frame
+
 		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
 		                                                         SourceLocationAtFrame loc) override;
 
-		void deallocate_command_buffers(std::span<const CommandBufferAllocation> src) override; // no-op, deallocated with pools
+		void deallocate_command_buffers(std::span<const CommandBufferAllocation> src) override; // no-op, recycled with pools
 
+		/// @brief Command pools are kept by the frame and reset when it is recycled, and command buffers allocated from them are reused.
+		/// A pool is handed out to one user at a time - deallocating it lets the frame hand it out again.
 		Result<void, AllocateException>
 		allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) override;
 
-		void deallocate_command_pools(std::span<const CommandPool> dst) override; // no-op
+		void deallocate_command_pools(std::span<const CommandPool> src) override;
 
 		// buffers are lockless
 		Result<void, AllocateException> allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) override;
@@ -48,6 +68,9 @@ namespace vuk {
 
 		void deallocate_images(std::span<const Image> src) override; // noop
 
+		Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+
 		Result<void, AllocateException>
 		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) override;
 
@@ -81,6 +104,8 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override; // noop
 
+		void track_timeline_values(std::span<const TimelineValue> src) override;
+
 		void deallocate_swapchains(std::span<const VkSwapchainKHR> src) override;
 
 		Result<void, AllocateException> allocate_graphics_pipelines(std::span<GraphicsPipelineInfo> dst,
@@ -101,7 +126,7 @@ namespace vuk {
 		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) override;
 		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
 
-		/// @brief Wait for the fences / timeline semaphores referencing this frame to complete
+		/// @brief Wait for the fences / timeline semaphores / timeline values referencing this frame to complete
 		///
 		/// Called automatically when recycled
 		void wait();
@@ -156,6 +181,8 @@ namespace vuk {
 
 		void deallocate_fences(std::span<const VkFence> src) override;
 
+		void deallocate_events(std::span<const VkEvent> src) override;
+
 		void deallocate_command_buffers(std::span<const CommandBufferAllocation> src) override;
 
 		Result<void, AllocateException>
@@ -192,6 +219,8 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
 
+		void track_timeline_values(std::span<const TimelineValue> src) override;
+
 		void deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) override;
 
 		void deallocate_swapchains(std::span<const VkSwapchainKHR> src) override;
@@ -214,6 +243,10 @@ namespace vuk {
 
 		void force_collect();
 
+		/// @brief Get the statistics of the buffers allocated directly from this resource
+		/// @param mem_usage The memory usage of the buffers
+		BufferAllocatorStatistics get_buffer_statistics(MemoryUsage mem_usage) const;
+
 		virtual ~DeviceSuperFrameResource();
 
 		const uint64_t frames_in_flight;
@@ -223,6 +256,7 @@ namespace vuk {
 		DeviceFrameResource& get_last_frame();
 		template<class T>
 		void deallocate_frame(T& f);
+		void release_pools(DeviceFrameResource& f);
 
 		struct DeviceSuperFrameResourceImpl* impl;
 		friend struct DeviceFrameResource;
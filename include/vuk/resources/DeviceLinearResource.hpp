@@ -26,6 +26,10 @@ namespace vuk {
 
 		void deallocate_fences(std::span<const VkFence> src) override; // noop
 
+		Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) override;
+
+		void deallocate_events(std::span<const VkEvent> src) override; // noop
+
 		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
 		                                                         SourceLocationAtFrame loc) override;
@@ -51,6 +55,9 @@ namespace vuk {
 
 		void deallocate_images(std::span<const Image> src) override; // noop
 
+		Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+
 		Result<void, AllocateException>
 		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) override;
 
@@ -84,7 +91,9 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override; // noop
 
-		/// @brief Wait for the fences / timeline semaphores referencing this allocator
+		void track_timeline_values(std::span<const TimelineValue> src) override;
+
+		/// @brief Wait for the fences / timeline semaphores / timeline values referencing this allocator
 		void wait();
 
 		/// @brief Release the resources of this resource into the upstream
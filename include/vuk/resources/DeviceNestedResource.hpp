@@ -17,6 +17,10 @@ namespace vuk {
 
 		void deallocate_fences(std::span<const VkFence> dst) override;
 
+		Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) override;
+
+		void deallocate_events(std::span<const VkEvent> dst) override;
+
 		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
 		                                                         SourceLocationAtFrame loc) override;
@@ -41,6 +45,9 @@ namespace vuk {
 
 		void deallocate_images(std::span<const Image> src) override;
 
+		Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+
 		Result<void, AllocateException>
 		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) override;
 
@@ -79,6 +86,8 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
 
+		void track_timeline_values(std::span<const TimelineValue> src) override;
+
 		Result<void, AllocateException> allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
 		                                                                 std::span<const VkAccelerationStructureCreateInfoKHR> cis,
 		                                                                 SourceLocationAtFrame loc) override;
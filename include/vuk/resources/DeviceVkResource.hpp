@@ -3,10 +3,33 @@
 #include "vuk/Allocator.hpp"
 #include "vuk/Config.hpp"
 
+#include <functional>
+#include <vector>
+
 namespace vuk {
+	struct ImagePoolBlockSizes;
+
+	/// @brief Memory use of a device memory heap
+	struct MemoryHeapBudget {
+		/// @brief Bytes of the heap used by this process
+		VkDeviceSize usage = 0;
+		/// @brief Bytes of the heap this process can use before allocations are expected to fail
+		VkDeviceSize budget = 0;
+		/// @brief Bytes of device memory vuk allocated from the heap
+		VkDeviceSize block_bytes = 0;
+		/// @brief Bytes of the device memory blocks in use by resources
+		VkDeviceSize allocation_bytes = 0;
+	};
+
+	/// @brief Called when the usage of a heap crosses a watermark, in either direction
+	using MemoryPressureCallback = std::function<void(uint32_t heap_index, const MemoryHeapBudget& budget, bool over_watermark)>;
+
 	/// @brief Device resource that performs direct allocation from the resources from the Vulkan runtime.
 	struct DeviceVkResource final : DeviceResource {
 		DeviceVkResource(Context& ctx);
+		/// @brief Create a DeviceVkResource that pools image memory in blocks of the given sizes
+		/// @param memory_budget_extension VK_EXT_memory_budget is enabled on the device, so that budgets are read from the driver instead of being estimated
+		DeviceVkResource(Context& ctx, const ImagePoolBlockSizes& image_pool_block_sizes, bool memory_budget_extension = false);
 		~DeviceVkResource();
 
 		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
@@ -17,6 +40,10 @@ namespace vuk {
 
 		void deallocate_fences(std::span<const VkFence> src) override;
 
+		Result<void, AllocateException> allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) override;
+
+		void deallocate_events(std::span<const VkEvent> src) override;
+
 		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
 		                                                         SourceLocationAtFrame loc) override;
@@ -41,6 +68,9 @@ namespace vuk {
 
 		void deallocate_images(std::span<const Image> src) override;
 
+		Result<void, AllocateException>
+		allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+
 		Result<void, AllocateException>
 		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) override;
 
@@ -79,6 +109,8 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
 
+		void track_timeline_values(std::span<const TimelineValue> src) override; // noop
+
 		Result<void, AllocateException> allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
 		                                                                 std::span<const VkAccelerationStructureCreateInfoKHR> cis,
 		                                                                 SourceLocationAtFrame loc) override;
@@ -109,6 +141,24 @@ namespace vuk {
 			return *ctx;
 		}
 
+		/// @brief Query the memory budget and invoke the callbacks of the watermarks crossed since the last query
+		/// DeviceSuperFrameResource calls this for every frame
+		void update_memory_budget(uint64_t frame);
+
+		/// @brief Get the budget of every memory heap, as of the last update_memory_budget()
+		std::vector<MemoryHeapBudget> get_memory_budget();
+
+		/// @brief Add a callback to invoke when the usage of a heap crosses watermark * budget
+		/// @param watermark Fraction of the heap budget, between 0 and 1
+		/// @return Identifier of the callback, to remove it with remove_memory_pressure_callback()
+		uint64_t add_memory_pressure_callback(float watermark, MemoryPressureCallback callback);
+
+		/// @brief Remove a callback added with add_memory_pressure_callback(), it is not invoked by later budget updates
+		void remove_memory_pressure_callback(uint64_t id);
+
+		/// @brief Get the bytes of memory currently allocated through this resource for a MemoryUsage
+		VkDeviceSize get_allocated_bytes(MemoryUsage usage) const;
+
 		Context* ctx;
 		VkDevice device;
 
@@ -49,6 +49,8 @@ namespace vuk {
 	template<class T>
 	class Unique;
 
+	struct DeviceResource;
+
 	struct FramebufferCreateInfo;
 
 	struct BufferCreateInfo;
@@ -86,4 +88,6 @@ namespace vuk {
 	class Future;
 
 	struct Compiler;
+
+	class TaskPool;
 } // namespace vuk
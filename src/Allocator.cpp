@@ -37,6 +37,18 @@ namespace vuk {
 		device_resource->deallocate_fences(src);
 	}
 
+	Result<void, AllocateException> Allocator::allocate(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		return device_resource->allocate_events(dst, loc);
+	}
+
+	Result<void, AllocateException> Allocator::allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		return device_resource->allocate_events(dst, loc);
+	}
+
+	void Allocator::deallocate(std::span<const VkEvent> src) {
+		device_resource->deallocate_events(src);
+	}
+
 	Result<void, AllocateException> Allocator::allocate(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) {
 		return device_resource->allocate_command_pools(dst, cis, loc);
 	}
@@ -102,6 +114,11 @@ namespace vuk {
 		device_resource->deallocate_images(src);
 	}
 
+	Result<void, AllocateException>
+	Allocator::allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		return device_resource->allocate_aliased_images(dst, cis, loc);
+	}
+
 	Result<void, AllocateException> Allocator::allocate(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
 		return device_resource->allocate_image_views(dst, cis, loc);
 	}
@@ -192,6 +209,10 @@ namespace vuk {
 		device_resource->deallocate_timeline_semaphores(src);
 	}
 
+	void Allocator::track_timeline_values(std::span<const TimelineValue> src) {
+		device_resource->track_timeline_values(src);
+	}
+
 	Result<void, AllocateException>
 	Allocator::allocate(std::span<VkAccelerationStructureKHR> dst, std::span<const VkAccelerationStructureCreateInfoKHR> cis, SourceLocationAtFrame loc) {
 		return device_resource->allocate_acceleration_structures(dst, cis, loc);
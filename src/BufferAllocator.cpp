@@ -2,6 +2,7 @@
 #include "vuk/Allocator.hpp"
 #include "vuk/Result.hpp"
 #include "vuk/SourceLocation.hpp"
+#include <bit>
 #include <iostream>
 
 // Aligns given value down to nearest multiply of align value. For example: VmaAlignUp(11, 8) = 8.
@@ -22,73 +23,108 @@ namespace vuk {
 	Result<void, AllocateException> BufferLinearAllocator::grow(size_t num_blocks, SourceLocationAtFrame source) {
 		std::lock_guard _(mutex);
 
-		int best_fit_block_size = 1024;
-		int best_fit_index = -1;
-		size_t actual_blocks = num_blocks;
-
-		// find best fit allocation
-		for (size_t i = 0; i < available_allocation_count; i++) {
-			int block_over = (int)available_allocations[i].num_blocks - (int)num_blocks;
-			if (block_over >= 0 && block_over < best_fit_block_size) {
-				best_fit_block_size = block_over;
-				best_fit_index = (int)i;
-				if (block_over == 0) {
-					break;
-				}
-			}
-		}
-
-		if (best_fit_index == -1) { // no allocation suitable, allocate new one
-			Buffer alloc;
+		Buffer alloc;
+		// best fit among the segments given back on reset
+		auto it = available_allocations.lower_bound(block_size * num_blocks);
+		if (it == available_allocations.end()) { // no allocation suitable, allocate new one
 			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size * num_blocks };
 			auto result = upstream->allocate_buffers(std::span{ &alloc, 1 }, std::span{ &bci, 1 }, source);
 			if (!result) {
 				return result;
 			}
-			for (auto i = 0; i < num_blocks; i++) {
-				used_allocations[used_allocation_count + i] = { alloc, i > 0 ? 0 : num_blocks, 0 };
-			}
-			current_buffer += (int)num_blocks;
-		} else { // we found one, we swap it into the used allocations and compact the available allocations
-			std::swap(used_allocations[used_allocation_count], available_allocations[best_fit_index]);
-			std::swap(available_allocations[best_fit_index], available_allocations[available_allocation_count - 1]);
-			available_allocation_count--;
-
-			auto& alloc = used_allocations[used_allocation_count];
-			for (auto i = 1; i < alloc.num_blocks; i++) {
-				// create 1 entry per block in used_allocations
-				used_allocations[used_allocation_count + i] = { alloc.buffer, 0, 0 };
-			}
-			current_buffer += (int)used_allocations[used_allocation_count].num_blocks;
-			actual_blocks = used_allocations[used_allocation_count].num_blocks;
+		} else {
+			alloc = it->second;
+			available_allocations.erase(it);
 		}
-		used_allocations[0].base_address = 0;
-		for (auto i = 0; i < actual_blocks; i++) {
-			if (used_allocation_count + i == 0) {
-				continue;
-			}
-			if (i == 0) { // the first block will have its based_address calculated, the remaining blocks share this address
-				for (int j = (int)used_allocation_count - 1; j >= 0; j--) {
-					if (used_allocations[j].num_blocks > 0) {
-						used_allocations[used_allocation_count].base_address = used_allocations[j].base_address + used_allocations[j].num_blocks * block_size;
-						break;
-					}
-				}
-			} else {
-				used_allocations[used_allocation_count + i].base_address = used_allocations[used_allocation_count + i - 1].base_address;
-			}
+		size_t actual_blocks = alloc.size / block_size;
+
+		// the segment starts after all the blocks before it
+		uint64_t base_address = used_allocation_count * block_size;
+		// create 1 entry per block in used_allocations, the first one owns the buffer and all of them share its address
+		used_allocations.reserve(used_allocation_count + actual_blocks);
+		for (size_t i = 0; i < actual_blocks; i++) {
+			used_allocations[used_allocation_count + i] = { alloc, i > 0 ? 0 : actual_blocks, base_address };
 		}
 		used_allocation_count += actual_blocks;
+		// only published once the blocks are filled in, as other threads read them without the lock
+		current_buffer += (int)actual_blocks;
+		grows++;
+		grows.notify_all();
 
-		return {expected_value};
+		return { expected_value };
 	}
 
-	// lock-free bump allocation if there is still space
+	namespace {
+		struct ThreadSubBlock {
+			const BufferLinearAllocator* owner = nullptr;
+			uint64_t generation = 0;
+			uint64_t cursor = 0;
+			uint64_t end = 0;
+			uint64_t last_use = 0;
+		};
+		// a thread uses a few allocators at a time (one per memory usage and frame), looked up by allocator and generation
+		thread_local std::array<ThreadSubBlock, 16> thread_sub_blocks;
+		thread_local uint64_t thread_sub_block_uses = 0;
+		std::atomic<uint64_t> next_generation = 1;
+	} // namespace
+
+	uint64_t BufferLinearAllocator::new_generation() {
+		return next_generation.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// small allocations are bumped from a sub-block owned by the calling thread, only refilling it touches the shared needle
 	Result<Buffer, AllocateException> BufferLinearAllocator::allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source) {
 		if (size == 0) {
 			return { expected_value, Buffer{ .buffer = VK_NULL_HANDLE, .size = 0 } };
 		}
 
+		// larger allocations would waste too much of a sub-block
+		if (size + alignment > sub_block_size / 4) {
+			auto base = reserve(size, alignment, source);
+			if (!base) {
+				return base;
+			}
+			return { expected_value, buffer_at(*base, size) };
+		}
+
+		auto gen = generation.load(std::memory_order_relaxed);
+		ThreadSubBlock* slot = nullptr;
+		ThreadSubBlock* victim = &thread_sub_blocks[0];
+		// free slots and earlier generations of this allocator go first, then the least recently used one
+		auto eviction_order = [this](const ThreadSubBlock& sb) {
+			return sb.owner == nullptr || sb.owner == this ? 0 : sb.last_use + 1;
+		};
+		for (auto& sb : thread_sub_blocks) {
+			if (sb.owner == this && sb.generation == gen) {
+				slot = &sb;
+				break;
+			}
+			if (eviction_order(sb) < eviction_order(*victim)) {
+				victim = &sb;
+			}
+		}
+		if (!slot) {
+			// the space left in the evicted sub-block is only wasted until its allocator is reset
+			slot = victim;
+			*slot = { this, gen, 0, 0 };
+		}
+		slot->last_use = ++thread_sub_block_uses;
+		auto& sb = *slot;
+		uint64_t base = VmaAlignUp<uint64_t>(sb.cursor, alignment);
+		if (base + size > sb.end) {
+			auto sub_block = reserve(sub_block_size, sub_block_size, source);
+			if (!sub_block) {
+				return sub_block;
+			}
+			sb = { this, gen, *sub_block, *sub_block + sub_block_size, sb.last_use };
+			base = VmaAlignUp<uint64_t>(sb.cursor, alignment);
+		}
+		sb.cursor = base + size;
+		return { expected_value, buffer_at(base, size) };
+	}
+
+	// lock-free bump allocation if there is still space
+	Result<uint64_t, AllocateException> BufferLinearAllocator::reserve(size_t size, size_t alignment, SourceLocationAtFrame source) {
 		uint64_t old_needle = needle.load();
 		uint64_t new_needle = VmaAlignUp(old_needle, alignment) + size;
 		uint64_t low_buffer = old_needle / block_size;
@@ -115,51 +151,75 @@ namespace vuk {
 		}
 
 		uint64_t base = new_needle - size;
-		int base_buffer = (int)(base / block_size);
 		bool needs_to_create = old_needle == 0 || is_straddling;
 		if (needs_to_create) {
 			size_t num_blocks = std::max(high_buffer - low_buffer + (old_needle == 0 ? 1 : 0), static_cast<uint64_t>(1));
 			while (current_buffer.load() < (int)high_buffer) {
-				grow(num_blocks, source);
+				if (auto result = grow(num_blocks, source); !result) {
+					// release the threads waiting for this block
+					grow_failed = true;
+					grows++;
+					grows.notify_all();
+					return result;
+				}
 			}
 			assert(base % block_size == 0);
 		}
-		// wait for the buffer to be allocated
-		while (current_buffer.load() < (int)high_buffer) {
-		};
-		auto& current_alloc = used_allocations[base_buffer];
+		// wait for the buffer to be allocated by the thread that crossed into it
+		while (true) {
+			auto seen_grows = grows.load();
+			if (current_buffer.load() >= (int)high_buffer) {
+				break;
+			}
+			if (grow_failed) {
+				return { expected_error, AllocateException{ VK_ERROR_OUT_OF_DEVICE_MEMORY } };
+			}
+			grows.wait(seen_grows);
+		}
+		return { expected_value, base };
+	}
+
+	Buffer BufferLinearAllocator::buffer_at(uint64_t base, size_t size) {
+		auto& current_alloc = used_allocations[base / block_size];
 		auto offset = base - current_alloc.base_address;
 		Buffer b = current_alloc.buffer;
 		b.offset += offset;
 		b.size = size;
 		b.mapped_ptr = b.mapped_ptr != nullptr ? b.mapped_ptr + offset : nullptr;
 		b.device_address = b.device_address != 0 ? b.device_address + offset : 0;
-
-		return { expected_value, b };
+		return b;
 	}
 
 	void BufferLinearAllocator::reset() {
 		std::lock_guard _(mutex);
+		uint64_t high_water_mark = needle.load();
 		for (size_t i = 0; i < used_allocation_count;) {
-			available_allocations[available_allocation_count++] = used_allocations[i];
-			i += used_allocations[i].num_blocks;
+			auto& alloc = used_allocations[i];
+			available_allocations.emplace(alloc.buffer.size, alloc.buffer);
+			i += alloc.num_blocks;
 		}
-		used_allocations = {};
 		used_allocation_count = 0;
 		current_buffer = -1;
 		needle = 0;
+		grow_failed = false;
+		generation = new_generation();
+
+		// a use spanning many blocks gets bigger blocks the next time, so that it takes fewer grows and segments
+		// when the use drops again, the block size decays back towards the initial one
+		if (high_water_mark > block_size * blocks_per_use) {
+			block_size = std::bit_ceil(high_water_mark / blocks_per_use);
+		} else if (high_water_mark < block_size / 2 && block_size > min_block_size) {
+			block_size = std::max(block_size / 2, min_block_size);
+		}
 	}
 
 	// we just destroy the buffers that we have left in the available allocations
 	void BufferLinearAllocator::trim() {
 		std::lock_guard _(mutex);
-		for (size_t i = 0; i < available_allocation_count; i++) {
-			auto& alloc = available_allocations[i];
-			if (alloc.num_blocks > 0) {
-				upstream->deallocate_buffers(std::span{ &alloc.buffer, 1 });
-			}
+		for (auto& [size, buf] : available_allocations) {
+			upstream->deallocate_buffers(std::span{ &buf, 1 });
 		}
-		available_allocation_count = 0;
+		available_allocations.clear();
 	}
 
 	BufferLinearAllocator::~BufferLinearAllocator() {
@@ -175,17 +235,23 @@ namespace vuk {
 		}
 		used_allocation_count = 0;
 
-		for (size_t i = 0; i < available_allocation_count; i++) {
-			auto& buf = available_allocations[i].buffer;
-			if (buf && available_allocations[i].num_blocks > 0) {
-				upstream->deallocate_buffers(std::span{ &buf, 1 });
-			}
+		for (auto& [size, buf] : available_allocations) {
+			upstream->deallocate_buffers(std::span{ &buf, 1 });
 		}
+		available_allocations.clear();
+	}
 
-		available_allocation_count = 0;
+	// slab allocations are marked by the lowest bit of the allocation pointer, which is never set for a SubAllocation
+	static void* encode_slab_allocation(size_t slab_class, uint32_t slot) {
+		return reinterpret_cast<void*>(uintptr_t(slot) << 8 | uintptr_t(slab_class) << 1 | 1);
+	}
+
+	static bool is_slab_allocation(void* allocation) {
+		return (reinterpret_cast<uintptr_t>(allocation) & 1) != 0;
 	}
 
 	Result<Buffer, AllocateException> BufferSubAllocator::allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source) {
+		allocation_count.fetch_add(1, std::memory_order_relaxed);
 		if (size >= block_size) { // allocate-through
 			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = size, .alignment = alignment };
 			Buffer buf;
@@ -197,6 +263,104 @@ namespace vuk {
 			}
 		}
 
+		// slots are aligned to their size, so this only works for power of two alignments
+		if (std::has_single_bit(alignment)) {
+			size_t slab_class = std::max<size_t>(std::bit_width(std::max(size, alignment) - 1), min_slab_class);
+			if (slab_class <= max_slab_class) {
+				auto result = allocate_from_slab(slab_class, source);
+				if (!result) {
+					return result;
+				}
+				if (*result) {
+					result->size = size;
+					return result;
+				}
+			}
+		}
+
+		return allocate_in_blocks(size, alignment, source);
+	}
+
+	Result<Buffer, AllocateException> BufferSubAllocator::allocate_from_slab(size_t slab_class, SourceLocationAtFrame source) {
+		auto& sc = slab_classes[slab_class - min_slab_class];
+		size_t slot_size = size_t(1) << slab_class;
+		uint64_t head = sc.free_head.load(std::memory_order_acquire);
+		while (true) {
+			if (uint32_t(head) == 0) {
+				auto added = add_slab(slab_class, source);
+				if (!added) {
+					return added;
+				}
+				if (!*added) {
+					return { expected_value, Buffer{} };
+				}
+				head = sc.free_head.load(std::memory_order_acquire);
+				continue;
+			}
+			uint32_t slot = uint32_t(head) - 1;
+			// the slab stays even if the slot was taken in the meantime, the tag makes the exchange fail then
+			uint64_t next = sc.slabs[slot / SlabClass::slots_per_slab]->next[slot % SlabClass::slots_per_slab].load(std::memory_order_relaxed);
+			uint64_t new_head = ((head >> 32) + 1) << 32 | next;
+			if (sc.free_head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+				slab_bytes_in_use.fetch_add(slot_size, std::memory_order_relaxed);
+				auto& slab = *sc.slabs[slot / SlabClass::slots_per_slab];
+				Buffer buf = slab.buffer.add_offset((slot % SlabClass::slots_per_slab) * slot_size);
+				buf.allocation = encode_slab_allocation(slab_class, slot);
+				return { expected_value, buf };
+			}
+		}
+	}
+
+	Result<bool, AllocateException> BufferSubAllocator::add_slab(size_t slab_class, SourceLocationAtFrame source) {
+		auto& sc = slab_classes[slab_class - min_slab_class];
+		std::lock_guard _(sc.grow_mutex);
+		// another thread added a slab or freed slots while we waited
+		if (uint32_t(sc.free_head.load(std::memory_order_acquire)) != 0) {
+			return { expected_value, true };
+		}
+		auto slab_index = sc.slab_count.load(std::memory_order_relaxed);
+		size_t slot_size = size_t(1) << slab_class;
+		size_t size = slot_size * SlabClass::slots_per_slab;
+		if (slab_index == SlabClass::max_slabs || size + slot_size >= block_size) {
+			return { expected_value, false };
+		}
+		auto backing = allocate_in_blocks(size, slot_size, source);
+		if (!backing) {
+			return backing;
+		}
+		auto slab = std::make_unique<SlabClass::Slab>();
+		slab->buffer = *backing;
+		uint32_t first_slot = uint32_t(slab_index * SlabClass::slots_per_slab);
+		for (uint32_t i = 0; i < SlabClass::slots_per_slab - 1; i++) {
+			slab->next[i].store(first_slot + i + 2, std::memory_order_relaxed);
+		}
+		auto& last_link = slab->next[SlabClass::slots_per_slab - 1];
+		sc.slabs[slab_index] = std::move(slab);
+		sc.slab_count.store(slab_index + 1, std::memory_order_release);
+		slab_bytes.fetch_add(size, std::memory_order_relaxed);
+
+		// all the slots go on the free list at once
+		uint64_t head = sc.free_head.load(std::memory_order_relaxed);
+		do {
+			last_link.store(uint32_t(head), std::memory_order_relaxed);
+		} while (!sc.free_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (first_slot + 1), std::memory_order_release, std::memory_order_relaxed));
+		return { expected_value, true };
+	}
+
+	void BufferSubAllocator::deallocate_to_slab(const Buffer& buf) {
+		auto bits = reinterpret_cast<uintptr_t>(buf.allocation);
+		size_t slab_class = (bits >> 1) & 0x7f;
+		uint32_t slot = uint32_t(bits >> 8);
+		auto& sc = slab_classes[slab_class - min_slab_class];
+		auto& link = sc.slabs[slot / SlabClass::slots_per_slab]->next[slot % SlabClass::slots_per_slab];
+		uint64_t head = sc.free_head.load(std::memory_order_relaxed);
+		do {
+			link.store(uint32_t(head), std::memory_order_relaxed);
+		} while (!sc.free_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (slot + 1), std::memory_order_release, std::memory_order_relaxed));
+		slab_bytes_in_use.fetch_sub(size_t(1) << slab_class, std::memory_order_relaxed);
+	}
+
+	Result<Buffer, AllocateException> BufferSubAllocator::allocate_in_blocks(size_t size, size_t alignment, SourceLocationAtFrame source) {
 		std::lock_guard _(mutex);
 		
 		VmaVirtualAllocation va;
@@ -230,8 +394,10 @@ namespace vuk {
 			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size, .alignment = 256 };
 			auto result = upstream->allocate_buffers(std::span{ &blocks[block_index].buffer, 1 }, std::span{ &bci, 1 }, source);
 			if (!result) {
+				vmaVirtualFree(virtual_alloc, va);
 				return result;
 			}
+			block_bytes.fetch_add(block_size, std::memory_order_relaxed);
 		}
 		
 		auto aligned_offset = VmaAlignUp(offset - block_index * block_size, alignment);
@@ -239,26 +405,47 @@ namespace vuk {
 		assert(buf.offset % alignment == 0);
 		assert((buf.offset + size) < block_size);
 		buf.size = size;
-		buf.allocation = new SubAllocation{ block_index, va };
+		buf.allocation = new SubAllocation{ block_index, va, vaci.size };
 		blocks[block_index].allocation_count++;
+		block_bytes_in_use.fetch_add(vaci.size, std::memory_order_relaxed);
 		return { expected_value, buf };
 	}
 
 	void BufferSubAllocator::deallocate_buffer(const Buffer& buf) {
+		deallocation_count.fetch_add(1, std::memory_order_relaxed);
+		if (is_slab_allocation(buf.allocation)) {
+			deallocate_to_slab(buf);
+			return;
+		}
 		if (buf.size >= block_size) {
 			upstream->deallocate_buffers(std::span{ &buf, 1 });
 			return;
 		}
+		deallocate_in_blocks(buf);
+	}
+
+	void BufferSubAllocator::deallocate_in_blocks(const Buffer& buf) {
 		std::lock_guard _(mutex);
 		auto sa = static_cast<SubAllocation*>(buf.allocation);
 		vmaVirtualFree(virtual_alloc, sa->allocation);
+		block_bytes_in_use.fetch_sub(sa->size, std::memory_order_relaxed);
 		if (--blocks[sa->block_index].allocation_count == 0) {
 			upstream->deallocate_buffers(std::span{ &blocks[sa->block_index].buffer, 1 });
 			blocks[sa->block_index].buffer = {};
+			block_bytes.fetch_sub(block_size, std::memory_order_relaxed);
 		}
 		delete sa;
 	}
 
+	BufferAllocatorStatistics BufferSubAllocator::get_statistics() const noexcept {
+		return { .allocation_count = allocation_count.load(),
+			       .deallocation_count = deallocation_count.load(),
+			       .slab_bytes = slab_bytes.load(),
+			       .slab_bytes_in_use = slab_bytes_in_use.load(),
+			       .block_bytes = block_bytes.load(),
+			       .block_bytes_in_use = block_bytes_in_use.load() };
+	}
+
 	BufferSubAllocator::BufferSubAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size) :
 	    upstream(&upstream),
 	    mem_usage(mem_usage),
@@ -272,6 +459,11 @@ namespace vuk {
 	}
 
 	BufferSubAllocator::~BufferSubAllocator() {
+		for (auto& sc : slab_classes) {
+			for (size_t i = 0; i < sc.slab_count; i++) {
+				deallocate_in_blocks(sc.slabs[i]->buffer);
+			}
+		}
 		assert(vmaIsVirtualBlockEmpty(virtual_alloc));
 		vmaDestroyVirtualBlock(virtual_alloc);
 	}
@@ -4,9 +4,13 @@
 #include "vuk/Config.hpp"
 #include "vuk/SourceLocation.hpp"
 #include "vuk/Types.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <bit>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <utility>
@@ -23,36 +27,75 @@ namespace vuk {
 		uint64_t base_address = 0;
 	};
 
+	// one entry per block, in chunks of growing size - entries never move, so they can be read while another thread appends
+	struct LinearSegmentTable {
+		static constexpr size_t first_chunk_size = 256;
+		std::array<std::unique_ptr<LinearSegment[]>, 40> chunks;
+
+		LinearSegment& operator[](size_t index) {
+			auto chunk = std::bit_width(index / first_chunk_size + 1) - 1;
+			return chunks[chunk][index - first_chunk_size * ((size_t(1) << chunk) - 1)];
+		}
+
+		// make room for count entries
+		void reserve(size_t count) {
+			for (size_t chunk = 0; count > 0; chunk++) {
+				if (!chunks[chunk]) {
+					chunks[chunk].reset(new LinearSegment[first_chunk_size << chunk]);
+				}
+				count -= std::min(count, first_chunk_size << chunk);
+			}
+		}
+	};
+
 	struct BufferLinearAllocator {
 		DeviceResource* upstream;
 		std::mutex mutex;
 		std::atomic<int> current_buffer = -1;
 		std::atomic<uint64_t> needle = 0;
+		std::atomic<bool> grow_failed = false;
+		// bumped whenever a grow finishes or fails, threads waiting for a block to be allocated wait on this
+		std::atomic<uint32_t> grows = 0;
+		// identifies the contents between resets, sub-blocks that threads hold from an earlier generation are not used anymore
+		std::atomic<uint64_t> generation;
 		MemoryUsage mem_usage;
 		BufferUsageFlags usage;
-		// TODO: convert to deque
-		std::array<LinearSegment, 256> available_allocations; // up to 4 GB of allocations with the default block_size
-		std::array<LinearSegment, 256> used_allocations;      // up to 4 GB of allocations with the default block_size
-		size_t available_allocation_count = 0;
+		// segments returned by reset, by size
+		std::multimap<size_t, Buffer> available_allocations;
+		LinearSegmentTable used_allocations;
 		size_t used_allocation_count = 0;
 
+		// adapts to the high-water mark of the previous use on reset, but never goes below the initial size
 		size_t block_size;
+		size_t min_block_size;
+		static constexpr size_t blocks_per_use = 16;
+		// threads take sub-blocks of this size from the shared needle and bump allocate small buffers from them without contention
+		size_t sub_block_size;
 
 		BufferLinearAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size = 1024 * 1024 * 16) :
 		    upstream(&upstream),
+		    generation(new_generation()),
 		    mem_usage(mem_usage),
 		    usage(buf_usage),
-		    block_size(block_size) {}
+		    block_size(block_size),
+		    min_block_size(block_size),
+		    sub_block_size(std::max(block_size / 256, size_t(256))) {}
 		~BufferLinearAllocator();
 
 		Result<void, AllocateException> grow(size_t num_blocks, SourceLocationAtFrame source);
 		Result<Buffer, AllocateException> allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source);
+		// reserve a range from the shared needle, returning its start
+		Result<uint64_t, AllocateException> reserve(size_t size, size_t alignment, SourceLocationAtFrame source);
+		// the buffer backing a reserved range
+		Buffer buffer_at(uint64_t base, size_t size);
 		// trim the amount of memory to the currently used amount
 		void trim();
 		// return all resources to available
 		void reset();
 		// explicitly release resources
 		void free();
+
+		static uint64_t new_generation();
 	};
 
 	struct BufferBlock {
@@ -63,6 +106,25 @@ namespace vuk {
 	struct SubAllocation {
 		size_t block_index;
 		VmaVirtualAllocation allocation;
+		size_t size;
+	};
+
+	// slots of one power of two size, handed out from slabs that are placed in the blocks like any larger allocation
+	struct SlabClass {
+		static constexpr size_t slots_per_slab = 256;
+		static constexpr size_t max_slabs = 1024;
+
+		struct Slab {
+			Buffer buffer;
+			std::array<std::atomic<uint32_t>, slots_per_slab> next; // free list links, slot index + 1
+		};
+
+		// lock-free free list: the low 32 bits are the first free slot index + 1, the high 32 bits are bumped on every change against ABA
+		std::atomic<uint64_t> free_head = 0;
+		// slabs are only added, under the mutex, and are kept until the allocator is destroyed
+		std::mutex grow_mutex;
+		std::atomic<size_t> slab_count = 0;
+		std::array<std::unique_ptr<Slab>, max_slabs> slabs;
 	};
 
 	struct BufferSubAllocator {
@@ -74,10 +136,44 @@ namespace vuk {
 		std::mutex mutex;
 		size_t block_size;
 
+		// small allocations with power of two alignment take a slot of the smallest class that fits, without taking the mutex
+		static constexpr size_t min_slab_class = 6;  // 64 B
+		static constexpr size_t max_slab_class = 16; // 64 KiB
+		std::array<SlabClass, max_slab_class - min_slab_class + 1> slab_classes;
+
+		std::atomic<uint64_t> allocation_count = 0;
+		std::atomic<uint64_t> deallocation_count = 0;
+		std::atomic<size_t> slab_bytes = 0;
+		std::atomic<size_t> slab_bytes_in_use = 0;
+		std::atomic<size_t> block_bytes = 0;
+		std::atomic<size_t> block_bytes_in_use = 0;
+
 		BufferSubAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size);
 		~BufferSubAllocator();
 
 		Result<Buffer, AllocateException> allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source);
 		void deallocate_buffer(const Buffer& buf);
+		BufferAllocatorStatistics get_statistics() const noexcept;
+
+	private:
+		// a null buffer when the class has no slabs left
+		Result<Buffer, AllocateException> allocate_from_slab(size_t slab_class, SourceLocationAtFrame source);
+		// false when the class has no slabs left
+		Result<bool, AllocateException> add_slab(size_t slab_class, SourceLocationAtFrame source);
+		void deallocate_to_slab(const Buffer& buf);
+		Result<Buffer, AllocateException> allocate_in_blocks(size_t size, size_t alignment, SourceLocationAtFrame source);
+		void deallocate_in_blocks(const Buffer& buf);
 	};
+
+	// only the highest value per semaphore needs to be waited for, so this stays as small as the number of queues
+	inline void add_timeline_values(std::vector<TimelineValue>& dst, std::span<const TimelineValue> src) {
+		for (auto& tv : src) {
+			auto it = std::find_if(dst.begin(), dst.end(), [&](const TimelineValue& o) { return o.semaphore == tv.semaphore; });
+			if (it == dst.end()) {
+				dst.push_back(tv);
+			} else {
+				it->value = std::max(it->value, tv.value);
+			}
+		}
+	}
 }; // namespace vuk
@@ -1,10 +1,14 @@
 #include "vuk/CommandBuffer.hpp"
+#include "RenderGraphImpl.hpp"
 #include "RenderGraphUtil.hpp"
 #include "fmt/printf.h"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/RenderGraph.hpp"
+#include "vuk/TaskPool.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 
 #define VUK_EARLY_RET()                                                                                                                                        \
@@ -70,6 +74,52 @@ namespace vuk {
 	    ongoing_render_pass(ongoing),
 	    ds_strategy_flags(ctx.default_descriptor_set_strategy) {}
 
+	CommandBuffer::CommandBuffer(const CommandBuffer& parent, VkCommandBuffer cb) :
+	    rg(parent.rg),
+	    ctx(parent.ctx),
+	    allocator(parent.allocator),
+	    command_buffer(cb),
+	    ongoing_render_pass(parent.ongoing_render_pass),
+	    current_pass(parent.current_pass),
+	    dynamic_state_flags(parent.dynamic_state_flags),
+	    next_pipeline(parent.next_pipeline),
+	    next_compute_pipeline(parent.next_compute_pipeline),
+	    next_ray_tracing_pipeline(parent.next_ray_tracing_pipeline),
+	    current_graphics_pipeline(parent.current_graphics_pipeline),
+	    current_compute_pipeline(parent.current_compute_pipeline),
+	    current_ray_tracing_pipeline(parent.current_ray_tracing_pipeline),
+	    topology(parent.topology),
+	    set_attribute_descriptions(parent.set_attribute_descriptions),
+	    set_binding_descriptions(parent.set_binding_descriptions),
+	    spec_map_entries(parent.spec_map_entries),
+	    rasterization_state(parent.rasterization_state),
+	    depth_stencil_state(parent.depth_stencil_state),
+	    conservative_state(parent.conservative_state),
+	    broadcast_color_blend_attachment_0(parent.broadcast_color_blend_attachment_0),
+	    set_color_blend_attachments(parent.set_color_blend_attachments),
+	    color_blend_attachments(parent.color_blend_attachments),
+	    blend_constants(parent.blend_constants),
+	    line_width(parent.line_width),
+	    viewports(parent.viewports),
+	    scissors(parent.scissors),
+	    pcrs(parent.pcrs),
+	    ds_strategy_flags(parent.ds_strategy_flags),
+	    sets_used(parent.sets_used),
+	    sets_to_bind(parent.sets_to_bind),
+	    persistent_sets_to_bind(parent.persistent_sets_to_bind),
+	    persistent_sets_used(parent.persistent_sets_used),
+	    sets_to_rebind(parent.sets_to_rebind),
+	    record_jobs_in_order(true) {
+		std::copy(std::begin(parent.attribute_descriptions), std::end(parent.attribute_descriptions), std::begin(attribute_descriptions));
+		std::copy(std::begin(parent.binding_descriptions), std::end(parent.binding_descriptions), std::begin(binding_descriptions));
+		std::copy(std::begin(parent.push_constant_buffer), std::end(parent.push_constant_buffer), std::begin(push_constant_buffer));
+		std::copy(std::begin(parent.set_layouts_used), std::end(parent.set_layouts_used), std::begin(set_layouts_used));
+		std::copy(std::begin(parent.set_bindings), std::end(parent.set_bindings), std::begin(set_bindings));
+		std::copy(std::begin(parent.persistent_sets), std::end(parent.persistent_sets), std::begin(persistent_sets));
+		// nothing is bound in a new command buffer
+		_invalidate_bound_state();
+	}
+
 	const CommandBuffer::RenderPassInfo& CommandBuffer::get_ongoing_render_pass() const {
 		return ongoing_render_pass.value();
 	}
@@ -1138,6 +1188,142 @@ namespace vuk {
 		return *this;
 	}
 
+	CommandBuffer& CommandBuffer::record_parallel(size_t job_count, std::function<void(CommandBuffer&, size_t)> job, TaskPool* task_pool) {
+		VUK_EARLY_RET();
+		assert(current_pass);
+		if (job_count == 0) {
+			return *this;
+		}
+
+		// a render pass begun inline can't execute secondary command buffers, so the jobs are recorded in order into this command buffer
+		if (record_jobs_in_order || (ongoing_render_pass && !inheritance)) {
+			for (size_t i = 0; i < job_count; i++) {
+				CommandBuffer child(*this, command_buffer);
+				job(child, i);
+				if (auto res = child.result(); !res) {
+					current_error = std::move(res);
+					return *this;
+				}
+			}
+			_invalidate_bound_state();
+			return *this;
+		}
+
+		// command pools can't be used from multiple threads, so each recording task gets its own
+		auto task_count = task_pool ? std::min(task_pool->concurrency(), job_count) : 1;
+		VkCommandPoolCreateInfo cpci{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		cpci.flags = VkCommandPoolCreateFlagBits::VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		cpci.queueFamilyIndex = ctx.domain_to_queue_family_index(current_pass->domain);
+		std::vector<Unique<CommandPool>> cpools;
+		cpools.reserve(task_count);
+		for (size_t i = 0; i < task_count; i++) {
+			auto& cpool = cpools.emplace_back(*allocator);
+			if (auto res = allocator->allocate_command_pools(std::span{ &*cpool, 1 }, std::span{ &cpci, 1 }); !res) {
+				current_error = std::move(res);
+				return *this;
+			}
+		}
+
+		VkCommandBufferInheritanceInfo job_inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		VkCommandBufferBeginInfo cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			                            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			                            .pInheritanceInfo = &job_inheritance };
+		if (ongoing_render_pass) {
+			job_inheritance = *inheritance;
+			cbi.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		}
+
+		std::vector<CommandBufferAllocation> job_cbufs(job_count);
+		std::vector<std::optional<Result<void>>> errors(job_count);
+		std::atomic<size_t> next_job = 0;
+		auto record_jobs = [&](size_t task) {
+			for (size_t i = next_job++; i < job_count; i = next_job++) {
+				CommandBufferAllocationCreateInfo ci{ .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .command_pool = *cpools[task] };
+				if (auto res = allocator->allocate_command_buffers(std::span{ &job_cbufs[i], 1 }, std::span{ &ci, 1 }); !res) {
+					errors[i].emplace(std::move(res));
+					continue;
+				}
+				VkCommandBuffer cbuf = job_cbufs[i].command_buffer;
+				ctx.vkBeginCommandBuffer(cbuf, &cbi);
+				CommandBuffer child(*this, cbuf);
+				job(child, i);
+				auto res = child.result();
+				if (auto result = ctx.vkEndCommandBuffer(cbuf); result != VK_SUCCESS && res) {
+					res = Result<void>{ expected_error, VkException{ result } };
+				}
+				if (!res) {
+					errors[i].emplace(std::move(res));
+				}
+			}
+		};
+		if (task_pool) {
+			task_pool->parallel_for(task_count, record_jobs);
+		} else {
+			record_jobs(0);
+		}
+
+		for (auto& error : errors) {
+			if (error) {
+				current_error = std::move(*error);
+				return *this;
+			}
+		}
+
+		std::vector<VkCommandBuffer> job_handles(job_count);
+		for (size_t i = 0; i < job_count; i++) {
+			job_handles[i] = job_cbufs[i].command_buffer;
+		}
+		if (!inheritance) {
+			ctx.vkCmdExecuteCommands(command_buffer, (uint32_t)job_count, job_handles.data());
+		} else {
+			// a secondary command buffer can't execute others, so continue in a new one after the jobs
+			// the job pools are given back when we return, so the continuation comes from the pool of the command buffer it continues
+			if (auto result = ctx.vkEndCommandBuffer(command_buffer); result != VK_SUCCESS) {
+				current_error = Result<void>{ expected_error, VkException{ result } };
+				return *this;
+			}
+			previous_segments.push_back(command_buffer);
+			previous_segments.insert(previous_segments.end(), job_handles.begin(), job_handles.end());
+
+			CommandBufferAllocation continuation;
+			assert(segment_pool.command_pool != VK_NULL_HANDLE);
+			CommandBufferAllocationCreateInfo ci{ .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .command_pool = segment_pool };
+			if (auto res = allocator->allocate_command_buffers(std::span{ &continuation, 1 }, std::span{ &ci, 1 }); !res) {
+				current_error = std::move(res);
+				return *this;
+			}
+			command_buffer = continuation.command_buffer;
+			ctx.vkBeginCommandBuffer(command_buffer, &cbi);
+		}
+		_invalidate_bound_state();
+		return *this;
+	}
+
+	void CommandBuffer::_invalidate_bound_state() {
+		if (!next_pipeline && current_graphics_pipeline && ongoing_render_pass) {
+			next_pipeline = current_graphics_pipeline->base;
+		}
+		if (!next_compute_pipeline && current_compute_pipeline) {
+			next_compute_pipeline = current_compute_pipeline->base;
+		}
+		if (!next_ray_tracing_pipeline && current_ray_tracing_pipeline) {
+			next_ray_tracing_pipeline = current_ray_tracing_pipeline->base;
+		}
+		for (size_t i = 0; i < VUK_MAX_SETS; i++) {
+			bool used;
+			VUK_SB_TEST(sets_used, i, used);
+			if (used) {
+				VUK_SB_SET(sets_to_rebind, i, true);
+			}
+			set_layouts_used[i] = VK_NULL_HANDLE;
+		}
+		sets_used.reset();
+		// dynamic state is flushed again
+		auto flags = dynamic_state_flags;
+		dynamic_state_flags = {};
+		set_dynamic_state(flags);
+	}
+
 	Result<void> CommandBuffer::result() {
 		return std::move(current_error);
 	}
@@ -1234,6 +1420,18 @@ namespace vuk {
 			}
 			pipeline_set_layout = ds_layout_alloc_info->layout;
 
+			bool to_rebind;
+			VUK_SB_TEST(sets_to_rebind, set_index, to_rebind);
+			if (to_rebind && pipeline_set_layout != VK_NULL_HANDLE && !set_to_bind && !persistent_set_to_bind) {
+				VUK_SB_TEST(persistent_sets_used, set_index, persistent_set_to_bind);
+				set_to_bind = !persistent_set_to_bind;
+				if (persistent_set_to_bind) {
+					VUK_SB_SET(persistent_sets_to_bind, set_index, true);
+				} else {
+					VUK_SB_SET(sets_to_bind, set_index, true);
+				}
+			}
+
 			// binding validation
 			if (pipeline_set_layout != VK_NULL_HANDLE) { // set in the layout
 				bool is_used;
@@ -1427,10 +1625,13 @@ namespace vuk {
 
 				ctx.vkCmdBindDescriptorSets(command_buffer, bind_point, current_layout, (uint32_t)set_index, 1, &ds->descriptor_set, 0, nullptr);
 				set_layouts_used[set_index] = ds->layout_info.layout;
+				VUK_SB_SET(persistent_sets_used, set_index, false);
 			} else {
 				ctx.vkCmdBindDescriptorSets(command_buffer, bind_point, current_layout, (uint32_t)set_index, 1, &persistent_sets[set_index].first, 0, nullptr);
 				set_layouts_used[set_index] = persistent_sets[set_index].second;
+				VUK_SB_SET(persistent_sets_used, set_index, true);
 			}
+			VUK_SB_SET(sets_to_rebind, set_index, false);
 		}
 		auto sets_bound = sets_to_bind | persistent_sets_to_bind;            // these sets we bound freshly, valid
 		for (uint64_t i = lowest_disturbed_binding; i < VUK_MAX_SETS; i++) { // clear the slots where the binding was disturbed
@@ -116,19 +116,21 @@ namespace vuk {
 		} else {
 			transfer_queue_family_index = compute_queue ? params.compute_queue_family_index : params.graphics_queue_family_index;
 		}
-		impl = new ContextImpl(*this);
+		impl = new ContextImpl(*this, params);
 
 		{
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_graphics_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.graphics_queue, params.graphics_queue_family_index, ts);
+			dedicated_graphics_queue.emplace(
+			    this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.graphics_queue, params.graphics_queue_family_index, ts, params.use_submission_threads);
 			set_name(params.graphics_queue, "Graphics Queue");
 			graphics_queue = &dedicated_graphics_queue.value();
 		}
 		if (dedicated_compute_queue_) {
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_compute_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.compute_queue, params.compute_queue_family_index, ts);
+			dedicated_compute_queue.emplace(
+			    this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.compute_queue, params.compute_queue_family_index, ts, params.use_submission_threads);
 			set_name(params.compute_queue, "Compute Queue");
 			compute_queue = &dedicated_compute_queue.value();
 		} else {
@@ -137,7 +139,8 @@ namespace vuk {
 		if (dedicated_transfer_queue_) {
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_transfer_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.transfer_queue, params.transfer_queue_family_index, ts);
+			dedicated_transfer_queue.emplace(
+			    this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.transfer_queue, params.transfer_queue_family_index, ts, params.use_submission_threads);
 			set_name(params.transfer_queue, "Transfer Queue");
 			transfer_queue = &dedicated_transfer_queue.value();
 		} else {
@@ -818,6 +821,11 @@ namespace vuk {
 
 	Context::~Context() {
 		if (impl) {
+			for (auto& queue : { &dedicated_graphics_queue, &dedicated_compute_queue, &dedicated_transfer_queue }) {
+				if (*queue) {
+					(*queue)->flush();
+				}
+			}
 			this->vkDeviceWaitIdle(device);
 
 			for (auto& s : impl->swapchains) {
@@ -855,6 +863,12 @@ namespace vuk {
 	}
 
 	Result<void> Context::wait_idle() {
+		// submission threads take the queue locks to submit, so they are flushed first
+		for (auto& queue : { &dedicated_graphics_queue, &dedicated_compute_queue, &dedicated_transfer_queue }) {
+			if (*queue) {
+				(*queue)->flush();
+			}
+		}
 		std::unique_lock<std::recursive_mutex> graphics_lock;
 		if (dedicated_graphics_queue) {
 			graphics_lock = std::unique_lock{ graphics_queue->get_queue_lock() };
@@ -75,9 +75,9 @@ namespace vuk {
 			}
 		}
 
-		ContextImpl(Context& ctx) :
+		ContextImpl(Context& ctx, const ContextCreateParameters& params) :
 		    device(ctx.device),
-		    device_vk_resource(std::make_unique<DeviceVkResource>(ctx)),
+		    device_vk_resource(std::make_unique<DeviceVkResource>(ctx, params.image_pool_block_sizes, params.memory_budget_extension)),
 		    direct_allocator(*device_vk_resource.get()),
 		    pipelinebase_cache(&ctx, &FN<struct PipelineBaseInfo>::create_fn, &FN<struct PipelineBaseInfo>::destroy_fn),
 		    pool_cache(&ctx, &FN<struct DescriptorPool>::create_fn, &FN<struct DescriptorPool>::destroy_fn),
@@ -7,6 +7,8 @@
 #include "vuk/PipelineInstance.hpp"
 #include "vuk/Query.hpp"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <numeric>
@@ -117,6 +119,15 @@ namespace vuk {
 		}
 	};
 
+	// a command pool that stays with a frame - it is reset when the frame is recycled, and the command buffers allocated from it are handed out again
+	struct FrameCommandPool {
+		CommandPool command_pool;
+		bool in_use = false;
+		// by VkCommandBufferLevel
+		std::array<std::vector<VkCommandBuffer>, 2> command_buffers;
+		std::array<size_t, 2> used = {};
+	};
+
 	struct DeviceFrameResourceImpl {
 		Context* ctx;
 		std::mutex sema_mutex;
@@ -125,9 +136,14 @@ namespace vuk {
 		std::vector<Buffer> buffers;
 		std::mutex fence_mutex;
 		std::vector<VkFence> fences;
+		std::mutex event_mutex;
+		// events stay with the frame and are reset when it is recycled
+		std::vector<VkEvent> events;
+		size_t events_used = 0;
+		std::vector<VkEvent> events_to_free;
 		std::mutex cbuf_mutex;
 		std::vector<CommandBufferAllocation> cmdbuffers_to_free;
-		std::vector<CommandPool> cmdpools_to_free;
+		std::vector<std::unique_ptr<FrameCommandPool>> cmdpools;
 		std::mutex framebuffer_mutex;
 		std::vector<VkFramebuffer> framebuffers;
 		std::mutex images_mutex;
@@ -153,6 +169,7 @@ namespace vuk {
 		uint64_t current_ts_pool = 0;
 		std::mutex tsema_mutex;
 		std::vector<TimelineSemaphore> tsemas;
+		std::vector<TimelineValue> tvalues;
 		std::mutex as_mutex;
 		std::vector<VkAccelerationStructureKHR> ass;
 		std::mutex swapchain_mutex;
@@ -202,28 +219,83 @@ namespace vuk {
 
 	void DeviceFrameResource::deallocate_fences(std::span<const VkFence> src) {} // noop
 
+	Result<void, AllocateException> DeviceFrameResource::allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		std::unique_lock _(impl->event_mutex);
+		auto& pool = impl->events;
+		for (auto& event : dst) {
+			if (impl->events_used == pool.size()) {
+				VUK_DO_OR_RETURN(upstream->allocate_events(std::span{ &event, 1 }, loc));
+				pool.push_back(event);
+			}
+			event = pool[impl->events_used++];
+		}
+		return { expected_value };
+	}
+
+	void DeviceFrameResource::deallocate_events(std::span<const VkEvent> src) {} // no-op, recycled with the frame
+
 	Result<void, AllocateException> DeviceFrameResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 	                                                                              std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                              SourceLocationAtFrame loc) {
-		VUK_DO_OR_RETURN(upstream->allocate_command_buffers(dst, cis, loc));
+		assert(dst.size() == cis.size());
 		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdbuffers_to_free;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			auto& ci = cis[i];
+			auto it = std::find_if(impl->cmdpools.begin(), impl->cmdpools.end(), [&](auto& p) { return p->command_pool.command_pool == ci.command_pool.command_pool; });
+			if (it == impl->cmdpools.end()) {
+				// pool not from this frame
+				VUK_DO_OR_RETURN(upstream->allocate_command_buffers(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc));
+				impl->cmdbuffers_to_free.push_back(dst[i]);
+				continue;
+			}
+			auto& pool = **it;
+			auto level = ci.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1;
+			auto& cbufs = pool.command_buffers[level];
+			if (pool.used[level] == cbufs.size()) {
+				VUK_DO_OR_RETURN(upstream->allocate_command_buffers(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc));
+				cbufs.push_back(dst[i].command_buffer);
+			}
+			dst[i] = CommandBufferAllocation{ cbufs[pool.used[level]++], pool.command_pool };
+		}
 		return { expected_value };
 	}
 
-	void DeviceFrameResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> src) {} // no-op, deallocated with pools
+	void DeviceFrameResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> src) {} // no-op, recycled with pools
 
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) {
-		VUK_DO_OR_RETURN(upstream->allocate_command_pools(dst, cis, loc));
+		assert(dst.size() == cis.size());
 		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdpools_to_free;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		// a pool is only handed out to one user at a time, so that it is not used from multiple threads at once
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			auto& ci = cis[i];
+			auto it = std::find_if(
+			    impl->cmdpools.begin(), impl->cmdpools.end(), [&](auto& p) { return !p->in_use && p->command_pool.queue_family_index == ci.queueFamilyIndex; });
+			if (it == impl->cmdpools.end()) {
+				auto& pool = impl->cmdpools.emplace_back(std::make_unique<FrameCommandPool>());
+				if (auto res = upstream->allocate_command_pools(std::span{ &pool->command_pool, 1 }, std::span{ &ci, 1 }, loc); !res) {
+					impl->cmdpools.pop_back();
+					return res;
+				}
+				it = impl->cmdpools.end() - 1;
+			}
+			(*it)->in_use = true;
+			dst[i] = (*it)->command_pool;
+		}
 		return { expected_value };
 	}
 
-	void DeviceFrameResource::deallocate_command_pools(std::span<const CommandPool> dst) {} // no-op
+	void DeviceFrameResource::deallocate_command_pools(std::span<const CommandPool> src) {
+		std::unique_lock _(impl->cbuf_mutex);
+		// the pool can be handed out again in this frame, but it is only reset when the frame is recycled
+		for (auto& p : src) {
+			for (auto& pool : impl->cmdpools) {
+				if (pool->command_pool.command_pool == p.command_pool) {
+					pool->in_use = false;
+				}
+			}
+		}
+	}
 
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
@@ -271,6 +343,16 @@ namespace vuk {
 
 	void DeviceFrameResource::deallocate_images(std::span<const Image> src) {} // noop
 
+	// aliased images are not cached, they are destroyed when the frame is recycled
+	Result<void, AllocateException>
+	DeviceFrameResource::allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_aliased_images(dst, cis, loc));
+		std::unique_lock _(impl->images_mutex);
+		auto& vec = impl->images;
+		vec.insert(vec.end(), dst.begin(), dst.end());
+		return { expected_value };
+	}
+
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(static_cast<DeviceSuperFrameResource*>(upstream)->allocate_cached_image_views(dst, cis, loc));
@@ -423,6 +505,11 @@ namespace vuk {
 
 	void DeviceFrameResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
+	void DeviceFrameResource::track_timeline_values(std::span<const TimelineValue> src) {
+		std::unique_lock _(impl->tsema_mutex);
+		add_timeline_values(impl->tvalues, src);
+	}
+
 	void DeviceFrameResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {
 		std::scoped_lock _(impl->swapchain_mutex);
 
@@ -503,7 +590,7 @@ namespace vuk {
 				impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX);
 			}
 		}
-		if (impl->tsemas.size() > 0) {
+		if (impl->tsemas.size() > 0 || impl->tvalues.size() > 0) {
 			VkSemaphoreWaitInfo swi{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
 
 			std::vector<VkSemaphore> semas(impl->tsemas.size());
@@ -513,9 +600,13 @@ namespace vuk {
 				semas[i] = impl->tsemas[i].semaphore;
 				values[i] = *impl->tsemas[i].value;
 			}
+			for (auto& tv : impl->tvalues) {
+				semas.push_back(tv.semaphore);
+				values.push_back(tv.value);
+			}
 			swi.pSemaphores = semas.data();
 			swi.pValues = values.data();
-			swi.semaphoreCount = (uint32_t)impl->tsemas.size();
+			swi.semaphoreCount = (uint32_t)semas.size();
 			impl->ctx->vkWaitSemaphores(device, &swi, UINT64_MAX);
 		}
 	}
@@ -560,6 +651,14 @@ namespace vuk {
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
+	void DeviceSuperFrameResource::deallocate_events(std::span<const VkEvent> src) {
+		std::shared_lock _s(impl->new_frame_mutex);
+		auto& f = get_last_frame();
+		std::unique_lock _(f.impl->event_mutex);
+		auto& vec = f.impl->events_to_free;
+		vec.insert(vec.end(), src.begin(), src.end());
+	}
+
 	void DeviceSuperFrameResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
@@ -725,6 +824,13 @@ namespace vuk {
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
+	void DeviceSuperFrameResource::track_timeline_values(std::span<const TimelineValue> src) {
+		std::shared_lock _s(impl->new_frame_mutex);
+		auto& f = get_last_frame();
+		std::unique_lock _(f.impl->tsema_mutex);
+		add_timeline_values(f.impl->tvalues, src);
+	}
+
 	void DeviceSuperFrameResource::deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
@@ -779,6 +885,10 @@ namespace vuk {
 	}
 
 	DeviceFrameResource& DeviceSuperFrameResource::get_next_frame() {
+		// outside of lock too, the memory pressure callbacks might deallocate into the superframe
+		if (direct) {
+			direct->update_memory_budget(impl->frame_counter.load() + 1);
+		}
 		// trim here, outside of lock, to prevent deadlocking, as trim may release memory to the superframe
 		{
 			auto& trim_frame = impl->frames[impl->frame_counter % frames_in_flight];
@@ -809,6 +919,7 @@ namespace vuk {
 			if (multi_frame.remaining_lifetime == 0) {
 				multi_frame.wait();
 				deallocate_frame(multi_frame);
+				release_pools(multi_frame);
 				it = impl->multi_frames.erase(it);
 			} else {
 				++it;
@@ -840,11 +951,18 @@ namespace vuk {
 		auto& f = *frame.impl;
 		upstream->deallocate_semaphores(f.semaphores);
 		upstream->deallocate_fences(f.fences);
+		for (size_t i = 0; i < f.events_used; i++) {
+			get_context().vkResetEvent(get_context().device, f.events[i]);
+		}
+		f.events_used = 0;
+		upstream->deallocate_events(f.events_to_free);
 		upstream->deallocate_command_buffers(f.cmdbuffers_to_free);
-		for (auto& pool : f.cmdpools_to_free) {
-			direct->ctx->vkResetCommandPool(get_context().device, pool.command_pool, {});
+		for (auto& pool : f.cmdpools) {
+			// through the context, as direct is not set when nested into another resource
+			get_context().vkResetCommandPool(get_context().device, pool->command_pool.command_pool, {});
+			pool->in_use = false;
+			pool->used = {};
 		}
-		deallocate_command_pools(f.cmdpools_to_free);
 		for (Buffer& buf : f.buffer_gpus) {
 			impl->suballocators[(int)buf.memory_usage - 1].deallocate_buffer(buf);
 		}
@@ -873,9 +991,9 @@ namespace vuk {
 
 		f.semaphores.clear();
 		f.fences.clear();
+		f.events_to_free.clear();
 		f.buffer_gpus.clear();
 		f.cmdbuffers_to_free.clear();
-		f.cmdpools_to_free.clear();
 		f.ds_pools.clear();
 		if (direct) {
 			f.linear_cpu_only.reset();
@@ -891,6 +1009,7 @@ namespace vuk {
 		f.ts_query_pools.clear();
 		f.query_index = 0;
 		f.tsemas.clear();
+		f.tvalues.clear();
 		f.ass.clear();
 		f.swapchains.clear();
 		f.buffers.clear();
@@ -901,6 +1020,22 @@ namespace vuk {
 		f.render_passes.clear();
 	}
 
+	void DeviceSuperFrameResource::release_pools(DeviceFrameResource& frame) {
+		auto& f = *frame.impl;
+		upstream->deallocate_events(f.events);
+		f.events.clear();
+		for (auto& pool : f.cmdpools) {
+			for (auto& cbufs : pool->command_buffers) {
+				for (auto& cbuf : cbufs) {
+					CommandBufferAllocation cba{ cbuf, pool->command_pool };
+					upstream->deallocate_command_buffers(std::span{ &cba, 1 });
+				}
+			}
+			deallocate_command_pools(std::span{ &pool->command_pool, 1 });
+		}
+		f.cmdpools.clear();
+	}
+
 	void DeviceSuperFrameResource::force_collect() {
 		impl->image_cache.collect(impl->frame_counter, 0);
 		impl->image_view_cache.collect(impl->frame_counter, 0);
@@ -910,6 +1045,10 @@ namespace vuk {
 		impl->render_pass_cache.collect(impl->frame_counter, 0);
 	}
 
+	BufferAllocatorStatistics DeviceSuperFrameResource::get_buffer_statistics(MemoryUsage mem_usage) const {
+		return impl->suballocators[(int)mem_usage - 1].get_statistics();
+	}
+
 	DeviceSuperFrameResource::~DeviceSuperFrameResource() {
 		impl->image_cache.clear();
 		impl->image_view_cache.clear();
@@ -933,6 +1072,7 @@ namespace vuk {
 			auto lframe = (impl->frame_counter + i) % frames_in_flight;
 			auto& f = impl->frames[lframe];
 			deallocate_frame(f);
+			release_pools(f);
 			f.DeviceFrameResource::~DeviceFrameResource();
 		}
 		for (uint32_t i = 0; i < (uint32_t)impl->command_pools.size(); i++) {
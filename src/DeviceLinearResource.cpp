@@ -17,6 +17,7 @@ namespace vuk {
 		std::vector<VkSemaphore> semaphores;
 		std::vector<Buffer> buffers;
 		std::vector<VkFence> fences;
+		std::vector<VkEvent> events;
 		std::vector<CommandBufferAllocation> cmdbuffers_to_free;
 		std::vector<CommandPool> cmdpools_to_free;
 		std::vector<VkFramebuffer> framebuffers;
@@ -30,6 +31,7 @@ namespace vuk {
 		uint64_t query_index = 0;
 		uint64_t current_ts_pool = 0;
 		std::vector<TimelineSemaphore> tsemas;
+		std::vector<TimelineValue> tvalues;
 		std::vector<VkAccelerationStructureKHR> ass;
 
 		BufferLinearAllocator linear_cpu_only;
@@ -80,6 +82,15 @@ namespace vuk {
 
 	void DeviceLinearResource::deallocate_fences(std::span<const VkFence> src) {} // noop
 
+	Result<void, AllocateException> DeviceLinearResource::allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_events(dst, loc));
+		auto& vec = impl->events;
+		vec.insert(vec.end(), dst.begin(), dst.end());
+		return { expected_value };
+	}
+
+	void DeviceLinearResource::deallocate_events(std::span<const VkEvent> src) {} // noop
+
 	Result<void, AllocateException> DeviceLinearResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 	                                                                               std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                               SourceLocationAtFrame loc) {
@@ -148,6 +159,14 @@ namespace vuk {
 
 	void DeviceLinearResource::deallocate_images(std::span<const Image> src) {} // noop
 
+	Result<void, AllocateException>
+	DeviceLinearResource::allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_aliased_images(dst, cis, loc));
+		auto& vec = impl->images;
+		vec.insert(vec.end(), dst.begin(), dst.end());
+		return { expected_value };
+	}
+
 	Result<void, AllocateException>
 	DeviceLinearResource::allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_image_views(dst, cis, loc));
@@ -286,6 +305,10 @@ namespace vuk {
 
 	void DeviceLinearResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
+	void DeviceLinearResource::track_timeline_values(std::span<const TimelineValue> src) {
+		add_timeline_values(impl->tvalues, src);
+	}
+
 	void DeviceLinearResource::wait() {
 		if (impl->fences.size() > 0) {
 			if (impl->fences.size() > 64) {
@@ -298,7 +321,7 @@ namespace vuk {
 				impl->ctx->vkWaitForFences(impl->device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX);
 			}
 		}
-		if (impl->tsemas.size() > 0) {
+		if (impl->tsemas.size() > 0 || impl->tvalues.size() > 0) {
 			VkSemaphoreWaitInfo swi{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
 
 			std::vector<VkSemaphore> semas(impl->tsemas.size());
@@ -308,9 +331,13 @@ namespace vuk {
 				semas[i] = impl->tsemas[i].semaphore;
 				values[i] = *impl->tsemas[i].value;
 			}
+			for (auto& tv : impl->tvalues) {
+				semas.push_back(tv.semaphore);
+				values.push_back(tv.value);
+			}
 			swi.pSemaphores = semas.data();
 			swi.pValues = values.data();
-			swi.semaphoreCount = (uint32_t)impl->tsemas.size();
+			swi.semaphoreCount = (uint32_t)semas.size();
 			impl->ctx->vkWaitSemaphores(impl->device, &swi, UINT64_MAX);
 		}
 	}
@@ -319,6 +346,7 @@ namespace vuk {
 		auto& f = *impl;
 		upstream->deallocate_semaphores(f.semaphores);
 		upstream->deallocate_fences(f.fences);
+		upstream->deallocate_events(f.events);
 		upstream->deallocate_command_buffers(f.cmdbuffers_to_free);
 		for (auto& pool : f.cmdpools_to_free) {
 			f.ctx->vkResetCommandPool(f.device, pool.command_pool, {});
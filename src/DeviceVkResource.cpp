@@ -16,9 +16,13 @@
 		printf("\n");                                                                                                                                              \
 	} while (false)
 #endif
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <numeric>
 #include <sstream>
+#include <tuple>
 #include <vk_mem_alloc.h>
 
 namespace vuk {
@@ -45,15 +49,78 @@ namespace vuk {
 		}
 	}
 
+	namespace {
+		enum ImagePoolClass { ePoolRenderTargets, ePoolStorageImages, ePoolSampledImages, ePoolCount };
+
+		ImagePoolClass classify_image(ImageUsageFlags usage) {
+			if (usage & (ImageUsageFlagBits::eColorAttachment | ImageUsageFlagBits::eDepthStencilAttachment)) {
+				return ePoolRenderTargets;
+			} else if (usage & ImageUsageFlagBits::eStorage) {
+				return ePoolStorageImages;
+			}
+			return ePoolSampledImages;
+		}
+	} // namespace
+
 	struct DeviceVkResourceImpl {
 		std::mutex mutex;
 		VmaAllocator allocator;
 		VkPhysicalDeviceProperties properties;
 		std::vector<uint32_t> all_queue_families;
 		uint32_t queue_family_count;
+
+		std::array<VkDeviceSize, ePoolCount> image_pool_block_sizes;
+		// created on first use, per usage class and memory type
+		std::array<std::array<VmaPool, VK_MAX_MEMORY_TYPES>, ePoolCount> image_pools = {};
+
+		// indexed by MemoryUsage
+		std::array<std::atomic<VkDeviceSize>, 5> allocated_bytes = {};
+
+		struct PressureCallback {
+			uint64_t id;
+			float watermark;
+			MemoryPressureCallback callback;
+			std::array<bool, VK_MAX_MEMORY_HEAPS> over = {};
+		};
+		std::mutex budget_mutex;
+		std::vector<MemoryHeapBudget> budgets;
+		std::vector<PressureCallback> pressure_callbacks;
+		uint64_t next_pressure_callback_id = 0;
+
+		void track_allocation(MemoryUsage usage, VmaAllocation allocation, bool allocated) {
+			VmaAllocationInfo info;
+			vmaGetAllocationInfo(allocator, allocation, &info);
+			if (allocated) {
+				allocated_bytes[to_integral(usage)] += info.size;
+			} else {
+				allocated_bytes[to_integral(usage)] -= info.size;
+			}
+		}
+
+		VmaPool get_image_pool(ImagePoolClass cls, uint32_t memory_type_index) {
+			auto& pool = image_pools[cls][memory_type_index];
+			if (pool == VK_NULL_HANDLE) {
+				VmaPoolCreateInfo pci{};
+				pci.memoryTypeIndex = memory_type_index;
+				pci.blockSize = image_pool_block_sizes[cls];
+				if (vmaCreatePool(allocator, &pci, &pool) != VK_SUCCESS) {
+					pool = VK_NULL_HANDLE;
+				}
+			}
+			return pool;
+		}
 	};
 
-	DeviceVkResource::DeviceVkResource(Context& ctx) : ctx(&ctx), impl(new DeviceVkResourceImpl), device(ctx.device) {
+	DeviceVkResource::DeviceVkResource(Context& ctx) : DeviceVkResource(ctx, ImagePoolBlockSizes{}) {}
+
+	DeviceVkResource::DeviceVkResource(Context& ctx, const ImagePoolBlockSizes& image_pool_block_sizes, bool memory_budget_extension) :
+	    ctx(&ctx),
+	    impl(new DeviceVkResourceImpl),
+	    device(ctx.device) {
+		impl->image_pool_block_sizes[ePoolRenderTargets] = image_pool_block_sizes.render_targets;
+		impl->image_pool_block_sizes[ePoolStorageImages] = image_pool_block_sizes.storage_images;
+		impl->image_pool_block_sizes[ePoolSampledImages] = image_pool_block_sizes.sampled_images;
+
 		VmaAllocatorCreateInfo allocatorInfo = {};
 		allocatorInfo.instance = ctx.instance;
 		allocatorInfo.physicalDevice = ctx.physical_device;
@@ -78,6 +145,10 @@ namespace vuk {
 		vulkanFunctions.vkCreateImage = ctx.vkCreateImage;
 		vulkanFunctions.vkDestroyImage = ctx.vkDestroyImage;
 		vulkanFunctions.vkCmdCopyBuffer = ctx.vkCmdCopyBuffer;
+		if (memory_budget_extension && ctx.vkGetPhysicalDeviceMemoryProperties2) {
+			vulkanFunctions.vkGetPhysicalDeviceMemoryProperties2KHR = ctx.vkGetPhysicalDeviceMemoryProperties2;
+			allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
 		allocatorInfo.pVulkanFunctions = &vulkanFunctions;
 
 		vmaCreateAllocator(&allocatorInfo, &impl->allocator);
@@ -96,6 +167,13 @@ namespace vuk {
 	}
 
 	DeviceVkResource::~DeviceVkResource() {
+		for (auto& pools : impl->image_pools) {
+			for (auto& pool : pools) {
+				if (pool != VK_NULL_HANDLE) {
+					vmaDestroyPool(impl->allocator, pool);
+				}
+			}
+		}
 		vmaDestroyAllocator(impl->allocator);
 		delete impl;
 	}
@@ -140,6 +218,26 @@ namespace vuk {
 		}
 	}
 
+	Result<void, AllocateException> DeviceVkResource::allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		VkEventCreateInfo eci{ .sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO };
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			VkResult res = ctx->vkCreateEvent(device, &eci, nullptr, &dst[i]);
+			if (res != VK_SUCCESS) {
+				deallocate_events({ dst.data(), (uint64_t)i });
+				return { expected_error, AllocateException{ res } };
+			}
+		}
+		return { expected_value };
+	}
+
+	void DeviceVkResource::deallocate_events(std::span<const VkEvent> src) {
+		for (auto& v : src) {
+			if (v != VK_NULL_HANDLE) {
+				ctx->vkDestroyEvent(device, v, nullptr);
+			}
+		}
+	}
+
 	Result<void, AllocateException> DeviceVkResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 	                                                                           std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                           SourceLocationAtFrame loc) {
@@ -240,6 +338,7 @@ namespace vuk {
 #if VUK_DEBUG_ALLOCATIONS
 			vmaSetAllocationName(impl->allocator, allocation, to_string(loc).c_str());
 #endif
+			impl->allocated_bytes[to_integral(ci.mem_usage)] += allocation_info.size;
 			VkBufferDeviceAddressInfo bdai{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, buffer };
 			uint64_t device_address = ctx->vkGetBufferDeviceAddress(device, &bdai);
 			dst[i] = Buffer{ allocation, buffer, 0, ci.size, device_address, static_cast<std::byte*>(allocation_info.pMappedData), ci.mem_usage };
@@ -250,6 +349,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_buffers(std::span<const Buffer> src) {
 		for (auto& v : src) {
 			if (v) {
+				impl->track_allocation(v.memory_usage, static_cast<VmaAllocation>(v.allocation), false);
 				vmaDestroyBuffer(impl->allocator, v.buffer, static_cast<VmaAllocation>(v.allocation));
 			}
 		}
@@ -263,22 +363,47 @@ namespace vuk {
 			aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
 			VkImage vkimg;
-			VmaAllocation allocation;
 			VkImageCreateInfo vkici = cis[i];
-			if (cis[i].usage & (vuk::ImageUsageFlagBits::eColorAttachment | vuk::ImageUsageFlagBits::eDepthStencilAttachment)) {
-				// this is a rendertarget, put it into the dedicated memory
-				aci.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+			auto res = ctx->vkCreateImage(device, &vkici, nullptr, &vkimg);
+			if (res != VK_SUCCESS) {
+				deallocate_images({ dst.data(), (uint64_t)i });
+				return { expected_error, AllocateException{ res } };
 			}
 
-			auto res = vmaCreateImage(impl->allocator, &vkici, &aci, &vkimg, &allocation, nullptr);
+			// images are placed into the block of a pool shared with images of the same usage class
+			// rather than getting their own device memory - which would count against maxMemoryAllocationCount and is slow to allocate
+			VkMemoryRequirements req;
+			ctx->vkGetImageMemoryRequirements(device, vkimg, &req);
+			auto cls = classify_image(cis[i].usage);
+			auto block_size = impl->image_pool_block_sizes[cls];
+			uint32_t memory_type_index;
+			if (block_size > 0 && req.size <= block_size / 2 &&
+			    vmaFindMemoryTypeIndex(impl->allocator, req.memoryTypeBits, &aci, &memory_type_index) == VK_SUCCESS) {
+				aci.pool = impl->get_image_pool(cls, memory_type_index);
+			}
 
+			VmaAllocation allocation;
+			res = vmaAllocateMemoryForImage(impl->allocator, vkimg, &aci, &allocation, nullptr);
+			if (res != VK_SUCCESS && aci.pool != VK_NULL_HANDLE) {
+				// the pool could not grow by a block, try to fit the image by itself
+				aci.pool = VK_NULL_HANDLE;
+				res = vmaAllocateMemoryForImage(impl->allocator, vkimg, &aci, &allocation, nullptr);
+			}
+			if (res == VK_SUCCESS) {
+				res = vmaBindImageMemory(impl->allocator, allocation, vkimg);
+				if (res != VK_SUCCESS) {
+					vmaFreeMemory(impl->allocator, allocation);
+				}
+			}
 			if (res != VK_SUCCESS) {
+				ctx->vkDestroyImage(device, vkimg, nullptr);
 				deallocate_images({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
 #if VUK_DEBUG_ALLOCATIONS
 			vmaSetAllocationName(impl->allocator, allocation, to_string(loc).c_str());
 #endif
+			impl->track_allocation(MemoryUsage::eGPUonly, allocation, true);
 
 			dst[i] = Image{ vkimg, allocation };
 		}
@@ -288,11 +413,137 @@ namespace vuk {
 	void DeviceVkResource::deallocate_images(std::span<const Image> src) {
 		for (auto& v : src) {
 			if (v) {
+				// aliased images only have an allocation if they own the memory
+				if (v.allocation) {
+					impl->track_allocation(MemoryUsage::eGPUonly, static_cast<VmaAllocation>(v.allocation), false);
+				}
 				vmaDestroyImage(impl->allocator, v.image, static_cast<VmaAllocation>(v.allocation));
 			}
 		}
 	}
 
+	Result<void, AllocateException>
+	DeviceVkResource::allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		std::lock_guard _(impl->mutex);
+
+		// create the images without memory to learn their requirements
+		std::vector<VkMemoryRequirements> reqs(cis.size());
+		for (size_t i = 0; i < cis.size(); i++) {
+			VkImageCreateInfo vkici = cis[i].ici;
+			auto res = ctx->vkCreateImage(device, &vkici, nullptr, &dst[i].image);
+			if (res != VK_SUCCESS) {
+				for (size_t j = 0; j < i; j++) {
+					ctx->vkDestroyImage(device, dst[j].image, nullptr);
+				}
+				return { expected_error, AllocateException{ res } };
+			}
+			dst[i].allocation = nullptr;
+			ctx->vkGetImageMemoryRequirements(device, dst[i].image, &reqs[i]);
+		}
+
+		// place images largest first, each at the lowest offset of a block where it doesn't overlap images used at the same time
+		// linear and optimal images are kept in separate blocks, so that we don't need to care about bufferImageGranularity
+		struct Block {
+			VkMemoryRequirements reqs;
+			ImageTiling tiling;
+			std::vector<size_t> images;
+		};
+		std::vector<Block> blocks;
+		std::vector<std::pair<size_t, VkDeviceSize>> placements(cis.size());
+		std::vector<size_t> order(cis.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return reqs[a].size > reqs[b].size; });
+
+		std::vector<std::pair<VkDeviceSize, VkDeviceSize>> taken;
+		for (auto i : order) {
+			auto& req = reqs[i];
+			auto& ci = cis[i];
+			size_t best_block = blocks.size();
+			VkDeviceSize best_offset = 0;
+			VkDeviceSize best_growth = req.size;
+			for (size_t b = 0; b < blocks.size() && best_growth > 0; b++) {
+				auto& block = blocks[b];
+				if (block.tiling != ci.ici.tiling || (block.reqs.memoryTypeBits & req.memoryTypeBits) == 0) {
+					continue;
+				}
+				taken.clear();
+				for (auto j : block.images) {
+					if (cis[j].first_use <= ci.last_use && ci.first_use <= cis[j].last_use) {
+						taken.emplace_back(placements[j].second, placements[j].second + reqs[j].size);
+					}
+				}
+				std::sort(taken.begin(), taken.end());
+				VkDeviceSize offset = 0;
+				for (auto& [begin, end] : taken) {
+					if (align_up(offset, req.alignment) + req.size <= begin) {
+						break;
+					}
+					offset = std::max(offset, end);
+				}
+				offset = align_up(offset, req.alignment);
+				auto growth = offset + req.size > block.reqs.size ? offset + req.size - block.reqs.size : 0;
+				if (growth < best_growth) {
+					best_block = b;
+					best_offset = offset;
+					best_growth = growth;
+				}
+			}
+			if (best_block == blocks.size()) {
+				blocks.push_back(Block{ req, ci.ici.tiling });
+			} else {
+				auto& block = blocks[best_block];
+				block.reqs.size = std::max(block.reqs.size, best_offset + req.size);
+				block.reqs.alignment = std::max(block.reqs.alignment, req.alignment);
+				block.reqs.memoryTypeBits &= req.memoryTypeBits;
+			}
+			blocks[best_block].images.push_back(i);
+			placements[i] = { best_block, best_offset };
+		}
+
+		std::vector<VmaAllocation> allocations(blocks.size(), VK_NULL_HANDLE);
+		auto cleanup = [&]() {
+			for (auto& allocation : allocations) {
+				if (allocation != VK_NULL_HANDLE) {
+					vmaFreeMemory(impl->allocator, allocation);
+				}
+			}
+			for (auto& img : dst) {
+				ctx->vkDestroyImage(device, img.image, nullptr);
+				img = {};
+			}
+		};
+
+		for (size_t b = 0; b < blocks.size(); b++) {
+			VmaAllocationCreateInfo aci{};
+			aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+			auto res = vmaAllocateMemory(impl->allocator, &blocks[b].reqs, &aci, &allocations[b], nullptr);
+			if (res != VK_SUCCESS) {
+				cleanup();
+				return { expected_error, AllocateException{ res } };
+			}
+#if VUK_DEBUG_ALLOCATIONS
+			vmaSetAllocationName(impl->allocator, allocations[b], to_string(loc).c_str());
+#endif
+		}
+
+		for (size_t i = 0; i < cis.size(); i++) {
+			auto [block, offset] = placements[i];
+			auto res = vmaBindImageMemory2(impl->allocator, allocations[block], offset, dst[i].image, nullptr);
+			if (res != VK_SUCCESS) {
+				cleanup();
+				return { expected_error, AllocateException{ res } };
+			}
+		}
+
+		// the first image placed into a block owns its memory, the memory is freed when this image is deallocated
+		for (size_t b = 0; b < blocks.size(); b++) {
+			dst[blocks[b].images[0]].allocation = allocations[b];
+			impl->track_allocation(MemoryUsage::eGPUonly, allocations[b], true);
+		}
+		return { expected_value };
+	}
+
 	Result<void, AllocateException>
 	DeviceVkResource::allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
 		assert(dst.size() == cis.size());
@@ -558,6 +809,8 @@ namespace vuk {
 		}
 	}
 
+	void DeviceVkResource::track_timeline_values(std::span<const TimelineValue> src) {} // noop, nothing is reused
+
 	Result<void, AllocateException> DeviceVkResource::allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
 	                                                                                   std::span<const VkAccelerationStructureCreateInfoKHR> cis,
 	                                                                                   SourceLocationAtFrame loc) {
@@ -1107,6 +1360,65 @@ namespace vuk {
 		}
 	}
 
+	void DeviceVkResource::update_memory_budget(uint64_t frame) {
+		std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> vma_budgets;
+		uint32_t heap_count;
+		{
+			std::lock_guard _(impl->mutex);
+			// VMA refreshes the budget from the driver when the frame index changes
+			vmaSetCurrentFrameIndex(impl->allocator, (uint32_t)frame);
+			vmaGetHeapBudgets(impl->allocator, vma_budgets.data());
+			const VkPhysicalDeviceMemoryProperties* memory_properties;
+			vmaGetMemoryProperties(impl->allocator, &memory_properties);
+			heap_count = memory_properties->memoryHeapCount;
+		}
+
+		// the callbacks are invoked outside of the lock, they are free to allocate, deallocate or query the budget
+		std::vector<std::tuple<MemoryPressureCallback, uint32_t, MemoryHeapBudget, bool>> crossed;
+		{
+			std::lock_guard _(impl->budget_mutex);
+			impl->budgets.resize(heap_count);
+			for (uint32_t h = 0; h < heap_count; h++) {
+				auto& vb = vma_budgets[h];
+				impl->budgets[h] = MemoryHeapBudget{ vb.usage, vb.budget, vb.statistics.blockBytes, vb.statistics.allocationBytes };
+			}
+			for (auto& pc : impl->pressure_callbacks) {
+				for (uint32_t h = 0; h < heap_count; h++) {
+					auto& budget = impl->budgets[h];
+					bool over = budget.budget > 0 && (double)budget.usage >= pc.watermark * (double)budget.budget;
+					if (over != pc.over[h]) {
+						pc.over[h] = over;
+						crossed.emplace_back(pc.callback, h, budget, over);
+					}
+				}
+			}
+		}
+		for (auto& [callback, heap_index, budget, over] : crossed) {
+			callback(heap_index, budget, over);
+		}
+	}
+
+	std::vector<MemoryHeapBudget> DeviceVkResource::get_memory_budget() {
+		std::lock_guard _(impl->budget_mutex);
+		return impl->budgets;
+	}
+
+	uint64_t DeviceVkResource::add_memory_pressure_callback(float watermark, MemoryPressureCallback callback) {
+		std::lock_guard _(impl->budget_mutex);
+		auto id = impl->next_pressure_callback_id++;
+		impl->pressure_callbacks.push_back({ id, watermark, std::move(callback) });
+		return id;
+	}
+
+	void DeviceVkResource::remove_memory_pressure_callback(uint64_t id) {
+		std::lock_guard _(impl->budget_mutex);
+		std::erase_if(impl->pressure_callbacks, [id](auto& pc) { return pc.id == id; });
+	}
+
+	VkDeviceSize DeviceVkResource::get_allocated_bytes(MemoryUsage usage) const {
+		return impl->allocated_bytes[to_integral(usage)].load(std::memory_order_relaxed);
+	}
+
 	Result<void, AllocateException> DeviceNestedResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
 		return upstream->allocate_semaphores(dst, loc);
 	}
@@ -1123,6 +1435,14 @@ namespace vuk {
 		upstream->deallocate_fences(dst);
 	}
 
+	Result<void, AllocateException> DeviceNestedResource::allocate_events(std::span<VkEvent> dst, SourceLocationAtFrame loc) {
+		return upstream->allocate_events(dst, loc);
+	}
+
+	void DeviceNestedResource::deallocate_events(std::span<const VkEvent> dst) {
+		upstream->deallocate_events(dst);
+	}
+
 	Result<void, AllocateException> DeviceNestedResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
 	                                                                               std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                               SourceLocationAtFrame loc) {
@@ -1168,6 +1488,11 @@ namespace vuk {
 		upstream->deallocate_images(src);
 	}
 
+	Result<void, AllocateException>
+	DeviceNestedResource::allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		return upstream->allocate_aliased_images(dst, cis, loc);
+	}
+
 	Result<void, AllocateException>
 	DeviceNestedResource::allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
 		return upstream->allocate_image_views(dst, cis, loc);
@@ -1237,6 +1562,10 @@ namespace vuk {
 		upstream->deallocate_timeline_semaphores(src);
 	}
 
+	void DeviceNestedResource::track_timeline_values(std::span<const TimelineValue> src) {
+		upstream->track_timeline_values(src);
+	}
+
 	Result<void, AllocateException> DeviceNestedResource::allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
 	                                                                                       std::span<const VkAccelerationStructureCreateInfoKHR> cis,
 	                                                                                       SourceLocationAtFrame loc) {
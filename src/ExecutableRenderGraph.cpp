@@ -6,8 +6,13 @@
 #include "vuk/Future.hpp"
 #include "vuk/Hash.hpp" // for create
 #include "vuk/RenderGraph.hpp"
+#include "vuk/TaskPool.hpp"
 #include "vuk/Util.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <optional>
 #include <sstream>
 #include <unordered_set>
 #include <vector>
@@ -107,6 +112,17 @@ namespace vuk {
 		cobuf.ongoing_render_pass = rpi;
 	}
 
+	bool RGCImpl::resolve_image_barrier(Context& ctx, VkImageMemoryBarrier2KHR& dep, vuk::DomainFlagBits domain) {
+		int32_t def_pass_idx;
+		std::memcpy(&def_pass_idx, &dep.pNext, sizeof(def_pass_idx));
+		dep.pNext = 0;
+		auto& bound = get_bound_attachment(def_pass_idx);
+		if (bound.parent_attachment < 0) {
+			return vuk::resolve_image_barrier(ctx, dep, get_bound_attachment(bound.parent_attachment), domain);
+		}
+		return vuk::resolve_image_barrier(ctx, dep, bound, domain);
+	}
+
 	void RGCImpl::emit_barriers(Context& ctx,
 	                            VkCommandBuffer cbuf,
 	                            vuk::DomainFlagBits domain,
@@ -118,18 +134,8 @@ namespace vuk {
 		uint32_t imbar_dst_index = 0;
 		for (auto src_index = 0; src_index < im_bars.size(); src_index++) {
 			auto dep = im_span[src_index];
-			int32_t def_pass_idx;
-			std::memcpy(&def_pass_idx, &dep.pNext, sizeof(def_pass_idx));
-			dep.pNext = 0;
-			auto& bound = get_bound_attachment(def_pass_idx);
-			if (bound.parent_attachment < 0) {
-				if (!resolve_image_barrier(ctx, dep, get_bound_attachment(bound.parent_attachment), domain)) {
-					continue;
-				}
-			} else {
-				if (!resolve_image_barrier(ctx, dep, bound, domain)) {
-					continue;
-				}
+			if (!resolve_image_barrier(ctx, dep, domain)) {
+				continue;
 			}
 			im_span[imbar_dst_index++] = dep;
 		}
@@ -147,6 +153,199 @@ namespace vuk {
 		}
 	}
 
+	namespace {
+		// the resolved image barriers of a split barrier, kept between calls on the same thread as passes are recorded on task pool threads
+		thread_local std::vector<VkImageMemoryBarrier2KHR> event_image_barriers;
+	} // namespace
+
+	void RGCImpl::emit_events(Context& ctx, VkCommandBuffer cbuf, vuk::DomainFlagBits domain, RelSpan<int32_t> split_barrier_indices, bool wait) {
+		auto& im_bars = event_image_barriers;
+		for (auto index : split_barrier_indices.to_span(split_barrier_refs)) {
+			auto& split = split_barriers[index];
+			// the set and the wait need the same dependency, so the barriers are resolved into a copy instead of in place
+			im_bars.clear();
+			for (auto dep : split.image_barriers.to_span(image_barriers)) {
+				if (resolve_image_barrier(ctx, dep, domain)) {
+					im_bars.push_back(dep);
+				}
+			}
+			auto mem_span = split.memory_barriers.to_span(mem_barriers);
+			VkDependencyInfoKHR dependency_info{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+				                                   .memoryBarrierCount = (uint32_t)mem_span.size(),
+				                                   .pMemoryBarriers = mem_span.data(),
+				                                   .imageMemoryBarrierCount = (uint32_t)im_bars.size(),
+				                                   .pImageMemoryBarriers = im_bars.data() };
+			auto event = split_events[index];
+			if (wait) {
+				ctx.vkCmdWaitEvents2KHR(cbuf, 1, &event, &dependency_info);
+			} else {
+				ctx.vkCmdSetEvent2KHR(cbuf, event, &dependency_info);
+			}
+		}
+	}
+
+	std::vector<RGCImpl::TransientLifetime> RGCImpl::compute_transient_lifetimes() {
+		std::vector<TransientLifetime> lifetimes(bound_attachments.size());
+		for (size_t i = 0; i < bound_attachments.size(); i++) {
+			auto& bound = bound_attachments[i];
+			auto& lifetime = lifetimes[i];
+			if (bound.type != AttachmentInfo::Type::eInternal || bound.parent_attachment != 0 || bound.attached_future) {
+				lifetime.escapes = true;
+				continue;
+			}
+			auto add_use = [&](ChainAccess& ca) {
+				auto& pass = get_pass(ca);
+				auto& res = get_resource(ca);
+				auto order_idx = (int32_t)computed_pass_idx_to_ordered_idx[ca.pass];
+				lifetime.first_pass = std::min(lifetime.first_pass, order_idx);
+				lifetime.last_pass = std::max(lifetime.last_pass, order_idx);
+				lifetime.domain |= pass.domain & DomainFlagBits::eQueueMask;
+				auto use = to_use(res.ia, pass.domain);
+				lifetime.uses.stages |= use.stages;
+				lifetime.uses.access |= use.access;
+			};
+			// the use chains of an attachment include the subchains of its diverged subranges
+			for (auto& head : bound.use_chains.to_span(attachment_use_chain_references)) {
+				for (ChainLink* link = head; link != nullptr; link = link->next) {
+					if (link->def->pass >= 0) {
+						add_use(*link->def);
+					}
+					for (auto& r : link->reads.to_span(pass_reads)) {
+						add_use(r);
+					}
+					if (link->undef) {
+						if (link->undef->pass >= 0) {
+							add_use(*link->undef);
+						} else {
+							lifetime.escapes = true;
+						}
+					}
+				}
+			}
+		}
+		return lifetimes;
+	}
+
+	Result<void> ExecutableRenderGraph::record_pass(Allocator& alloc,
+	                                                PassInfo& pass,
+	                                                VkCommandBuffer& cbuf,
+	                                                const VkCommandBufferInheritanceInfo* inheritance,
+	                                                std::vector<VkCommandBuffer>* previous_segments,
+	                                                CommandPool segment_pool) {
+		auto& ctx = alloc.get_context();
+		CommandBuffer cobuf(*this, ctx, alloc, cbuf);
+		if (inheritance) {
+			cobuf.inheritance = *inheritance;
+			// without anywhere to put the segments, the secondary command buffer can't be split
+			cobuf.record_jobs_in_order = !previous_segments;
+			cobuf.segment_pool = segment_pool;
+		}
+		if (pass.render_pass_index >= 0) {
+			fill_render_pass_info(impl->rpis[pass.render_pass_index], 0, cobuf);
+		} else {
+			cobuf.ongoing_render_pass = {};
+		}
+
+		if (!pass.qualified_name.is_invalid()) {
+			ctx.begin_region(cobuf.command_buffer, pass.qualified_name.name);
+		}
+		if (pass.pass->execute) {
+			cobuf.current_pass = &pass;
+			void* pass_profile_data = nullptr;
+			if (this->impl->callbacks.on_begin_pass)
+				pass_profile_data = this->impl->callbacks.on_begin_pass(this->impl->callbacks.user_data, pass.pass->name, cbuf, (DomainFlagBits)pass.domain.m_mask);
+			pass.pass->execute(cobuf);
+			if (this->impl->callbacks.on_end_pass)
+				this->impl->callbacks.on_end_pass(this->impl->callbacks.user_data, pass_profile_data);
+		}
+		if (!pass.qualified_name.is_invalid()) {
+			ctx.end_region(cobuf.command_buffer);
+		}
+
+		// record_parallel might have continued the pass in another secondary command buffer
+		cbuf = cobuf.command_buffer;
+		if (previous_segments) {
+			*previous_segments = std::move(cobuf.previous_segments);
+		}
+		return cobuf.result();
+	}
+
+	Result<VkCommandBuffer> ExecutableRenderGraph::get_cached_recording(PassInfo& pass, DomainFlagBits domain) {
+		auto& ctx = impl->recording_cache_resource->get_context();
+
+		// the user key covers what execute depends on, we add the render pass and the identities of the bound resources
+		size_t key = *pass.pass->cache_key;
+		hash_combine(key, (uint32_t)domain);
+		VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		if (pass.render_pass_index >= 0) {
+			inheritance.renderPass = impl->rpis[pass.render_pass_index].handle;
+			hash_combine(key, inheritance.renderPass);
+		}
+		for (auto& r : pass.resources.to_span(impl->resources)) {
+			if (r.type == Resource::Type::eBuffer) {
+				auto& buf = impl->get_bound_buffer(r.reference).buffer;
+				hash_combine(key, buf.buffer, buf.offset, buf.size);
+			} else {
+				auto& att = impl->get_bound_attachment(r.reference);
+				auto* root = &att;
+				while (root->parent_attachment < 0) {
+					root = &impl->get_bound_attachment(root->parent_attachment);
+				}
+				auto& sub = att.image_subrange;
+				hash_combine(key, root->attachment.image.image, att.attachment.image_view.payload, sub.base_layer, sub.layer_count, sub.base_level, sub.level_count);
+			}
+		}
+
+		std::unique_lock lock(impl->recording_cache_mutex);
+		auto& cached = impl->recording_cache[pass.qualified_name];
+		lock.unlock();
+		cached.uses++;
+		for (auto& recording : cached.recordings) {
+			if (recording.resource && recording.key == key) {
+				recording.last_use = cached.uses;
+				return { expected_value, recording.command_buffer.command_buffer };
+			}
+		}
+
+		// replace the least recently used recording
+		auto& entry = *std::min_element(
+		    cached.recordings.begin(), cached.recordings.end(), [](auto& a, auto& b) { return (a.resource ? a.last_use + 1 : 0) < (b.resource ? b.last_use + 1 : 0); });
+		entry.release();
+		entry.resource = std::make_unique<DeviceLinearResource>(*impl->recording_cache_resource);
+		Allocator cache_alloc(*impl->recording_cache_resource);
+		Allocator alloc(*entry.resource);
+		auto record = [&]() -> Result<VkCommandBuffer> {
+			VkCommandPoolCreateInfo cpci{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+			cpci.queueFamilyIndex = ctx.domain_to_queue_family_index(domain);
+			VUK_DO_OR_RETURN(cache_alloc.allocate_command_pools(std::span{ &entry.command_pool, 1 }, std::span{ &cpci, 1 }));
+			CommandBufferAllocationCreateInfo ci{ .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .command_pool = entry.command_pool };
+			VUK_DO_OR_RETURN(cache_alloc.allocate_command_buffers(std::span{ &entry.command_buffer, 1 }, std::span{ &ci, 1 }));
+
+			// the recording might still be pending from an earlier frame when it is submitted again
+			VkCommandBufferBeginInfo cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				                            .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+				                            .pInheritanceInfo = &inheritance };
+			if (pass.render_pass_index >= 0) {
+				cbi.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			}
+			VkCommandBuffer cbuf = entry.command_buffer.command_buffer;
+			ctx.vkBeginCommandBuffer(cbuf, &cbi);
+			VUK_DO_OR_RETURN(record_pass(alloc, pass, cbuf, &inheritance));
+			if (auto result = ctx.vkEndCommandBuffer(cbuf); result != VK_SUCCESS) {
+				return { expected_error, VkException{ result } };
+			}
+			return { expected_value, cbuf };
+		};
+		auto cbuf = record();
+		if (!cbuf) {
+			entry.release();
+			return cbuf;
+		}
+		entry.key = key;
+		entry.last_use = cached.uses;
+		return cbuf;
+	}
+
 	Result<SubmitInfo> ExecutableRenderGraph::record_single_submit(Allocator& alloc, std::span<PassInfo*> passes, vuk::DomainFlagBits domain) {
 		assert(passes.size() > 0);
 
@@ -176,8 +375,22 @@ namespace vuk {
 		if (this->impl->callbacks.on_begin_command_buffer)
 			cbuf_profile_data = this->impl->callbacks.on_begin_command_buffer(this->impl->callbacks.user_data, cbuf);
 
+		// a render pass with cached passes in it executes secondary command buffers, so all of its passes are recorded into secondaries
+		auto uses_secondaries = [&](size_t i) {
+			for (size_t j = i; j < passes.size(); j++) {
+				if (passes[j]->render_pass_index != passes[i]->render_pass_index || passes[j]->command_buffer_index != passes[i]->command_buffer_index) {
+					break;
+				}
+				if (impl->is_cached(*passes[j])) {
+					return true;
+				}
+			}
+			return false;
+		};
+
 		uint64_t command_buffer_index = passes[0]->command_buffer_index;
 		int32_t render_pass_index = -1;
+		bool secondary_render_pass = false;
 		for (size_t i = 0; i < passes.size(); i++) {
 			auto& pass = passes[i];
 
@@ -207,16 +420,44 @@ namespace vuk {
 				ctx.vkCmdEndRenderPass(cbuf);
 			}
 
+			bool begins_render_pass = pass->render_pass_index != render_pass_index && pass->render_pass_index != -1;
+			if (begins_render_pass) {
+				secondary_render_pass = uses_secondaries(i);
+			}
+			bool in_secondary_render_pass = pass->render_pass_index != -1 && secondary_render_pass;
+
+			// barriers between passes of a render pass executing secondaries go into the secondary of the pass
+			VkCommandBuffer barrier_cbuf = cbuf;
+			VkCommandBuffer pass_cbuf = cbuf;
+			VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+			if (in_secondary_render_pass) {
+				auto& rpass = impl->rpis[pass->render_pass_index];
+				inheritance.renderPass = rpass.handle;
+				inheritance.framebuffer = rpass.framebuffer;
+				CommandBufferAllocation secondary;
+				CommandBufferAllocationCreateInfo secondary_ci{ .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .command_pool = *cpool };
+				VUK_DO_OR_RETURN(alloc.allocate_command_buffers(std::span{ &secondary, 1 }, std::span{ &secondary_ci, 1 }));
+				VkCommandBufferBeginInfo secondary_cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					                                      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+					                                      .pInheritanceInfo = &inheritance };
+				ctx.vkBeginCommandBuffer(secondary.command_buffer, &secondary_cbi);
+				pass_cbuf = secondary.command_buffer;
+				if (!begins_render_pass) {
+					barrier_cbuf = pass_cbuf;
+				}
+			}
+
 			if (i > 1) {
 				// insert post-barriers
-				impl->emit_barriers(ctx, cbuf, domain, passes[i - 1]->post_memory_barriers, passes[i - 1]->post_image_barriers);
+				impl->emit_barriers(ctx, barrier_cbuf, domain, passes[i - 1]->post_memory_barriers, passes[i - 1]->post_image_barriers);
 			}
 			// insert pre-barriers
-			impl->emit_barriers(ctx, cbuf, domain, pass->pre_memory_barriers, pass->pre_image_barriers);
+			impl->emit_events(ctx, barrier_cbuf, domain, pass->event_waits, true);
+			impl->emit_barriers(ctx, barrier_cbuf, domain, pass->pre_memory_barriers, pass->pre_image_barriers);
 
 			// if render pass is changing and new pass uses one
-			if (pass->render_pass_index != render_pass_index && pass->render_pass_index != -1) {
-				begin_render_pass(ctx, impl->rpis[pass->render_pass_index], cbuf, false);
+			if (begins_render_pass) {
+				begin_render_pass(ctx, impl->rpis[pass->render_pass_index], cbuf, secondary_render_pass);
 			}
 
 			render_pass_index = pass->render_pass_index;
@@ -229,36 +470,36 @@ namespace vuk {
 				si.absolute_waits.emplace_back(w);
 			}
 
-			CommandBuffer cobuf(*this, ctx, alloc, cbuf);
-			if (render_pass_index >= 0) {
-				fill_render_pass_info(impl->rpis[pass->render_pass_index], 0, cobuf);
-			} else {
-				cobuf.ongoing_render_pass = {};
-			}
-
 			// propagate signals onto SI
 			auto pass_fut_signals = pass->future_signals.to_span(impl->future_signals);
 			si.future_signals.insert(si.future_signals.end(), pass_fut_signals.begin(), pass_fut_signals.end());
 
-			if (!pass->qualified_name.is_invalid()) {
-				ctx.begin_region(cobuf.command_buffer, pass->qualified_name.name);
-			}
-			if (pass->pass->execute) {
-				cobuf.current_pass = pass;
-				void* pass_profile_data = nullptr;
-				if (this->impl->callbacks.on_begin_pass)
-					pass_profile_data = this->impl->callbacks.on_begin_pass(this->impl->callbacks.user_data, pass->pass->name, cbuf, (DomainFlagBits)pass->domain.m_mask);
-				pass->pass->execute(cobuf);
-				if (this->impl->callbacks.on_end_pass)
-					this->impl->callbacks.on_end_pass(this->impl->callbacks.user_data, pass_profile_data);
-			}
-			if (!pass->qualified_name.is_invalid()) {
-				ctx.end_region(cobuf.command_buffer);
-			}
-
-			if (auto res = cobuf.result(); !res) {
-				return res;
+			if (impl->is_cached(*pass)) {
+				auto cached = get_cached_recording(*pass, domain);
+				if (!cached) {
+					return cached;
+				}
+				if (in_secondary_render_pass) {
+					if (auto result = ctx.vkEndCommandBuffer(pass_cbuf); result != VK_SUCCESS) {
+						return { expected_error, VkException{ result } };
+					}
+					VkCommandBuffer secondaries[] = { pass_cbuf, *cached };
+					ctx.vkCmdExecuteCommands(cbuf, 2, secondaries);
+				} else {
+					ctx.vkCmdExecuteCommands(cbuf, 1, &*cached);
+				}
+			} else if (in_secondary_render_pass) {
+				std::vector<VkCommandBuffer> segments;
+				VUK_DO_OR_RETURN(record_pass(alloc, *pass, pass_cbuf, &inheritance, &segments, *cpool));
+				if (auto result = ctx.vkEndCommandBuffer(pass_cbuf); result != VK_SUCCESS) {
+					return { expected_error, VkException{ result } };
+				}
+				segments.push_back(pass_cbuf);
+				ctx.vkCmdExecuteCommands(cbuf, (uint32_t)segments.size(), segments.data());
+			} else {
+				VUK_DO_OR_RETURN(record_pass(alloc, *pass, cbuf));
 			}
+			impl->emit_events(ctx, cbuf, domain, pass->event_sets, false);
 		}
 
 		if (render_pass_index != -1) {
@@ -279,8 +520,359 @@ namespace vuk {
 		return { expected_value, std::move(si) };
 	}
 
-	Result<SubmitBundle> ExecutableRenderGraph::execute(Allocator& alloc, std::vector<std::pair<SwapchainRef, size_t>> swp_with_index) {
+	Result<SubmitInfo>
+	ExecutableRenderGraph::record_single_submit_parallel(Allocator& alloc, std::span<PassInfo*> passes, vuk::DomainFlagBits domain, TaskPool& task_pool) {
+		assert(passes.size() > 0);
+
+		auto& ctx = alloc.get_context();
+		SubmitInfo si;
+
+		// command pools can't be used from multiple threads, so each recording task gets its own
+		// the last pool is for the commands between the passes, which are recorded on this thread
+		auto task_count = std::min(task_pool.concurrency(), passes.size());
+		VkCommandPoolCreateInfo cpci{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		cpci.flags = VkCommandPoolCreateFlagBits::VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		cpci.queueFamilyIndex = ctx.domain_to_queue_family_index(domain); // currently queue family idx = queue idx
+		std::vector<Unique<CommandPool>> cpools;
+		cpools.reserve(task_count + 1);
+		for (size_t i = 0; i < task_count + 1; i++) {
+			auto& cpool = cpools.emplace_back(alloc);
+			VUK_DO_OR_RETURN(alloc.allocate_command_pools(std::span{ &*cpool, 1 }, std::span{ &cpci, 1 }));
+		}
+
+		// a pass that continues the render pass of the previous pass has its barriers recorded into its own secondary command buffer
+		// otherwise the barriers and render pass begin & end are recorded between the passes
+		auto continues_render_pass = [&](size_t i) {
+			return i > 0 && passes[i]->render_pass_index != -1 && passes[i]->render_pass_index == passes[i - 1]->render_pass_index &&
+			       passes[i]->command_buffer_index == passes[i - 1]->command_buffer_index;
+		};
+
+		std::vector<CommandBufferAllocation> pass_cbufs(passes.size());
+		// the secondary command buffers of a pass in a render pass, in order
+		std::vector<std::vector<VkCommandBuffer>> pass_segments(passes.size());
+		std::vector<std::optional<Result<void>>> errors(passes.size());
+		std::atomic<size_t> next_pass = 0;
+		task_pool.parallel_for(task_count, [&](size_t task) {
+			for (size_t i = next_pass++; i < passes.size(); i = next_pass++) {
+				auto& pass = *passes[i];
+				bool in_render_pass = pass.render_pass_index >= 0;
+				CommandBufferAllocationCreateInfo ci{ .level = in_render_pass ? VK_COMMAND_BUFFER_LEVEL_SECONDARY : VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+					                                    .command_pool = *cpools[task] };
+				if (auto res = alloc.allocate_command_buffers(std::span{ &pass_cbufs[i], 1 }, std::span{ &ci, 1 }); !res) {
+					errors[i].emplace(std::move(res));
+					continue;
+				}
+				VkCommandBuffer cbuf = pass_cbufs[i].command_buffer;
+
+				VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+				VkCommandBufferBeginInfo cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					                            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+					                            .pInheritanceInfo = &inheritance };
+				if (in_render_pass) {
+					auto& rpass = impl->rpis[pass.render_pass_index];
+					inheritance.renderPass = rpass.handle;
+					inheritance.subpass = 0;
+					inheritance.framebuffer = rpass.framebuffer;
+					cbi.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				}
+				ctx.vkBeginCommandBuffer(cbuf, &cbi);
+
+				void* cbuf_profile_data = nullptr;
+				if (!in_render_pass && impl->callbacks.on_begin_command_buffer)
+					cbuf_profile_data = impl->callbacks.on_begin_command_buffer(impl->callbacks.user_data, cbuf);
+
+				// passes with split barriers are outside of render passes, so they have their own primary command buffer
+				impl->emit_events(ctx, cbuf, domain, pass.event_waits, true);
+
+				if (continues_render_pass(i)) {
+					if (i > 1) {
+						impl->emit_barriers(ctx, cbuf, domain, passes[i - 1]->post_memory_barriers, passes[i - 1]->post_image_barriers);
+					}
+					impl->emit_barriers(ctx, cbuf, domain, pass.pre_memory_barriers, pass.pre_image_barriers);
+				}
+
+				auto record = [&]() -> Result<void> {
+					if (impl->is_cached(pass)) {
+						auto cached = get_cached_recording(pass, domain);
+						if (!cached) {
+							return cached;
+						}
+						// secondary command buffers can't execute others, so the cached recording follows the one with the barriers
+						if (in_render_pass) {
+							pass_segments[i].push_back(cbuf);
+							pass_segments[i].push_back(*cached);
+						} else {
+							ctx.vkCmdExecuteCommands(cbuf, 1, &*cached);
+						}
+						return { expected_value };
+					}
+					auto res = record_pass(alloc, pass, cbuf, in_render_pass ? &inheritance : nullptr, &pass_segments[i], *cpools[task]);
+					if (in_render_pass) {
+						pass_segments[i].push_back(cbuf);
+					}
+					return res;
+				};
+				auto res = record();
+				impl->emit_events(ctx, cbuf, domain, pass.event_sets, false);
+
+				if (!in_render_pass && impl->callbacks.on_end_command_buffer)
+					impl->callbacks.on_end_command_buffer(impl->callbacks.user_data, cbuf_profile_data);
+				if (auto result = ctx.vkEndCommandBuffer(cbuf); result != VK_SUCCESS && res) {
+					res = Result<void>{ expected_error, VkException{ result } };
+				}
+				if (!res) {
+					errors[i].emplace(std::move(res));
+				}
+			}
+		});
+
+		for (auto& error : errors) {
+			if (error) {
+				return std::move(*error);
+			}
+		}
+
+		// stitch the passes together in order
+		CommandBufferAllocationCreateInfo glue_ci{ .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .command_pool = *cpools.back() };
+		VkCommandBuffer glue = VK_NULL_HANDLE;
+		void* glue_profile_data = nullptr;
+		auto get_glue = [&]() -> Result<VkCommandBuffer> {
+			if (glue != VK_NULL_HANDLE) {
+				return { expected_value, glue };
+			}
+			CommandBufferAllocation cba;
+			VUK_DO_OR_RETURN(alloc.allocate_command_buffers(std::span{ &cba, 1 }, std::span{ &glue_ci, 1 }));
+			si.command_buffers.emplace_back(cba);
+			glue = cba.command_buffer;
+
+			VkCommandBufferBeginInfo cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+			ctx.vkBeginCommandBuffer(glue, &cbi);
+			if (impl->callbacks.on_begin_command_buffer)
+				glue_profile_data = impl->callbacks.on_begin_command_buffer(impl->callbacks.user_data, glue);
+			return { expected_value, glue };
+		};
+		auto end_glue = [&]() -> Result<void> {
+			if (glue == VK_NULL_HANDLE) {
+				return { expected_value };
+			}
+			if (impl->callbacks.on_end_command_buffer)
+				impl->callbacks.on_end_command_buffer(impl->callbacks.user_data, glue_profile_data);
+			auto result = ctx.vkEndCommandBuffer(glue);
+			glue = VK_NULL_HANDLE;
+			if (result != VK_SUCCESS) {
+				return { expected_error, VkException{ result } };
+			}
+			return { expected_value };
+		};
+		auto emit_glue_barriers = [&](RelSpan<VkMemoryBarrier2KHR> mem_bars, RelSpan<VkImageMemoryBarrier2KHR> im_bars) -> Result<void> {
+			if (mem_bars.size() == 0 && im_bars.size() == 0) {
+				return { expected_value };
+			}
+			auto cbuf = get_glue();
+			if (!cbuf) {
+				return cbuf;
+			}
+			impl->emit_barriers(ctx, *cbuf, domain, mem_bars, im_bars);
+			return { expected_value };
+		};
+
+		robin_hood::unordered_set<SwapchainRef> used_swapchains;
+		uint64_t command_buffer_index = passes[0]->command_buffer_index;
+		int32_t render_pass_index = -1;
+		for (size_t i = 0; i < passes.size(); i++) {
+			auto& pass = passes[i];
+
+			for (auto& ref : pass->referenced_swapchains.to_span(impl->swapchain_references)) {
+				used_swapchains.emplace(impl->get_bound_attachment(ref).swapchain);
+			}
+
+			if (pass->command_buffer_index != command_buffer_index) {
+				if (render_pass_index != -1) {
+					ctx.vkCmdEndRenderPass(glue);
+					render_pass_index = -1;
+				}
+				VUK_DO_OR_RETURN(end_glue());
+				command_buffer_index = pass->command_buffer_index;
+			}
+
+			if (!continues_render_pass(i)) {
+				if (render_pass_index != -1) {
+					ctx.vkCmdEndRenderPass(glue);
+				}
+				if (i > 1) {
+					VUK_DO_OR_RETURN(emit_glue_barriers(passes[i - 1]->post_memory_barriers, passes[i - 1]->post_image_barriers));
+				}
+				VUK_DO_OR_RETURN(emit_glue_barriers(pass->pre_memory_barriers, pass->pre_image_barriers));
+				if (pass->render_pass_index != -1) {
+					auto cbuf = get_glue();
+					if (!cbuf) {
+						return cbuf;
+					}
+					begin_render_pass(ctx, impl->rpis[pass->render_pass_index], *cbuf, true);
+				}
+				render_pass_index = pass->render_pass_index;
+			}
+
+			for (auto& w : pass->relative_waits.to_span(impl->waits)) {
+				si.relative_waits.emplace_back(w);
+			}
+
+			for (auto& w : pass->absolute_waits.to_span(impl->absolute_waits)) {
+				si.absolute_waits.emplace_back(w);
+			}
+
+			// propagate signals onto SI
+			auto pass_fut_signals = pass->future_signals.to_span(impl->future_signals);
+			si.future_signals.insert(si.future_signals.end(), pass_fut_signals.begin(), pass_fut_signals.end());
+
+			if (render_pass_index != -1) {
+				ctx.vkCmdExecuteCommands(glue, (uint32_t)pass_segments[i].size(), pass_segments[i].data());
+			} else {
+				// passes outside of render passes were recorded into primary command buffers, which are submitted in order
+				VUK_DO_OR_RETURN(end_glue());
+				si.command_buffers.emplace_back(pass_cbufs[i]);
+			}
+		}
+
+		if (render_pass_index != -1) {
+			ctx.vkCmdEndRenderPass(glue);
+		}
+
+		// insert post-barriers
+		VUK_DO_OR_RETURN(emit_glue_barriers(passes.back()->post_memory_barriers, passes.back()->post_image_barriers));
+		VUK_DO_OR_RETURN(end_glue());
+
+		si.used_swapchains.insert(si.used_swapchains.end(), used_swapchains.begin(), used_swapchains.end());
+
+		return { expected_value, std::move(si) };
+	}
+
+	namespace {
+		Result<void> check_broken_rules(const AttachmentInfo& atti, const ImageAttachment& prev, const ImageAttachment& ia) {
+			auto broken = [&](auto&& print) -> Result<void> {
+				std::stringstream msg;
+				msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
+				print(msg);
+				return { expected_error, RenderGraphException{ msg.str() } };
+			};
+			if (prev.base_layer != ia.base_layer && prev.base_layer != VK_REMAINING_ARRAY_LAYERS) {
+				return broken([&](auto& msg) { msg << " base layer was previously known to be " << prev.base_layer << ", but now set to " << ia.base_layer; });
+			}
+			if (prev.layer_count != ia.layer_count && prev.layer_count != VK_REMAINING_ARRAY_LAYERS) {
+				return broken([&](auto& msg) { msg << " layer count was previously known to be " << prev.layer_count << ", but now set to " << ia.layer_count; });
+			}
+			if (prev.base_level != ia.base_level && prev.base_level != VK_REMAINING_MIP_LEVELS) {
+				return broken([&](auto& msg) { msg << " base level was previously known to be " << prev.base_level << ", but now set to " << ia.base_level; });
+			}
+			if (prev.level_count != ia.level_count && prev.level_count != VK_REMAINING_MIP_LEVELS) {
+				return broken([&](auto& msg) { msg << " level count was previously known to be " << prev.level_count << ", but now set to " << ia.level_count; });
+			}
+			if (prev.format != ia.format && prev.format != Format::eUndefined) {
+				return broken([&](auto& msg) {
+					msg << " format was previously known to be " << format_to_sv(prev.format) << ", but now set to " << format_to_sv(ia.format);
+				});
+			}
+			if (prev.sample_count != ia.sample_count && prev.sample_count != SampleCountFlagBits::eInfer) {
+				return broken([&](auto& msg) {
+					msg << " sample count was previously known to be " << static_cast<uint32_t>(prev.sample_count.count) << ", but now set to "
+					    << static_cast<uint32_t>(ia.sample_count.count);
+				});
+			}
+			if (prev.extent.extent.width != ia.extent.extent.width && prev.extent.extent.width != 0) {
+				return broken([&](auto& msg) {
+					msg << " extent.width was previously known to be " << prev.extent.extent.width << ", but now set to " << ia.extent.extent.width;
+				});
+			}
+			if (prev.extent.extent.height != ia.extent.extent.height && prev.extent.extent.height != 0) {
+				return broken([&](auto& msg) {
+					msg << " extent.height was previously known to be " << prev.extent.extent.height << ", but now set to " << ia.extent.extent.height;
+				});
+			}
+			if (prev.extent.extent.depth != ia.extent.extent.depth && prev.extent.extent.depth != 0) {
+				return broken([&](auto& msg) {
+					msg << " extent.depth was previously known to be " << prev.extent.extent.depth << ", but now set to " << ia.extent.extent.depth;
+				});
+			}
+			if (ia.may_require_image_view() && prev.view_type != ia.view_type && prev.view_type != ImageViewType::eInfer) {
+				return broken([&](auto& msg) {
+					msg << " view type was previously known to be " << image_view_type_to_sv(prev.view_type) << ", but now set to "
+					    << image_view_type_to_sv(ia.view_type);
+				});
+			}
+			return { expected_value };
+		}
+
+		// stable topological sort of the resources to infer, so that resources come after the sources their rules declare
+		// resources on a cycle keep their original order at the end
+		template<class Info, class Inferences, class F>
+		void order_by_rule_sources(std::vector<std::pair<Info*, Inferences*>>& to_infer, F&& find_source) {
+			robin_hood::unordered_flat_map<Info*, size_t> index;
+			for (size_t i = 0; i < to_infer.size(); i++) {
+				index.emplace(to_infer[i].first, i);
+			}
+
+			std::vector<std::vector<size_t>> dependents(to_infer.size());
+			std::vector<size_t> indegree(to_infer.size());
+			bool any_edges = false;
+			for (size_t i = 0; i < to_infer.size(); i++) {
+				auto rules = to_infer[i].second;
+				if (!rules) {
+					continue;
+				}
+				for (auto& rule : rules->rules) {
+					if (!rule.sources_declared) {
+						continue;
+					}
+					for (auto& source : rule.sources) {
+						auto src = find_source(rules->prefix, source);
+						auto it = src ? index.find(src) : index.end();
+						// sources that are already known don't constrain the order
+						if (it == index.end() || it->second == i) {
+							continue;
+						}
+						dependents[it->second].push_back(i);
+						indegree[i]++;
+						any_edges = true;
+					}
+				}
+			}
+			if (!any_edges) {
+				return;
+			}
+
+			std::vector<size_t> order;
+			order.reserve(to_infer.size());
+			for (size_t i = 0; i < to_infer.size(); i++) {
+				if (indegree[i] == 0) {
+					order.push_back(i);
+				}
+			}
+			for (size_t head = 0; head < order.size(); head++) {
+				for (auto d : dependents[order[head]]) {
+					if (--indegree[d] == 0) {
+						order.push_back(d);
+					}
+				}
+			}
+			for (size_t i = 0; i < to_infer.size(); i++) {
+				if (indegree[i] > 0) {
+					order.push_back(i);
+				}
+			}
+
+			std::vector<std::pair<Info*, Inferences*>> sorted;
+			sorted.reserve(to_infer.size());
+			for (auto i : order) {
+				sorted.push_back(to_infer[i]);
+			}
+			to_infer = std::move(sorted);
+		}
+	} // namespace
+
+	Result<SubmitBundle>
+	ExecutableRenderGraph::execute(Allocator& alloc, std::vector<std::pair<SwapchainRef, size_t>> swp_with_index, RenderGraphExecuteOptions options) {
 		Context& ctx = alloc.get_context();
+		impl->recording_cache_resource = options.recording_cache_resource;
 
 		// bind swapchain attachment images & ivs
 		for (auto& bound : impl->bound_attachments) {
@@ -408,143 +1000,123 @@ namespace vuk {
 		}
 
 		InferenceContext inf_ctx{ this };
-		bool infer_progress = true;
-		std::stringstream msg;
 
-		// we provide an upper bound of 100 inference iterations to catch infinite loops that don't converge to a fixpoint
-		for (size_t i = 0; i < 100 && !attis_to_infer.empty() && infer_progress; i++) {
-			infer_progress = false;
-			for (auto ia_it = attis_to_infer.begin(); ia_it != attis_to_infer.end();) {
-				auto& atti = *ia_it->first;
-				auto& ia = atti.attachment;
-				auto prev = ia;
-				// infer FB -> IA
-				if (ia.sample_count == Samples::eInfer || (ia.extent.extent.width == 0 && ia.extent.extent.height == 0) ||
-				    ia.extent.sizing == Sizing::eRelative) { // this IA can potentially take inference from an FB
-					for (auto* rpi : atti.rp_uses.to_span(impl->attachment_rp_references)) {
-						auto& fbci = rpi->fbci;
-						Samples fb_samples = fbci.sample_count;
-						bool samples_known = fb_samples != Samples::eInfer;
-
-						// an extent is known if it is not 0
-						// 0 sized framebuffers are illegal
-						Extent3D fb_extent = { fbci.width, fbci.height };
-						bool extent_known = !(fb_extent.width == 0 || fb_extent.height == 0);
-
-						if (samples_known && ia.sample_count == Samples::eInfer) {
-							ia.sample_count = fb_samples;
-						}
+		// the bound resource a rule source refers to
+		auto find_bound = [&](Name prefix, Name source, Resource::Type type) -> ChainLink* {
+			ChainLink* link = impl->find_link(impl->resolve_name(QualifiedName{ prefix, source }));
+			while (link && link->def && link->def->pass >= 0) {
+				link = link->prev;
+			}
+			if (!link || !link->def || link->type != type) {
+				return nullptr;
+			}
+			return link;
+		};
+		order_by_rule_sources(attis_to_infer, [&](Name prefix, Name source) -> AttachmentInfo* {
+			auto link = find_bound(prefix, source, Resource::Type::eImage);
+			return link ? &impl->get_bound_attachment(link->def->pass) : nullptr;
+		});
+		order_by_rule_sources(bufis_to_infer, [&](Name prefix, Name source) -> BufferInfo* {
+			auto link = find_bound(prefix, source, Resource::Type::eBuffer);
+			return link ? &impl->get_bound_buffer(link->def->pass) : nullptr;
+		});
+
+		// returns if progress was made on the attachment
+		auto infer_attachment = [&](AttachmentInfo& atti, IAInferences* rules) -> Result<bool> {
+			auto& ia = atti.attachment;
+			auto prev = ia;
+			// infer FB -> IA
+			if (ia.sample_count == Samples::eInfer || (ia.extent.extent.width == 0 && ia.extent.extent.height == 0) ||
+			    ia.extent.sizing == Sizing::eRelative) { // this IA can potentially take inference from an FB
+				for (auto* rpi : atti.rp_uses.to_span(impl->attachment_rp_references)) {
+					auto& fbci = rpi->fbci;
+					Samples fb_samples = fbci.sample_count;
+					bool samples_known = fb_samples != Samples::eInfer;
+
+					// an extent is known if it is not 0
+					// 0 sized framebuffers are illegal
+					Extent3D fb_extent = { fbci.width, fbci.height };
+					bool extent_known = !(fb_extent.width == 0 || fb_extent.height == 0);
+
+					if (samples_known && ia.sample_count == Samples::eInfer) {
+						ia.sample_count = fb_samples;
+					}
 
-						if (extent_known) {
-							if (ia.extent.extent.width == 0 && ia.extent.extent.height == 0) {
-								ia.extent.extent.width = fb_extent.width;
-								ia.extent.extent.height = fb_extent.height;
-							} else if (ia.extent.sizing == Sizing::eRelative) {
-								ia.extent.extent.width = static_cast<uint32_t>(ia.extent._relative.width * fb_extent.width);
-								ia.extent.extent.height = static_cast<uint32_t>(ia.extent._relative.height * fb_extent.height);
-								ia.extent.extent.depth = static_cast<uint32_t>(ia.extent._relative.depth * fb_extent.depth);
-							}
-							ia.extent.sizing = Sizing::eAbsolute;
+					if (extent_known) {
+						if (ia.extent.extent.width == 0 && ia.extent.extent.height == 0) {
+							ia.extent.extent.width = fb_extent.width;
+							ia.extent.extent.height = fb_extent.height;
+						} else if (ia.extent.sizing == Sizing::eRelative) {
+							ia.extent.extent.width = static_cast<uint32_t>(ia.extent._relative.width * fb_extent.width);
+							ia.extent.extent.height = static_cast<uint32_t>(ia.extent._relative.height * fb_extent.height);
+							ia.extent.extent.depth = static_cast<uint32_t>(ia.extent._relative.depth * fb_extent.depth);
 						}
+						ia.extent.sizing = Sizing::eAbsolute;
 					}
 				}
-				// infer custom rule -> IA
-				if (ia_it->second) {
-					inf_ctx.prefix = ia_it->second->prefix;
-					for (auto& rule : ia_it->second->rules) {
-						rule(inf_ctx, ia);
-					}
+			}
+			// infer custom rule -> IA
+			if (rules) {
+				inf_ctx.prefix = rules->prefix;
+				for (auto& rule : rules->rules) {
+					rule(inf_ctx, ia);
 				}
-				if (prev != ia) { // progress made
-					// check for broken constraints
-					if (prev.base_layer != ia.base_layer && prev.base_layer != VK_REMAINING_ARRAY_LAYERS) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " base layer was previously known to be " << prev.base_layer << ", but now set to " << ia.base_layer;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.layer_count != ia.layer_count && prev.layer_count != VK_REMAINING_ARRAY_LAYERS) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " layer count was previously known to be " << prev.layer_count << ", but now set to " << ia.layer_count;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.base_level != ia.base_level && prev.base_level != VK_REMAINING_MIP_LEVELS) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " base level was previously known to be " << prev.base_level << ", but now set to " << ia.base_level;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.level_count != ia.level_count && prev.level_count != VK_REMAINING_MIP_LEVELS) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " level count was previously known to be " << prev.level_count << ", but now set to " << ia.level_count;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.format != ia.format && prev.format != Format::eUndefined) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " format was previously known to be " << format_to_sv(prev.format) << ", but now set to " << format_to_sv(ia.format);
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.sample_count != ia.sample_count && prev.sample_count != SampleCountFlagBits::eInfer) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " sample count was previously known to be " << static_cast<uint32_t>(prev.sample_count.count) << ", but now set to "
-						    << static_cast<uint32_t>(ia.sample_count.count);
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.extent.extent.width != ia.extent.extent.width && prev.extent.extent.width != 0) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " extent.width was previously known to be " << prev.extent.extent.width << ", but now set to " << ia.extent.extent.width;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.extent.extent.height != ia.extent.extent.height && prev.extent.extent.height != 0) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " extent.height was previously known to be " << prev.extent.extent.height << ", but now set to " << ia.extent.extent.height;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (prev.extent.extent.depth != ia.extent.extent.depth && prev.extent.extent.depth != 0) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " extent.depth was previously known to be " << prev.extent.extent.depth << ", but now set to " << ia.extent.extent.depth;
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
-					if (ia.may_require_image_view() && prev.view_type != ia.view_type && prev.view_type != ImageViewType::eInfer) {
-						msg << "Rule broken for attachment[" << atti.name.name.c_str() << "] :\n ";
-						msg << " view type was previously known to be " << image_view_type_to_sv(prev.view_type) << ", but now set to "
-						    << image_view_type_to_sv(ia.view_type);
-						return { expected_error, RenderGraphException{ msg.str() } };
-					}
+			}
+			if (prev == ia) {
+				return { expected_value, false };
+			}
+			VUK_DO_OR_RETURN(check_broken_rules(atti, prev, ia));
 
-					infer_progress = true;
-					// infer IA -> FB
-					if (ia.sample_count == Samples::eInfer && (ia.extent.extent.width == 0 && ia.extent.extent.height == 0)) { // this IA is not helpful for FB inference
-						continue;
-					}
-					for (auto* rpi : atti.rp_uses.to_span(impl->attachment_rp_references)) {
-						auto& fbci = rpi->fbci;
-						Samples fb_samples = fbci.sample_count;
-						bool samples_known = fb_samples != Samples::eInfer;
+			// infer IA -> FB
+			if (ia.sample_count == Samples::eInfer && (ia.extent.extent.width == 0 && ia.extent.extent.height == 0)) { // this IA is not helpful for FB inference
+				return { expected_value, true };
+			}
+			for (auto* rpi : atti.rp_uses.to_span(impl->attachment_rp_references)) {
+				auto& fbci = rpi->fbci;
+				Samples fb_samples = fbci.sample_count;
+				bool samples_known = fb_samples != Samples::eInfer;
 
-						// an extent is known if it is not 0
-						// 0 sized framebuffers are illegal
-						Extent2D fb_extent = Extent2D{ fbci.width, fbci.height };
-						bool extent_known = !(fb_extent.width == 0 || fb_extent.height == 0);
+				// an extent is known if it is not 0
+				// 0 sized framebuffers are illegal
+				Extent2D fb_extent = Extent2D{ fbci.width, fbci.height };
+				bool extent_known = !(fb_extent.width == 0 || fb_extent.height == 0);
 
-						if (samples_known && extent_known) {
-							continue;
-						}
-
-						if (!samples_known && ia.sample_count != Samples::eInfer) {
-							auto attachments = rpi->attachments.to_span(impl->rp_infos);
-							auto it = std::find_if(attachments.begin(), attachments.end(), [attip = &atti](auto& rp_att) { return rp_att.attachment_info == attip; });
-							assert(it != attachments.end());
-							if (!it->is_resolve_dst) {
-								fbci.sample_count = ia.sample_count;
-							}
-						}
+				if (samples_known && extent_known) {
+					continue;
+				}
 
-						if (ia.extent.sizing == vuk::Sizing::eAbsolute && ia.extent.extent.width > 0 && ia.extent.extent.height > 0) {
-							fbci.width = ia.extent.extent.width;
-							fbci.height = ia.extent.extent.height;
-						}
+				if (!samples_known && ia.sample_count != Samples::eInfer) {
+					auto attachments = rpi->attachments.to_span(impl->rp_infos);
+					auto it = std::find_if(attachments.begin(), attachments.end(), [attip = &atti](auto& rp_att) { return rp_att.attachment_info == attip; });
+					assert(it != attachments.end());
+					if (!it->is_resolve_dst) {
+						fbci.sample_count = ia.sample_count;
 					}
 				}
-				if (ia.is_fully_known()) {
+
+				if (ia.extent.sizing == vuk::Sizing::eAbsolute && ia.extent.extent.width > 0 && ia.extent.extent.height > 0) {
+					fbci.width = ia.extent.extent.width;
+					fbci.height = ia.extent.extent.height;
+				}
+			}
+			return { expected_value, true };
+		};
+
+		// with rules ordered after their sources, the first iteration resolves everything that only depends on declared sources
+		// rules with undeclared sources or cyclic dependencies need more iterations
+		// we provide an upper bound of 100 inference iterations to catch infinite loops that don't converge to a fixpoint
+		bool infer_progress = true;
+		impl->statistics.inference_iterations = 0;
+		for (size_t i = 0; i < 100 && !attis_to_infer.empty() && infer_progress; i++) {
+			impl->statistics.inference_iterations++;
+			infer_progress = false;
+			for (auto ia_it = attis_to_infer.begin(); ia_it != attis_to_infer.end();) {
+				auto progress = infer_attachment(*ia_it->first, ia_it->second);
+				if (!progress) {
+					return progress;
+				}
+				infer_progress |= *progress;
+				if (ia_it->first->attachment.is_fully_known()) {
 					ia_it = attis_to_infer.erase(ia_it);
 				} else {
 					++ia_it;
@@ -552,52 +1124,53 @@ namespace vuk {
 			}
 		}
 
-		for (auto& [atti, iaref] : attis_to_infer) {
-			msg << "Could not infer attachment [" << atti->name.name.c_str() << "]:\n";
-			auto& ia = atti->attachment;
-			if (ia.sample_count == Samples::eInfer) {
-				msg << "- sample count unknown\n";
-			}
-			if (ia.extent.sizing == Sizing::eRelative) {
-				msg << "- relative sizing could not be resolved\n";
-			}
-			if (ia.extent.extent.width == 0) {
-				msg << "- extent.width unknown\n";
-			}
-			if (ia.extent.extent.height == 0) {
-				msg << "- extent.height unknown\n";
-			}
-			if (ia.extent.extent.depth == 0) {
-				msg << "- extent.depth unknown\n";
-			}
-			if (ia.format == Format::eUndefined) {
-				msg << "- format unknown\n";
-			}
-			if (ia.may_require_image_view() && ia.view_type == ImageViewType::eInfer) {
-				msg << "- view type unknown\n";
-			}
-			if (ia.base_layer == VK_REMAINING_ARRAY_LAYERS) {
-				msg << "- base layer unknown\n";
-			}
-			if (ia.layer_count == VK_REMAINING_ARRAY_LAYERS) {
-				msg << "- layer count unknown\n";
-			}
-			if (ia.base_level == VK_REMAINING_MIP_LEVELS) {
-				msg << "- base level unknown\n";
-			}
-			if (ia.level_count == VK_REMAINING_MIP_LEVELS) {
-				msg << "- level count unknown\n";
-			}
-			msg << "\n";
-		}
-
 		if (attis_to_infer.size() > 0) {
+			std::stringstream msg;
+			for (auto& [atti, iaref] : attis_to_infer) {
+				msg << "Could not infer attachment [" << atti->name.name.c_str() << "]:\n";
+				auto& ia = atti->attachment;
+				if (ia.sample_count == Samples::eInfer) {
+					msg << "- sample count unknown\n";
+				}
+				if (ia.extent.sizing == Sizing::eRelative) {
+					msg << "- relative sizing could not be resolved\n";
+				}
+				if (ia.extent.extent.width == 0) {
+					msg << "- extent.width unknown\n";
+				}
+				if (ia.extent.extent.height == 0) {
+					msg << "- extent.height unknown\n";
+				}
+				if (ia.extent.extent.depth == 0) {
+					msg << "- extent.depth unknown\n";
+				}
+				if (ia.format == Format::eUndefined) {
+					msg << "- format unknown\n";
+				}
+				if (ia.may_require_image_view() && ia.view_type == ImageViewType::eInfer) {
+					msg << "- view type unknown\n";
+				}
+				if (ia.base_layer == VK_REMAINING_ARRAY_LAYERS) {
+					msg << "- base layer unknown\n";
+				}
+				if (ia.layer_count == VK_REMAINING_ARRAY_LAYERS) {
+					msg << "- layer count unknown\n";
+				}
+				if (ia.base_level == VK_REMAINING_MIP_LEVELS) {
+					msg << "- base level unknown\n";
+				}
+				if (ia.level_count == VK_REMAINING_MIP_LEVELS) {
+					msg << "- level count unknown\n";
+				}
+				msg << "\n";
+			}
 			return { expected_error, RenderGraphException{ msg.str() } };
 		}
 
 		infer_progress = true;
 		// we provide an upper bound of 100 inference iterations to catch infinite loops that don't converge to a fixpoint
 		for (size_t i = 0; i < 100 && !bufis_to_infer.empty() && infer_progress; i++) {
+			impl->statistics.inference_iterations++;
 			infer_progress = false;
 			for (auto bufi_it = bufis_to_infer.begin(); bufi_it != bufis_to_infer.end();) {
 				auto& bufi = *bufi_it->first;
@@ -614,6 +1187,7 @@ namespace vuk {
 				if (prev != buff) { // progress made
 					// check for broken constraints
 					if (prev.size != buff.size && prev.size != ~(0u)) {
+						std::stringstream msg;
 						msg << "Rule broken for buffer[" << bufi.name.name.c_str() << "] :\n ";
 						msg << " size was previously known to be " << prev.size << ", but now set to " << buff.size;
 						return { expected_error, RenderGraphException{ msg.str() } };
@@ -629,15 +1203,15 @@ namespace vuk {
 			}
 		}
 
-		for (auto& [buff, bufinfs] : bufis_to_infer) {
-			msg << "Could not infer buffer [" << buff->name.name.c_str() << "]:\n";
-			if (buff->buffer.size == ~(0u)) {
-				msg << "- size unknown\n";
-			}
-			msg << "\n";
-		}
-
 		if (bufis_to_infer.size() > 0) {
+			std::stringstream msg;
+			for (auto& [buff, bufinfs] : bufis_to_infer) {
+				msg << "Could not infer buffer [" << buff->name.name.c_str() << "]:\n";
+				if (buff->buffer.size == ~(0u)) {
+					msg << "- size unknown\n";
+				}
+				msg << "\n";
+			}
 			return { expected_error, RenderGraphException{ msg.str() } };
 		}
 
@@ -676,9 +1250,29 @@ namespace vuk {
 			}
 		}
 
+		// internal images that are used on a single queue and don't escape the graph can share memory with images not alive at the same time
+		std::vector<RGCImpl::TransientLifetime> lifetimes;
+		if (impl->alias_transient_images) {
+			lifetimes = impl->compute_transient_lifetimes();
+		}
+		auto is_aliasable = [&](size_t i) {
+			if (lifetimes.empty()) {
+				return false;
+			}
+			auto& lifetime = lifetimes[i];
+			auto queue = lifetime.domain.m_mask;
+			return !lifetime.escapes && lifetime.last_pass >= 0 && queue != 0 && (queue & (queue - 1)) == 0;
+		};
+		std::vector<size_t> aliased;
+
 		// create non-attachment images
-		for (auto& bound : impl->bound_attachments) {
+		for (size_t i = 0; i < impl->bound_attachments.size(); i++) {
+			auto& bound = impl->bound_attachments[i];
 			if (!bound.attachment.image && bound.parent_attachment == 0) {
+				if (!bound.allocator && !bound.attachment.allow_srgb_unorm_mutable && is_aliasable(i)) {
+					aliased.push_back(i);
+					continue;
+				}
 				auto allocator = bound.allocator ? *bound.allocator : alloc;
 				assert(bound.attachment.usage != ImageUsageFlags{});
 				auto img = allocate_image(allocator, bound.attachment);
@@ -690,6 +1284,69 @@ namespace vuk {
 			}
 		}
 
+		if (aliased.size() > 0) {
+			// images on different queues can execute concurrently, so only images on the same queue share memory
+			std::stable_sort(aliased.begin(), aliased.end(), [&](size_t a, size_t b) { return lifetimes[a].domain.m_mask < lifetimes[b].domain.m_mask; });
+			std::vector<AliasedImageCreateInfo> cis;
+			cis.reserve(aliased.size());
+			for (auto i : aliased) {
+				auto& attachment = impl->bound_attachments[i].attachment;
+				assert(attachment.usage != ImageUsageFlags{});
+				assert(attachment.extent.sizing == Sizing::eAbsolute);
+				ImageCreateInfo ici;
+				ici.format = vuk::Format(attachment.format);
+				ici.imageType = attachment.image_type;
+				ici.flags = attachment.image_flags;
+				ici.arrayLayers = attachment.layer_count;
+				ici.samples = attachment.sample_count.count;
+				ici.tiling = attachment.tiling;
+				ici.mipLevels = attachment.level_count;
+				ici.usage = attachment.usage;
+				ici.extent = static_cast<vuk::Extent3D>(attachment.extent.extent);
+				cis.push_back({ ici, (uint32_t)lifetimes[i].first_pass, (uint32_t)lifetimes[i].last_pass });
+			}
+
+			std::vector<Image> images(aliased.size());
+			for (size_t begin = 0, end = 0; begin < aliased.size(); begin = end) {
+				auto queue = lifetimes[aliased[begin]].domain;
+				for (end = begin; end < aliased.size() && lifetimes[aliased[end]].domain == queue; end++)
+					;
+				auto dst = std::span(images).subspan(begin, end - begin);
+				VUK_DO_OR_RETURN(alloc.allocate_aliased_images(dst, std::span<const AliasedImageCreateInfo>(cis).subspan(begin, end - begin)));
+				// like the other transients, these are handed back right away and recycled by the allocator
+				alloc.deallocate(std::span<const Image>(dst));
+			}
+			for (size_t k = 0; k < aliased.size(); k++) {
+				auto& bound = impl->bound_attachments[aliased[k]];
+				bound.attachment.image = images[k];
+				ctx.set_name(bound.attachment.image.image, bound.name.name);
+			}
+
+			// aliasing barriers: the transition out of undefined at the start of an aliased image's lifetime
+			// must also wait for all uses of images on the same queue that ended before it started
+			std::vector<QueueResourceUse> alias_waits(impl->bound_attachments.size());
+			for (auto a : aliased) {
+				for (auto b : aliased) {
+					if (lifetimes[a].domain == lifetimes[b].domain && lifetimes[b].last_pass < lifetimes[a].first_pass) {
+						alias_waits[a].stages |= lifetimes[b].uses.stages;
+						alias_waits[a].access |= lifetimes[b].uses.access;
+					}
+				}
+			}
+			for (auto& barrier : impl->image_barriers) {
+				if (barrier.oldLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+					continue;
+				}
+				int32_t bound_idx;
+				std::memcpy(&bound_idx, &barrier.pNext, sizeof(bound_idx));
+				auto& bound = impl->get_bound_attachment(bound_idx);
+				auto root_idx = bound.parent_attachment < 0 ? bound.parent_attachment : bound_idx;
+				auto& wait = alias_waits[-1 * root_idx - 1];
+				barrier.srcStageMask |= (VkPipelineStageFlags2)wait.stages.m_mask;
+				barrier.srcAccessMask |= (VkAccessFlags2)wait.access.m_mask;
+			}
+		}
+
 		// create framebuffers, create & bind attachments
 		for (auto& rp : impl->rpis) {
 			if (rp.attachments.size() == 0)
@@ -770,54 +1427,91 @@ namespace vuk {
 
 		SubmitBundle sbundle;
 
-		auto record_batch = [&alloc, this](std::span<PassInfo*> passes, DomainFlagBits domain) -> Result<SubmitBatch> {
+		auto record_batch = [&options, this](Allocator& alloc, std::span<PassInfo*> passes, DomainFlagBits domain) -> Result<SubmitBatch> {
 			SubmitBatch sbatch{ .domain = domain };
 			auto partition_it = passes.begin();
 			while (partition_it != passes.end()) {
 				auto batch_index = (*partition_it)->batch_index;
 				auto new_partition_it = std::partition_point(partition_it, passes.end(), [batch_index](PassInfo* rpi) { return rpi->batch_index == batch_index; });
 				auto partition_span = std::span(partition_it, new_partition_it);
-				auto si = record_single_submit(alloc, partition_span, domain);
+				auto si = options.task_pool && partition_span.size() > 1 ? record_single_submit_parallel(alloc, partition_span, domain, *options.task_pool)
+				                                                         : record_single_submit(alloc, partition_span, domain);
 				if (!si) {
 					return si;
 				}
 				sbatch.submits.emplace_back(*si);
 				partition_it = new_partition_it;
 			}
-			for (auto& rel : impl->final_releases) {
-				if (rel.dst_use.domain & domain) {
-					sbatch.submits.back().future_signals.push_back(rel.signal);
-				}
-			}
-			
-			std::erase_if(impl->final_releases, [=](auto& rel) { return rel.dst_use.domain & domain; });
 			return { expected_value, sbatch };
 		};
 
+		// events of the split barriers - like the command pools, they are returned to alloc which keeps them until the submissions complete
+		Unique<std::vector<VkEvent>> split_events(alloc, std::vector<VkEvent>(impl->split_barriers.size()));
+		VUK_DO_OR_RETURN(alloc.allocate_events(*split_events));
+		impl->split_events = *split_events;
+
 		// record cbufs
 		// assume that rpis are partitioned wrt batch_index
+		struct DomainRecording {
+			std::span<PassInfo*> passes;
+			DomainFlagBits domain;
+			std::vector<FutureBase*> release_signals;
+			std::optional<Result<SubmitBatch>> batch;
+		};
+		std::array<DomainRecording, 3> recordings{ DomainRecording{ impl->graphics_passes, DomainFlagBits::eGraphicsQueue },
+			                                         DomainRecording{ impl->compute_passes, DomainFlagBits::eComputeQueue },
+			                                         DomainRecording{ impl->transfer_passes, DomainFlagBits::eTransferQueue } };
 
-		if (impl->graphics_passes.size() > 0) {
-			auto batch = record_batch(impl->graphics_passes, DomainFlagBits::eGraphicsQueue);
-			if (!batch) {
-				return batch;
+		// a final release is signalled by the first domain recorded that it targets
+		for (auto& rec : recordings) {
+			if (rec.passes.empty()) {
+				continue;
 			}
-			sbundle.batches.emplace_back(std::move(*batch));
+			for (auto& rel : impl->final_releases) {
+				if (rel.dst_use.domain & rec.domain) {
+					rec.release_signals.push_back(rel.signal);
+				}
+			}
+			std::erase_if(impl->final_releases, [domain = rec.domain](auto& rel) { return rel.dst_use.domain & domain; });
 		}
 
-		if (impl->compute_passes.size() > 0) {
-			auto batch = record_batch(impl->compute_passes, DomainFlagBits::eComputeQueue);
-			if (!batch) {
-				return batch;
+		// the domains allocate from alloc concurrently, the resources behind it are synchronized
+		auto record_domain = [&](DomainRecording& rec) {
+			rec.batch.emplace(record_batch(alloc, rec.passes, rec.domain));
+		};
+
+		if (options.task_pool) {
+			std::array<DomainRecording*, 3> to_record;
+			size_t record_count = 0;
+			for (auto& rec : recordings) {
+				if (!rec.passes.empty()) {
+					to_record[record_count++] = &rec;
+				}
+			}
+			options.task_pool->parallel_for(record_count, [&](size_t i) { record_domain(*to_record[i]); });
+		} else {
+			for (auto& rec : recordings) {
+				if (rec.passes.empty()) {
+					continue;
+				}
+				record_domain(rec);
+				if (!*rec.batch) {
+					break;
+				}
 			}
-			sbundle.batches.emplace_back(std::move(*batch));
 		}
 
-		if (impl->transfer_passes.size() > 0) {
-			auto batch = record_batch(impl->transfer_passes, DomainFlagBits::eTransferQueue);
+		// batches are emitted in domain order, reporting the first error in that order
+		for (auto& rec : recordings) {
+			if (!rec.batch) {
+				continue;
+			}
+			auto& batch = *rec.batch;
 			if (!batch) {
 				return batch;
 			}
+			auto& signals = batch->submits.back().future_signals;
+			signals.insert(signals.end(), rec.release_signals.begin(), rec.release_signals.end());
 			sbundle.batches.emplace_back(std::move(*batch));
 		}
 
@@ -881,7 +1575,8 @@ namespace vuk {
 		auto fqname = QualifiedName{ prefix, name };
 		auto resolved_name = erg->impl->resolve_name(fqname);
 
-		auto link = &erg->impl->res_to_links.at(resolved_name); // TODO: no error signaling
+		auto link = erg->impl->find_link(resolved_name); // TODO: no error signaling
+		assert(link);
 		while (link->def->pass > 0) {
 			link = link->prev;
 		}
@@ -892,7 +1587,8 @@ namespace vuk {
 		auto fqname = QualifiedName{ prefix, name };
 		auto resolved_name = erg->impl->resolve_name(fqname);
 
-		auto link = &erg->impl->res_to_links.at(resolved_name); // TODO: no error signaling
+		auto link = erg->impl->find_link(resolved_name); // TODO: no error signaling
+		assert(link);
 		while (link->def->pass > 0) {
 			link = link->prev;
 		}
@@ -5,12 +5,15 @@
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
 #include "vuk/Future.hpp"
+#include "vuk/TaskPool.hpp"
 
 #include <bit>
 #include <charconv>
 #include <fmt/printf.h>
+#include <memory>
 #include <set>
 #include <sstream>
+#include <tuple>
 #include <unordered_set>
 
 // intrinsics
@@ -42,6 +45,7 @@ namespace vuk {
 		pw.name = p.name;
 		pw.arguments = p.arguments;
 		pw.execute = std::move(p.execute);
+		pw.cache_key = p.cache_key;
 		pw.execute_on = p.execute_on;
 		pw.resources.offset0 = impl->resources.size();
 		impl->resources.insert(impl->resources.end(), p.resources.begin(), p.resources.end());
@@ -51,40 +55,82 @@ namespace vuk {
 		impl->passes.emplace_back(std::move(pw));
 	}
 
-	void RGCImpl::append(Name subgraph_name, const RenderGraph& other) {
+	void RGCImpl::resolve_resource(Name joiner, Resource& r, bool add_foreign_aliases) {
+		r.original_name = r.name.name;
+		if (r.foreign) {
+			auto prefix = std::find_if(sg_prefixes.begin(), sg_prefixes.end(), [=](auto& kv) { return kv.first == r.foreign; })->second;
+			auto full_src_prefix = !r.name.prefix.is_invalid() ? prefix.append(r.name.prefix.to_sv()) : prefix;
+			auto res_name = resolve_alias_rec({ full_src_prefix, r.name.name });
+			auto res_out_name = r.out_name.name.is_invalid() ? QualifiedName{} : resolve_alias_rec({ full_src_prefix, r.out_name.name });
+			auto full_dst_prefix = !r.name.prefix.is_invalid() ? joiner.append(r.name.prefix.to_sv()) : joiner;
+			if (add_foreign_aliases) {
+				computed_aliases.emplace(QualifiedName{ full_dst_prefix, r.name.name }, res_name);
+			}
+			r.name = res_name;
+			if (!r.out_name.is_invalid()) {
+				if (add_foreign_aliases) {
+					computed_aliases.emplace(QualifiedName{ full_dst_prefix, r.out_name.name }, res_out_name);
+				}
+				r.out_name = res_out_name;
+			}
+		} else {
+			if (!r.name.name.is_invalid()) {
+				r.name = resolve_alias_rec({ joiner, r.name.name });
+			}
+			r.out_name = r.out_name.name.is_invalid() ? QualifiedName{} : resolve_alias_rec({ joiner, r.out_name.name });
+		}
+	}
+
+	// adds the aliases introduced by a graph, in inlining order, and queues it for inlining
+	void RGCImpl::enqueue_inline(Name subgraph_name, const RenderGraph& other) {
 		Name joiner = subgraph_name.is_invalid() ? Name("") : subgraph_name;
 
 		for (auto [new_name, old_name] : other.impl->aliases) {
 			computed_aliases.emplace(QualifiedName{ joiner, new_name }, QualifiedName{ Name{}, old_name });
 		}
-
 		for (auto& p : other.impl->passes) {
-			PassInfo& pi = computed_passes.emplace_back(p);
-			pi.qualified_name = { joiner, p.name };
-			pi.resources.offset0 = resources.size();
 			for (auto r : p.resources.to_span(other.impl->resources)) {
-				r.original_name = r.name.name;
 				if (r.foreign) {
-					auto prefix = Name{ std::find_if(sg_prefixes.begin(), sg_prefixes.end(), [=](auto& kv) { return kv.first == r.foreign; })->second };
-					auto full_src_prefix = !r.name.prefix.is_invalid() ? prefix.append(r.name.prefix.to_sv()) : prefix;
-					auto res_name = resolve_alias_rec({ full_src_prefix, r.name.name });
-					auto res_out_name = r.out_name.name.is_invalid() ? QualifiedName{} : resolve_alias_rec({ full_src_prefix, r.out_name.name });
-					auto full_dst_prefix = !r.name.prefix.is_invalid() ? joiner.append(r.name.prefix.to_sv()) : joiner;
-					computed_aliases.emplace(QualifiedName{ full_dst_prefix, r.name.name }, res_name);
-					r.name = res_name;
-					if (!r.out_name.is_invalid()) {
-						computed_aliases.emplace(QualifiedName{ full_dst_prefix, r.out_name.name }, res_out_name);
-						r.out_name = res_out_name;
-					}
-				} else {
-					if (!r.name.name.is_invalid()) {
-						r.name = resolve_alias_rec({ joiner, r.name.name });
-					}
-					r.out_name = r.out_name.name.is_invalid() ? QualifiedName{} : resolve_alias_rec({ joiner, r.out_name.name });
+					resolve_resource(joiner, r, true);
 				}
-				resources.emplace_back(std::move(r));
 			}
-			pi.resources.offset1 = resources.size();
+		}
+
+		if (inlined_count == scratch.inlined.size()) {
+			scratch.inlined.emplace_back();
+		}
+		auto& inlined = scratch.inlined[inlined_count++];
+		inlined.joiner = joiner;
+		inlined.rg = &other;
+	}
+
+	// only reads the aliases, so graphs can be resolved concurrently once all of them are enqueued
+	void RGCImpl::resolve_passes(InlinedGraph& inlined) {
+		auto& other = *inlined.rg;
+		inlined.passes.clear();
+		inlined.resources.clear();
+		for (auto& p : other.impl->passes) {
+			PassInfo& pi = inlined.passes.emplace_back(p);
+			pi.qualified_name = { inlined.joiner, p.name };
+			pi.resources.offset0 = inlined.resources.size();
+			for (auto r : p.resources.to_span(other.impl->resources)) {
+				resolve_resource(inlined.joiner, r, false);
+				inlined.resources.emplace_back(std::move(r));
+			}
+			pi.resources.offset1 = inlined.resources.size();
+		}
+	}
+
+	void RGCImpl::append(InlinedGraph& inlined) {
+		auto& other = *inlined.rg;
+		auto joiner = inlined.joiner;
+
+		auto resource_base = resources.size();
+		resources.insert(resources.end(), inlined.resources.begin(), inlined.resources.end());
+		for (auto& pi : inlined.passes) {
+			auto& dst = computed_passes.emplace_back(pi);
+			dst.resources.offset0 += resource_base;
+			dst.resources.offset1 += resource_base;
 		}
 
 		for (auto [name, att] : other.impl->bound_attachments) {
@@ -168,11 +214,16 @@ namespace vuk {
 		std::erase_if(passes, [](auto& pass) { return pass.pass->type == PassType::eDiverge && pass.resources.size() == 0; });
 	}
 
-	Result<void> build_links(std::span<PassInfo> passes, ResourceLinkMap& res_to_links, std::vector<Resource>& resources, std::vector<ChainAccess>& pass_reads) {
-		// build edges into link map
-		// reserving here to avoid rehashing map
-		res_to_links.clear();
-		res_to_links.reserve(passes.size() * 10);
+	// link_of(res, false) is the link of the name of the resource, link_of(res, true) is the link of its out name
+	template<class F>
+	Result<void> build_links(std::span<PassInfo> passes,
+	                         F&& link_of,
+	                         std::vector<Resource>& resources,
+	                         std::vector<ChainAccess>& pass_reads,
+	                         std::vector<std::pair<ChainLink*, ChainAccess>>& reads) {
+		// build edges into links
+		// reads are gathered first, then appended grouped by link - appending interleaved would copy the spans repeatedly
+		reads.clear();
 
 		for (auto pass_idx = 0; pass_idx < passes.size(); pass_idx++) {
 			auto& pif = passes[pass_idx];
@@ -181,46 +232,71 @@ namespace vuk {
 				bool is_def = !res.out_name.is_invalid();
 				int32_t res_idx = static_cast<int32_t>(&res - &*pif.resources.to_span(resources).begin());
 				if (!res.name.is_invalid()) {
-					auto& r_io = res_to_links[res.name];
+					auto& r_io = link_of(res, false);
 					r_io.type = res.type;
 					if (!is_write_access(res.ia) && pif.pass->type != PassType::eForcedAccess && res.ia != Access::eConsume) {
-						r_io.reads.append(pass_reads, { pass_idx, res_idx });
+						reads.emplace_back(&r_io, ChainAccess{ pass_idx, res_idx });
 					}
 					if (is_write_access(res.ia) || res.ia == Access::eConsume || pif.pass->type == PassType::eForcedAccess) {
 						r_io.undef = { pass_idx, res_idx };
 						is_undef = true;
 						if (is_def) {
-							r_io.next = &res_to_links[res.out_name];
+							r_io.next = &link_of(res, true);
 						}
 					}
 				}
 				if (is_def) {
-					auto& w_io = res_to_links[res.out_name];
+					auto& w_io = link_of(res, true);
 					w_io.def = { pass_idx, res_idx };
 					w_io.type = res.type;
 					if (is_undef) {
-						w_io.prev = &res_to_links[res.name];
+						w_io.prev = &link_of(res, false);
 					}
 				}
 			}
 		}
 
+		// reads were gathered in pass order, so ordering by (link, pass, resource) keeps them in pass order within a link
+		std::sort(reads.begin(), reads.end(), [](auto& a, auto& b) {
+			if (a.first != b.first) {
+				return std::less<ChainLink*>{}(a.first, b.first);
+			}
+			return std::pair{ a.second.pass, a.second.resource } < std::pair{ b.second.pass, b.second.resource };
+		});
+		for (auto& [link, read] : reads) {
+			link->reads.append(pass_reads, read);
+		}
+
 		return { expected_value };
 	}
 
+	Result<void> RGCImpl::build_links() {
+		links.assign(resource_ids.size(), ChainLink{});
+		pass_reads.clear();
+		return vuk::build_links(
+		    computed_passes,
+		    [this](const Resource& res, bool out) -> ChainLink& {
+			    auto& ids = get_ids(res);
+			    return links[out ? ids.out_name : ids.name];
+		    },
+		    resources,
+		    pass_reads,
+		    scratch.reads);
+	}
+
 	Result<void> RGCImpl::terminate_chains() {
 		// introduce chain links with inputs (acquired and attached buffers & images) and outputs (releases)
 		// these are denoted with negative indices
 		for (auto& bound : bound_attachments) {
-			res_to_links[bound.name].def = { .pass = static_cast<int32_t>(-1 * (&bound - &*bound_attachments.begin() + 1)) };
+			find_link(bound.name)->def = { .pass = static_cast<int32_t>(-1 * (&bound - &*bound_attachments.begin() + 1)) };
 		}
 
 		for (auto& bound : bound_buffers) {
-			res_to_links[bound.name].def = { .pass = static_cast<int32_t>(-1 * (&bound - &*bound_buffers.begin() + 1)) };
+			find_link(bound.name)->def = { .pass = static_cast<int32_t>(-1 * (&bound - &*bound_buffers.begin() + 1)) };
 		}
 
 		for (auto& bound : releases) {
-			res_to_links[bound.first].undef = { .pass = static_cast<int32_t>(-1 * (&bound - &*releases.begin() + 1)) };
+			find_link(bound.first)->undef = { .pass = static_cast<int32_t>(-1 * (&bound - &*releases.begin() + 1)) };
 		}
 
 		return { expected_value };
@@ -238,6 +314,20 @@ namespace vuk {
 		return { expected_value };
 	}
 
+	Result<void> collect_chains(std::span<ChainLink> links, std::vector<ChainLink*>& chains) {
+		chains.clear();
+		// collect chains by looking at links without a prev
+		for (auto& link : links) {
+			// names only used by culled passes are left with empty links
+			bool used = link.def || link.undef || link.reads.size() > 0;
+			if (used && !link.prev) {
+				chains.push_back(&link);
+			}
+		}
+
+		return { expected_value };
+	}
+
 	Result<void> RGCImpl::diagnose_unheaded_chains() {
 		// diagnose unheaded chains at this point
 		for (auto& chp : chains) {
@@ -260,55 +350,365 @@ namespace vuk {
 		return { expected_value };
 	}
 
-	Result<void> RGCImpl::schedule_intra_queue(std::span<PassInfo> passes, const RenderGraphCompileOptions& compile_options) {
-		// calculate indegrees for all passes & build adjacency
-		std::vector<size_t> indegrees(passes.size());
-		std::vector<uint8_t> adjacency_matrix(passes.size() * passes.size());
-		for (auto& [qfname, link] : res_to_links) {
-			if (link.undef && (link.undef->pass >= 0) &&
-			    ((link.def && link.def->pass >= 0) || link.reads.size() > 0)) { // we only care about an undef if the def or reads are in the graph
-				indegrees[link.undef->pass]++;
+	Result<void> RGCImpl::cull_dead_passes() {
+		// a Future for the whole graph observes every pass in it
+		if (final_releases.size() > 0) {
+			return { expected_value };
+		}
+
+		// chains that don't start from an internal resource are visible outside the graph
+		// (subchains start from a diverge pass, we conservatively treat those as visible too)
+		auto& external_links = scratch.external_links;
+		external_links.assign(links.size(), false);
+		for (auto head : chains) {
+			bool internal = false;
+			if (head->def && head->def->pass < 0) {
+				if (head->type == Resource::Type::eImage) {
+					internal = get_bound_attachment(head->def->pass).type == AttachmentInfo::Type::eInternal;
+				} else {
+					internal = !get_bound_buffer(head->def->pass).buffer;
+				}
+			}
+			if (!internal) {
+				for (ChainLink* link = head; link != nullptr; link = link->next) {
+					external_links[link - links.data()] = true;
+				}
+			}
+		}
+
+		// walk backwards from the passes with effects outside the graph: releases, writes to external resources and passes without resources
+		auto& live = scratch.live;
+		live.assign(computed_passes.size(), false);
+		auto& work_queue = scratch.work_queue;
+		work_queue.clear();
+		auto mark_live = [&](int32_t pass_idx) {
+			if (pass_idx >= 0 && !live[pass_idx]) {
+				live[pass_idx] = true;
+				work_queue.push_back(pass_idx);
+			}
+		};
+		for (auto& link : links) {
+			if (link.undef && link.undef->pass < 0 && link.def) {
+				mark_live(link.def->pass);
+			}
+		}
+		for (int32_t i = 0; i < (int32_t)computed_passes.size(); i++) {
+			auto& pass = computed_passes[i];
+			if (pass.resources.size() == 0) {
+				mark_live(i);
+			}
+			for (auto& res : pass.resources.to_span(resources)) {
+				bool is_undef = is_write_access(res.ia) || res.ia == Access::eConsume || pass.pass->type == PassType::eForcedAccess;
+				if (res.name.is_invalid() || !is_undef) {
+					continue;
+				}
+				if (external_links[get_ids(res).name]) {
+					mark_live(i);
+				}
+			}
+		}
+		// a live pass keeps the producers of everything it reads or overwrites alive
+		while (work_queue.size() > 0) {
+			auto pass_idx = work_queue.back();
+			work_queue.pop_back();
+			for (auto& res : computed_passes[pass_idx].resources.to_span(resources)) {
+				if (res.name.is_invalid()) {
+					continue;
+				}
+				auto& link = get_link(res);
 				if (link.def) {
-					adjacency_matrix[link.def->pass * passes.size() + link.undef->pass]++; // def -> undef
+					mark_live(link.def->pass);
+				}
+			}
+		}
+
+		if (std::find(live.begin(), live.end(), false) == live.end()) {
+			return { expected_value };
+		}
+
+		// drop dead passes, remembering the resources they used
+		auto& dead_uses = scratch.dead_uses;
+		dead_uses.assign(links.size(), false);
+		size_t dst = 0;
+		for (size_t i = 0; i < computed_passes.size(); i++) {
+			if (live[i]) {
+				if (dst != i) {
+					computed_passes[dst] = std::move(computed_passes[i]);
 				}
+				dst++;
+			} else {
+				culled_passes.push_back(computed_passes[i].qualified_name);
+				for (auto& res : computed_passes[i].resources.to_span(resources)) {
+					if (!res.name.is_invalid()) {
+						dead_uses[get_ids(res).name] = true;
+					}
+				}
+			}
+		}
+		computed_passes.erase(computed_passes.begin() + dst, computed_passes.end());
+
+		VUK_DO_OR_RETURN(build_links());
+
+		// internal resources only used by dead passes are dropped, so that we don't allocate or infer them
+		auto unused = [&](const QualifiedName& name) {
+			auto id = resource_ids.at(name);
+			if (!dead_uses[id]) {
+				return false;
+			}
+			if (std::find_if(releases.begin(), releases.end(), [&](auto& release) { return release.first == name; }) != releases.end()) {
+				return false;
+			}
+			return links[id].reads.size() == 0 && !links[id].undef;
+		};
+		std::erase_if(bound_attachments, [&](auto& bound) { return bound.type == AttachmentInfo::Type::eInternal && unused(bound.name); });
+		std::erase_if(bound_buffers, [&](auto& bound) { return !bound.buffer && unused(bound.name); });
+
+		VUK_DO_OR_RETURN(terminate_chains());
+		VUK_DO_OR_RETURN(collect_chains(links, chains));
+		return diagnose_unheaded_chains();
+	}
+
+	Result<void> RGCImpl::build_chains(const RenderGraphCompileOptions& compile_options) {
+		VUK_DO_OR_RETURN(build_links());
+		VUK_DO_OR_RETURN(terminate_chains());
+		VUK_DO_OR_RETURN(collect_chains(links, chains));
+		VUK_DO_OR_RETURN(diagnose_unheaded_chains());
+		if (compile_options.cull_dead_passes) {
+			VUK_DO_OR_RETURN(cull_dead_passes());
+		}
+		return { expected_value };
+	}
+
+	Result<void> RGCImpl::schedule_intra_queue(std::span<PassInfo> passes, const RenderGraphCompileOptions& compile_options) {
+		// collect dependency edges & calculate indegrees for all passes
+		auto& indegrees = scratch.indegrees;
+		indegrees.assign(passes.size(), 0);
+		auto& edges = scratch.edges;
+		edges.clear();
+		auto add_edge = [&](int32_t src, int32_t dst) {
+			indegrees[dst]++;
+			edges.emplace_back((uint32_t)src, (uint32_t)dst);
+		};
+		for (auto& link : links) {
+			// we only care about an undef if the def or reads are in the graph - if there are reads, they are ordered by read -> undef
+			if (link.undef && (link.undef->pass >= 0) && (link.def && link.def->pass >= 0)) {
+				add_edge(link.def->pass, link.undef->pass); // def -> undef
 			}
 			for (auto& read : link.reads.to_span(pass_reads)) {
 				if ((link.def && link.def->pass >= 0)) {
-					indegrees[read.pass]++;                                         // this only counts as a dep if there is a def before
-					adjacency_matrix[link.def->pass * passes.size() + read.pass]++; // def -> read
+					add_edge(link.def->pass, read.pass); // def -> read, this only counts as a dep if there is a def before
 				}
 				if ((link.undef && link.undef->pass >= 0)) {
-					indegrees[link.undef->pass]++;
-					adjacency_matrix[read.pass * passes.size() + link.undef->pass]++; // read -> undef
+					add_edge(read.pass, link.undef->pass); // read -> undef
 				}
 			}
 		}
 
-		// enqueue all indegree == 0 passes
-		std::vector<size_t> process_queue;
-		for (auto i = 0; i < indegrees.size(); i++) {
-			if (indegrees[i] == 0)
-				process_queue.push_back(i);
+		// build CSR adjacency: successors of pass i are successors[offsets[i]..offsets[i+1])
+		auto& offsets = scratch.offsets;
+		offsets.assign(passes.size() + 1, 0);
+		for (auto& [src, dst] : edges) {
+			offsets[src + 1]++;
+		}
+		for (size_t i = 0; i < passes.size(); i++) {
+			offsets[i + 1] += offsets[i];
 		}
-		// dequeue indegree = 0 pass, add it to the ordered list, then decrement adjacent pass indegrees and push indegree == 0 to queue
+		auto& successors = scratch.successors;
+		successors.resize(edges.size());
+		{
+			auto& fill = scratch.fill;
+			fill.assign(offsets.begin(), offsets.end() - 1);
+			for (auto& [src, dst] : edges) {
+				successors[fill[src]++] = dst;
+			}
+		}
+		// visit successors in pass order, so that the schedule is independent of link map iteration order
+		for (size_t i = 0; i < passes.size(); i++) {
+			std::sort(successors.begin() + offsets[i], successors.begin() + offsets[i + 1]);
+		}
+
+		// add pass to the ordered list, then decrement adjacent pass indegrees and report passes reaching indegree == 0
 		computed_pass_idx_to_ordered_idx.resize(passes.size());
 		ordered_idx_to_computed_pass_idx.resize(passes.size());
-		while (process_queue.size() > 0) {
-			auto pop_idx = process_queue.back();
+		ordered_passes.reserve(passes.size());
+		// ordered index of the last scheduled producer of each pass
+		auto& latest_producer = scratch.latest_producer;
+		latest_producer.assign(passes.size(), -1);
+		auto schedule = [&](size_t pop_idx, auto&& on_ready) {
 			computed_pass_idx_to_ordered_idx[pop_idx] = ordered_passes.size();
 			ordered_idx_to_computed_pass_idx[ordered_passes.size()] = pop_idx;
-			ordered_passes.emplace_back(&passes[pop_idx]);
-			process_queue.pop_back();
-			for (auto i = 0; i < passes.size(); i++) { // all the outgoing from this pass
+			for (auto e = offsets[pop_idx]; e < offsets[pop_idx + 1]; e++) { // all the outgoing from this pass
+				auto i = successors[e];
 				if (i == pop_idx) {
 					continue;
 				}
-				auto adj_value = adjacency_matrix[pop_idx * passes.size() + i];
-				if (adj_value > 0) {
-					if (indegrees[i] -= adj_value; indegrees[i] == 0) {
-						process_queue.push_back(i);
+				latest_producer[i] = (int64_t)ordered_passes.size();
+				if (--indegrees[i] == 0) {
+					on_ready(i);
+				}
+			}
+			ordered_passes.emplace_back(&passes[pop_idx]);
+		};
+
+		auto ordering = compile_options.pass_ordering;
+		if (ordering == PassOrdering::eDefault) {
+			// enqueue all indegree == 0 passes
+			auto& process_queue = scratch.process_queue;
+			process_queue.clear();
+			for (auto i = 0; i < indegrees.size(); i++) {
+				if (indegrees[i] == 0)
+					process_queue.push_back(i);
+			}
+			// dequeue the most recently unblocked pass
+			while (process_queue.size() > 0) {
+				auto pop_idx = process_queue.back();
+				process_queue.pop_back();
+				schedule(pop_idx, [&](size_t i) { process_queue.push_back(i); });
+			}
+		} else {
+			// ready passes are picked by lowest priority, ties broken by pass index
+			auto& priority = scratch.priority;
+			priority.assign(passes.size(), 0);
+			// grouping heuristics prefer a ready pass in the group of the previously scheduled pass
+			bool grouped = ordering == PassOrdering::eMinimizeRenderPassSwitches;
+			auto& group = scratch.group;
+			group.assign(grouped ? passes.size() : 0, 0);
+
+			if (grouped) {
+				for (size_t i = 0; i < passes.size(); i++) {
+					auto& pass = passes[i];
+					priority[i] = (int64_t)i;
+					// passes that can share a render pass have the same ordered attachments
+					size_t h = 0;
+					for (auto& res : pass.resources.to_span(resources)) {
+						if (is_framebuffer_attachment(res)) {
+							hash_combine(h, get_ids(res).assigned);
+						}
+					}
+					group[i] = h;
+				}
+			} else if (ordering == PassOrdering::eMinimizeBarriers) {
+				for (size_t i = 0; i < passes.size(); i++) {
+					priority[i] = (int64_t)i;
+				}
+			} else if (ordering == PassOrdering::eCriticalPathFirst) {
+				// longest path to a sink, computed in reverse topological order
+				auto& topo_order = scratch.topo_order;
+				topo_order.clear();
+				topo_order.reserve(passes.size());
+				auto& remaining = scratch.remaining;
+				remaining = indegrees;
+				for (size_t i = 0; i < passes.size(); i++) {
+					if (remaining[i] == 0) {
+						topo_order.push_back(i);
+					}
+				}
+				for (size_t k = 0; k < topo_order.size(); k++) {
+					auto v = topo_order[k];
+					for (auto e = offsets[v]; e < offsets[v + 1]; e++) {
+						if (successors[e] != v && --remaining[successors[e]] == 0) {
+							topo_order.push_back(successors[e]);
+						}
+					}
+				}
+				for (auto it = topo_order.rbegin(); it != topo_order.rend(); ++it) {
+					auto v = *it;
+					int64_t longest = 0;
+					for (auto e = offsets[v]; e < offsets[v + 1]; e++) {
+						if (successors[e] != v) {
+							longest = std::max(longest, -priority[successors[e]]);
+						}
+					}
+					priority[v] = -(longest + 1);
+				}
+			}
+
+			std::set<std::pair<int64_t, size_t>> ready;
+			robin_hood::unordered_flat_map<size_t, std::set<size_t>> ready_in_group;
+			// the resources used by ready passes, for finding the ready passes sharing resources with the previously scheduled pass
+			bool sharing = ordering == PassOrdering::eMinimizeBarriers;
+			robin_hood::unordered_flat_map<int32_t, std::set<size_t>> ready_using;
+			auto& shared_count = scratch.shared_count;
+			shared_count.assign(sharing ? passes.size() : 0, 0);
+			auto& touched = scratch.touched;
+			// uses of the same image or buffer, through any of its names
+			auto resource_key = [&](const Resource& res) {
+				auto& ids = get_ids(res);
+				return ids.assigned >= 0 ? ids.assigned : ids.name;
+			};
+			auto make_ready = [&](size_t i) {
+				if (ordering == PassOrdering::eMaximizeProducerConsumerDistance) {
+					priority[i] = latest_producer[i]; // all producers are scheduled by now
+				}
+				ready.emplace(priority[i], i);
+				if (grouped) {
+					ready_in_group[group[i]].emplace(i);
+				}
+				if (sharing) {
+					for (auto& res : passes[i].resources.to_span(resources)) {
+						if (!res.name.is_invalid()) {
+							ready_using[resource_key(res)].emplace(i);
+						}
+					}
+				}
+			};
+			for (size_t i = 0; i < passes.size(); i++) {
+				if (indegrees[i] == 0) {
+					make_ready(i);
+				}
+			}
+
+			std::optional<size_t> last_group;
+			std::optional<size_t> last_pass;
+			while (ready.size() > 0) {
+				size_t pop_idx = ready.begin()->second;
+				if (last_group) {
+					auto& same_group = ready_in_group[*last_group];
+					if (same_group.size() > 0) {
+						pop_idx = *same_group.begin();
+					}
+				}
+				if (sharing && last_pass) {
+					// the ready pass sharing the most resources with the previous pass goes next, ties broken by pass index
+					// uses of a resource back to back can share a barrier and keep its layout, interleaving other passes brings transitions back
+					touched.clear();
+					for (auto& res : passes[*last_pass].resources.to_span(resources)) {
+						if (res.name.is_invalid()) {
+							continue;
+						}
+						auto it = ready_using.find(resource_key(res));
+						if (it == ready_using.end()) {
+							continue;
+						}
+						for (auto i : it->second) {
+							if (shared_count[i]++ == 0) {
+								touched.push_back(i);
+							}
+						}
 					}
+					uint32_t most_shared = 0;
+					for (auto i : touched) {
+						if (shared_count[i] > most_shared || (shared_count[i] == most_shared && i < pop_idx)) {
+							most_shared = shared_count[i];
+							pop_idx = i;
+						}
+						shared_count[i] = 0;
+					}
+				}
+				ready.erase({ priority[pop_idx], pop_idx });
+				if (grouped) {
+					ready_in_group[group[pop_idx]].erase(pop_idx);
+					last_group = group[pop_idx];
 				}
+				if (sharing) {
+					for (auto& res : passes[pop_idx].resources.to_span(resources)) {
+						if (!res.name.is_invalid()) {
+							ready_using[resource_key(res)].erase(pop_idx);
+						}
+					}
+					last_pass = pop_idx;
+				}
+				schedule(pop_idx, make_ready);
 			}
 		}
 		assert(ordered_passes.size() == passes.size());
@@ -325,15 +725,15 @@ namespace vuk {
 			if (head->def->pass >= 0 && head->type == Resource::Type::eImage) { // no Buffer divergence
 				auto& pass = get_pass(*head->def);
 				if (pass.pass->type == PassType::eDiverge) { // diverging subchain
-					auto& whole_res = pass.resources.to_span(resources)[0].name;
-					auto parent_chain_end = &res_to_links[whole_res];
+					auto& whole_res = pass.resources.to_span(resources)[0];
+					auto parent_chain_end = &get_link(whole_res);
 					head->source = parent_chain_end;
 					parent_chain_end->child_chains.append(child_chains, head);
 				} else if (pass.pass->type == PassType::eConverge) { // reconverged subchain
 					// take first resource which guaranteed to be diverged
 					auto div_resources = pass.resources.to_span(resources).subspan(1);
 					for (auto& res : div_resources) {
-						res_to_links[res.name].destination = head;
+						get_link(res).destination = head;
 					}
 				}
 			}
@@ -353,7 +753,7 @@ namespace vuk {
 					auto& div_res = div_resources[0];
 					// TODO: we actually need to walk all converging resources here to find the scope of the convergence
 					// walk this resource to convergence
-					ChainLink* link = &res_to_links[div_res.name];
+					ChainLink* link = &get_link(div_res);
 					while (link->prev) { // seek to the head of the diverged chain
 						link = link->prev;
 					}
@@ -395,8 +795,8 @@ namespace vuk {
 				if (pass.pass->type == PassType::eDiverge) { // diverging subchain
 					div_subchains.push_back(head);
 					// whole resource is always first resource
-					auto& whole_res = pass.resources.to_span(resources)[0].name;
-					auto link = &res_to_links[whole_res];
+					auto& whole_res = pass.resources.to_span(resources)[0];
+					auto link = &get_link(whole_res);
 					while (link->prev) { // seek to the head of the original chain
 						link = link->prev;
 					}
@@ -554,7 +954,7 @@ namespace vuk {
 			prefix.resize(ptr - prefix.data());
 		}
 
-		sg_prefixes.emplace(&rg, prefix);
+		sg_prefixes.emplace(&rg, Name(prefix));
 
 		prefix.append("::");
 
@@ -579,44 +979,120 @@ namespace vuk {
 				for (auto& [name_in_parent, name_in_sg] : sg_info.exported_names) {
 					QualifiedName old_name;
 					if (!name_in_sg.prefix.is_invalid()) { // unfortunately, prefix + name_in_sg.prefix duplicates the name of the sg, so remove it
-						std::string fixed_prefix = prefix.substr(0, prefix.size() - sg_raw_ptr->name.to_sv().size());
+						std::string fixed_prefix(prefix.to_sv().substr(0, prefix.to_sv().size() - sg_raw_ptr->name.to_sv().size()));
 						fixed_prefix.append(name_in_sg.prefix.to_sv());
 						old_name = QualifiedName{ Name(fixed_prefix), name_in_sg.name };
 					} else {
-						old_name = QualifiedName{ Name(prefix), name_in_sg.name };
+						old_name = QualifiedName{ prefix, name_in_sg.name };
 					}
 
-					auto new_name = QualifiedName{ our_prefix.empty() ? Name{} : Name(our_prefix), name_in_parent };
+					auto new_name = QualifiedName{ our_prefix.to_sv().empty() ? Name{} : our_prefix, name_in_parent };
 					computed_aliases[new_name] = old_name;
 				}
 				if (!consumed_rgs.contains(sg_raw_ptr)) {
 					inline_subgraphs(*sg_raw_ptr, consumed_rgs);
-					append(Name(prefix), *sg_raw_ptr);
+					enqueue_inline(prefix, *sg_raw_ptr);
 					consumed_rgs.emplace(sg_raw_ptr);
 				}
 			}
 		}
 	}
 
+	void RGCImpl::reset() {
+		// storage on the arena is dropped before rewinding it, everything else keeps its capacity
+		decltype(computed_passes)(computed_passes.get_allocator()).swap(computed_passes);
+		decltype(ordered_passes)(ordered_passes.get_allocator()).swap(ordered_passes);
+		decltype(partitioned_passes)(partitioned_passes.get_allocator()).swap(partitioned_passes);
+		decltype(rpis)(rpis.get_allocator()).swap(rpis);
+		// a deque allocates on construction, so it can only be recreated after the rewind
+		auto helper_links_allocator = helper_links.get_allocator();
+		std::destroy_at(&helper_links);
+		arena_->reset();
+		std::construct_at(&helper_links, helper_links_allocator);
+
+		resources.clear();
+		waits.clear();
+		absolute_waits.clear();
+		future_signals.clear();
+		absolute_wait_sources.clear();
+		future_signal_sources.clear();
+		computed_pass_idx_to_ordered_idx.clear();
+		ordered_idx_to_computed_pass_idx.clear();
+		computed_pass_idx_to_partitioned_idx.clear();
+		computed_aliases.clear();
+		assigned_names.clear();
+		sg_name_counter.clear();
+		sg_prefixes.clear();
+		image_barriers.clear();
+		mem_barriers.clear();
+		split_candidates.clear();
+		split_barriers.clear();
+		split_barrier_refs.clear();
+		resource_ids.clear();
+		ids_per_resource.clear();
+		links.clear();
+		pass_reads.clear();
+		chains.clear();
+		child_chains.clear();
+		swapchain_references.clear();
+		rp_infos.clear();
+		last_ordered_pass_idx_in_domain_array = {};
+		bound_attachments.clear();
+		bound_buffers.clear();
+		attachment_use_chain_references.clear();
+		attachment_rp_references.clear();
+		releases.clear();
+		final_releases.clear();
+		ia_inference_rules.clear();
+		buf_inference_rules.clear();
+		diverged_subchain_headers.clear();
+		transfer_passes = {};
+		compute_passes = {};
+		graphics_passes = {};
+		culled_passes.clear();
+		div_subchains.clear();
+		conv_subchains.clear();
+		inlined_count = 0;
+		statistics = {};
+		callbacks = {};
+		alias_transient_images = false;
+	}
+
 	Compiler::Compiler() : impl(new RGCImpl) {}
 	Compiler::~Compiler() {
 		delete impl;
 	}
 
-	Result<void> Compiler::inline_rgs(std::span<std::shared_ptr<RenderGraph>> rgs) {
+	Result<void> RGCImpl::inline_rgs(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
 		// inline all the subgraphs into us
-
-		robin_hood::unordered_flat_set<RenderGraph*> consumed_rgs = {};
-		std::string prefix = "";
+		// aliases are collected serially in inlining order, after which each graph can be resolved on its own
+		auto& consumed_rgs = scratch.consumed_rgs;
+		auto& prefix = scratch.prefix;
+		prefix.clear();
+		inlined_count = 0;
 		for (auto& rg : rgs) {
-			impl->compute_prefixes(*rg, prefix);
+			compute_prefixes(*rg, prefix);
 			consumed_rgs.clear();
-			impl->inline_subgraphs(*rg, consumed_rgs);
+			inline_subgraphs(*rg, consumed_rgs);
 		}
+		statistics.subgraphs_inlined = sg_prefixes.size() - rgs.size();
 
 		for (auto& rg : rgs) {
-			auto our_prefix = std::find_if(impl->sg_prefixes.begin(), impl->sg_prefixes.end(), [rgp = rg.get()](auto& kv) { return kv.first == rgp; })->second;
-			impl->append(Name{ our_prefix.c_str() }, *rg);
+			auto our_prefix = std::find_if(sg_prefixes.begin(), sg_prefixes.end(), [rgp = rg.get()](auto& kv) { return kv.first == rgp; })->second;
+			enqueue_inline(our_prefix, *rg);
+		}
+
+		auto inlined = std::span(scratch.inlined.data(), inlined_count);
+		if (compile_options.task_pool) {
+			compile_options.task_pool->parallel_for(inlined.size(), [&](size_t i) { resolve_passes(inlined[i]); });
+		} else {
+			for (auto& ig : inlined) {
+				resolve_passes(ig);
+			}
+		}
+		// merge in inlining order, so the result doesn't depend on which thread resolved what
+		for (auto& ig : inlined) {
+			append(ig);
 		}
 
 		return { expected_value };
@@ -624,7 +1100,8 @@ namespace vuk {
 
 	void RGCImpl::compute_assigned_names() {
 		// gather name alias info now - once we partition, we might encounter unresolved aliases
-		robin_hood::unordered_flat_map<QualifiedName, QualifiedName> name_map;
+		auto& name_map = scratch.name_map;
+		name_map.clear();
 		name_map.insert(computed_aliases.begin(), computed_aliases.end());
 
 		for (auto& passinfo : computed_passes) {
@@ -639,15 +1116,57 @@ namespace vuk {
 
 		assigned_names.clear();
 		// populate resource name -> use chain map
+		// every name walked through resolves to the same chain, so we record all of them to keep this linear in long chains
+		auto& walked = scratch.walked;
 		for (auto& [k, v] : name_map) {
-			auto it = name_map.find(v);
-			auto res = v;
+			if (assigned_names.contains(k)) {
+				continue;
+			}
+			walked.clear();
+			auto res = k;
+			auto it = name_map.find(res);
 			while (it != name_map.end()) {
+				if (auto resolved = assigned_names.find(res); resolved != assigned_names.end()) {
+					res = resolved->second;
+					break;
+				}
+				walked.push_back(res);
 				res = it->second;
 				it = name_map.find(res);
 			}
 			assert(!res.is_invalid());
-			assigned_names.emplace(k, res);
+			for (auto& name : walked) {
+				assigned_names.emplace(name, res);
+			}
+		}
+	}
+
+	void RGCImpl::assign_resource_ids() {
+		resource_ids.clear();
+		auto id_of = [this](const QualifiedName& name) -> int32_t {
+			if (name.is_invalid()) {
+				return -1;
+			}
+			return resource_ids.emplace(name, static_cast<int32_t>(resource_ids.size())).first->second;
+		};
+
+		ids_per_resource.resize(resources.size());
+		for (size_t i = 0; i < resources.size(); i++) {
+			auto& res = resources[i];
+			auto& ids = ids_per_resource[i];
+			ids.name = id_of(res.name);
+			ids.out_name = id_of(res.out_name);
+			ids.assigned = res.name.is_invalid() ? -1 : id_of(resolve_name(res.name));
+		}
+		// bound resources and releases can be named without any pass referring to them
+		for (auto& bound : bound_attachments) {
+			id_of(bound.name);
+		}
+		for (auto& bound : bound_buffers) {
+			id_of(bound.name);
+		}
+		for (auto& release : releases) {
+			id_of(release.first);
 		}
 	}
 
@@ -867,38 +1386,68 @@ namespace vuk {
 		}
 	}
 
-	Result<void> Compiler::compile(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
-		auto arena = impl->arena_.release();
-		delete impl;
-		arena->reset();
-		impl = new RGCImpl(arena);
-		impl->callbacks = compile_options.callbacks;
+	// adds the wall time of the enclosing scope to a phase time
+	struct PhaseTimer {
+		std::chrono::nanoseconds& phase_time;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-		VUK_DO_OR_RETURN(inline_rgs(rgs));
+		~PhaseTimer() {
+			phase_time += std::chrono::steady_clock::now() - start;
+		}
+	};
 
-		impl->compute_assigned_names();
+	Result<void> Compiler::compile(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
+		impl->reset();
+		impl->callbacks = compile_options.callbacks;
+		impl->alias_transient_images = compile_options.alias_transient_images;
+		// the cached link is only valid until the next compile
+		if (impl->link_cache) {
+			impl->link_cache->valid = false;
+		}
 
-		impl->merge_diverge_passes(impl->computed_passes);
+		auto& times = impl->statistics.phase_times;
+		{
+			PhaseTimer _{ times.inline_rgs };
+			VUK_DO_OR_RETURN(impl->inline_rgs(rgs, compile_options));
+		}
+		{
+			PhaseTimer _{ times.compute_assigned_names };
+			impl->compute_assigned_names();
+			impl->merge_diverge_passes(impl->computed_passes);
+			impl->assign_resource_ids();
+		}
 
 		// run global pass ordering - once we split per-queue we don't see enough
 		// inputs to order within a queue
 
-		VUK_DO_OR_RETURN(build_links(impl->computed_passes, impl->res_to_links, impl->resources, impl->pass_reads));
-		VUK_DO_OR_RETURN(impl->terminate_chains());
-		VUK_DO_OR_RETURN(collect_chains(impl->res_to_links, impl->chains));
-		VUK_DO_OR_RETURN(impl->diagnose_unheaded_chains());
-		VUK_DO_OR_RETURN(impl->schedule_intra_queue(impl->computed_passes, compile_options));
-
-		VUK_DO_OR_RETURN(impl->relink_subchains());
-		resource_linking();
-		VUK_DO_OR_RETURN(impl->fix_subchains());
-		// fix subchains might remove chains, so drop those now
-		std::erase(impl->chains, nullptr);
+		{
+			PhaseTimer _{ times.build_links };
+			VUK_DO_OR_RETURN(impl->build_chains(compile_options));
+		}
+		{
+			PhaseTimer _{ times.schedule_intra_queue };
+			VUK_DO_OR_RETURN(impl->schedule_intra_queue(impl->computed_passes, compile_options));
+		}
+		{
+			PhaseTimer _{ times.relink_subchains };
+			VUK_DO_OR_RETURN(impl->relink_subchains());
+			resource_linking();
+		}
+		{
+			PhaseTimer _{ times.fix_subchains };
+			VUK_DO_OR_RETURN(impl->fix_subchains());
+			// fix subchains might remove chains, so drop those now
+			std::erase(impl->chains, nullptr);
+		}
 		// auto dumped_graph = dump_graph();
 
-		queue_inference();
-		pass_partitioning();
-		render_pass_assignment();
+		{
+			PhaseTimer _{ times.queue_inference };
+			queue_inference();
+			pass_partitioning();
+			render_pass_assignment();
+		}
+		impl->statistics.chains = impl->chains.size();
 
 		return { expected_value };
 	}
@@ -1073,11 +1622,11 @@ namespace vuk {
 		}
 	}
 
-	void RenderGraph::inference_rule(Name target, std::function<void(const struct InferenceContext&, ImageAttachment&)> rule) {
+	void RenderGraph::inference_rule(Name target, IARule rule) {
 		impl->ia_inference_rules.emplace_back(IAInference{ QualifiedName{ Name{}, target }, std::move(rule) });
 	}
 
-	void RenderGraph::inference_rule(Name target, std::function<void(const struct InferenceContext&, Buffer&)> rule) {
+	void RenderGraph::inference_rule(Name target, BufferRule rule) {
 		impl->buf_inference_rules.emplace_back(BufferInference{ QualifiedName{ Name{}, target }, std::move(rule) });
 	}
 
@@ -1094,9 +1643,16 @@ namespace vuk {
 			resolved_resources.emplace_back(res);
 		}
 		ResourceLinkMap res_to_links;
+		res_to_links.reserve(pass_infos.size() * 10);
 		std::vector<ChainAccess> pass_reads;
 		std::vector<ChainLink*> chains;
-		build_links(pass_infos, res_to_links, resolved_resources, pass_reads);
+		std::vector<std::pair<ChainLink*, ChainAccess>> reads;
+		build_links(
+		    pass_infos,
+		    [&](const Resource& res, bool out) -> ChainLink& { return res_to_links[out ? res.out_name : res.name]; },
+		    resolved_resources,
+		    pass_reads,
+		    reads);
 
 		for (auto& bound : bound_attachments) {
 			res_to_links[bound.first].def = { .pass = static_cast<int32_t>(-1 * (&bound - &*bound_attachments.begin() + 1)) };
@@ -1206,28 +1762,31 @@ namespace vuk {
 	}
 
 	IARule same_extent_as(Name n) {
-		return [=](const InferenceContext& ctx, ImageAttachment& ia) {
+		auto rule = [=](const InferenceContext& ctx, ImageAttachment& ia) {
 			ia.extent = ctx.get_image_attachment(n).extent;
 		};
+		return { rule, { n } };
 	}
 
 	IARule same_2D_extent_as(Name n) {
-		return [=](const InferenceContext& ctx, ImageAttachment& ia) {
+		auto rule = [=](const InferenceContext& ctx, ImageAttachment& ia) {
 			auto& o = ctx.get_image_attachment(n);
 			ia.extent.sizing = o.extent.sizing;
 			ia.extent.extent.width = o.extent.extent.width;
 			ia.extent.extent.height = o.extent.extent.height;
 		};
+		return { rule, { n } };
 	}
 
 	IARule same_format_as(Name n) {
-		return [=](const InferenceContext& ctx, ImageAttachment& ia) {
+		auto rule = [=](const InferenceContext& ctx, ImageAttachment& ia) {
 			ia.format = ctx.get_image_attachment(n).format;
 		};
+		return { rule, { n } };
 	}
 
 	IARule same_shape_as(Name n) {
-		return [=](const InferenceContext& ctx, ImageAttachment& ia) {
+		auto rule = [=](const InferenceContext& ctx, ImageAttachment& ia) {
 			auto& src = ctx.get_image_attachment(n);
 			if (src.base_layer != VK_REMAINING_ARRAY_LAYERS)
 				ia.base_layer = src.base_layer;
@@ -1242,10 +1801,11 @@ namespace vuk {
 			if (src.view_type != ImageViewType::eInfer)
 				ia.view_type = src.view_type;
 		};
+		return { rule, { n } };
 	}
 
 	IARule similar_to(Name n) {
-		return [=](const InferenceContext& ctx, ImageAttachment& ia) {
+		auto rule = [=](const InferenceContext& ctx, ImageAttachment& ia) {
 			auto& src = ctx.get_image_attachment(n);
 			if (src.base_layer != VK_REMAINING_ARRAY_LAYERS)
 				ia.base_layer = src.base_layer;
@@ -1262,13 +1822,15 @@ namespace vuk {
 			if (src.sample_count != Samples::eInfer)
 				ia.sample_count = src.sample_count;
 		};
+		return { rule, { n } };
 	}
 
 	BufferRule same_size_as(Name inference_source) {
-		return [=](const InferenceContext& ctx, Buffer& buf) {
+		auto rule = [=](const InferenceContext& ctx, Buffer& buf) {
 			auto& src = ctx.get_buffer(inference_source);
 			buf.size = src.size;
 		};
+		return { rule, { inference_source } };
 	}
 
 	bool crosses_queue(QueueResourceUse last_use, QueueResourceUse current_use) {
@@ -1359,6 +1921,13 @@ namespace vuk {
 			}
 		}
 
+		// pre-barriers against a single earlier pass on the same queue might be split into events later
+		auto add_split_candidate = [&](int32_t src_pass, int32_t dst_pass, bool is_image) {
+			auto& dst = get_pass(dst_pass);
+			auto count = is_image ? dst.pre_image_barriers.size() : dst.pre_memory_barriers.size();
+			split_candidates.push_back({ src_pass, dst_pass, is_image, count - 1 });
+		};
+
 		// handle head (queue wait, initial use) -> emit barriers -> handle tail (signal, final use)
 		std::vector<ChainLink*> seen_chains;
 		while (work_queue.size() > 0) {
@@ -1510,21 +2079,29 @@ namespace vuk {
 							last_use_source = link->source->undef->pass;
 						}
 
-						// TODO: do not emit this if dep is a read and the layouts match
+						// reads identical to the read before them on the same queue were made visible by the barrier of that read
+						bool same_read = is_read_access(last_use) && last_use.stages == use.stages && last_use.access == use.access &&
+						                 (!is_image || last_use.layout == use.layout) && last_use.domain == use.domain;
 						auto& dst = get_pass(first_pass_idx);
-						if (is_image) {
-							if (crosses_queue(last_use, use)) {
-								emit_image_barrier(get_pass((int32_t)computed_pass_idx_to_ordered_idx[last_use_source]).post_image_barriers,
-								                   head->def->pass,
-								                   last_use,
-								                   use,
-								                   image_subrange,
-								                   aspect,
-								                   true);
+						if (!same_read) {
+							if (is_image) {
+								if (crosses_queue(last_use, use)) {
+									emit_image_barrier(get_pass((int32_t)computed_pass_idx_to_ordered_idx[last_use_source]).post_image_barriers,
+									                   head->def->pass,
+									                   last_use,
+									                   use,
+									                   image_subrange,
+									                   aspect,
+									                   true);
+								}
+								emit_image_barrier(dst.pre_image_barriers, head->def->pass, last_use, use, image_subrange, aspect);
+							} else {
+								emit_memory_barrier(dst.pre_memory_barriers, last_use, use);
 							}
-							emit_image_barrier(dst.pre_image_barriers, head->def->pass, last_use, use, image_subrange, aspect);
-						} else {
-							emit_memory_barrier(dst.pre_memory_barriers, last_use, use);
+						}
+						// the first reads synchronize against def alone
+						if (!same_read && start_of_reads == 0 && link->def->pass >= 0 && !crosses_queue(last_use, use)) {
+							add_split_candidate((int32_t)computed_pass_idx_to_ordered_idx[link->def->pass], first_pass_idx, is_image);
 						}
 						if (crosses_queue(last_use, use)) {
 							// in this case def was on a different queue the subsequent reads
@@ -1596,6 +2173,10 @@ namespace vuk {
 						} else {
 							emit_memory_barrier(get_pass(*link->undef).pre_memory_barriers, last_use, use);
 						}
+						// def and the reads before undef all execute before the last of them
+						if (last_executing_pass_idx != -1 && !crosses_queue(last_use, use)) {
+							add_split_candidate(last_executing_pass_idx, (int32_t)computed_pass_idx_to_ordered_idx[link->undef->pass], is_image);
+						}
 
 						if (crosses_queue(last_use, use)) {
 							// we wait on either def or the last read if there was one
@@ -1606,6 +2187,7 @@ namespace vuk {
 							} else {
 								auto& acquire = is_image ? get_bound_attachment(link->def->pass).acquire : get_bound_buffer(link->def->pass).acquire;
 								get_pass(*link->undef).absolute_waits.append(absolute_waits, { acquire.initial_domain, acquire.initial_visibility });
+								absolute_wait_sources.emplace_back(link->def->pass, is_image);
 							}
 						}
 						last_use = use;
@@ -1669,6 +2251,7 @@ namespace vuk {
 						get_bound_buffer(head->def->pass).attached_future = fut;
 					}
 					pass.future_signals.append(future_signals, fut);
+					future_signal_sources.push_back({ link->undef->pass, head->def->pass, is_image, last_use });
 				}
 
 				QueueResourceUse use = release.dst_use;
@@ -1747,17 +2330,19 @@ namespace vuk {
 			size_t k = 0;
 			for (size_t j = 0; j < p0res.size(); j++) {
 				auto& res0 = p0res[j];
-				auto& link0 = res_to_links.at(res0.name);
 				if (!is_framebuffer_attachment(res0)) {
 					continue;
 				}
+				auto& link0 = get_link(res0);
 				// advance attachments in p1 until we get a match or run out
 				for (; k < p1res.size(); k++) {
 					auto& res1 = p1res[k];
-					auto& link1 = res_to_links.at(res1.name);
+					if (res1.name.is_invalid()) {
+						continue;
+					}
 					// TODO: we only handle some cases here (too conservative)
 					bool same_access = res0.ia == res1.ia;
-					if (same_access && link0.next == &link1) {
+					if (same_access && link0.next == &get_link(res1)) {
 						break;
 					}
 				}
@@ -1881,6 +2466,279 @@ namespace vuk {
 		return { expected_value };
 	}
 
+	namespace {
+		struct BarrierCounts {
+			size_t image_barriers = 0;
+			size_t memory_barriers = 0;
+			size_t pipeline_barrier_calls = 0;
+		};
+	} // namespace
+
+	static BarrierCounts count_barriers(std::span<PassInfo*> passes) {
+		BarrierCounts counts;
+		for (auto& pass : passes) {
+			counts.image_barriers += pass->pre_image_barriers.size() + pass->post_image_barriers.size();
+			counts.memory_barriers += pass->pre_memory_barriers.size() + pass->post_memory_barriers.size();
+			if (pass->pre_image_barriers.size() > 0 || pass->pre_memory_barriers.size() > 0) {
+				counts.pipeline_barrier_calls++;
+			}
+			if (pass->post_image_barriers.size() > 0 || pass->post_memory_barriers.size() > 0) {
+				counts.pipeline_barrier_calls++;
+			}
+		}
+		return counts;
+	}
+
+	Result<void> RGCImpl::split_barriers_with_events() {
+		// position of each ordered pass in the submission order of its queue
+		std::vector<size_t> queue_position(ordered_passes.size());
+		for (size_t i = 0; i < ordered_passes.size(); i++) {
+			queue_position[i] = computed_pass_idx_to_partitioned_idx[ordered_idx_to_computed_pass_idx[i]];
+		}
+		std::erase_if(split_candidates, [&](const SplitCandidate& c) {
+			auto& src = get_pass(c.src_pass);
+			auto& dst = get_pass(c.dst_pass);
+			// dropped by merge_rps
+			if (c.index >= (c.is_image ? dst.pre_image_barriers.size() : dst.pre_memory_barriers.size())) {
+				return true;
+			}
+			// barriers in render passes might be recorded into secondary command buffers, where events can't be waited on
+			if (src.render_pass_index >= 0 || dst.render_pass_index >= 0) {
+				return true;
+			}
+			if ((src.domain & DomainFlagBits::eQueueMask) != (dst.domain & DomainFlagBits::eQueueMask) || src.batch_index != dst.batch_index) {
+				return true;
+			}
+			// without work in between, the GPU would stall on the wait just the same
+			return queue_position[c.dst_pass] <= queue_position[c.src_pass] + 1;
+		});
+		if (split_candidates.empty()) {
+			return { expected_value };
+		}
+
+		// one split barrier per pair of passes
+		std::sort(split_candidates.begin(), split_candidates.end(), [](const SplitCandidate& a, const SplitCandidate& b) {
+			return std::tie(a.dst_pass, a.src_pass, a.is_image, a.index) < std::tie(b.dst_pass, b.src_pass, b.is_image, b.index);
+		});
+		std::vector<bool> image_split;
+		std::vector<bool> memory_split;
+		for (auto it = split_candidates.begin(); it != split_candidates.end();) {
+			auto dst_pass = it->dst_pass;
+			auto& dst = get_pass(dst_pass);
+			image_split.assign(dst.pre_image_barriers.size(), false);
+			memory_split.assign(dst.pre_memory_barriers.size(), false);
+			while (it != split_candidates.end() && it->dst_pass == dst_pass) {
+				SplitBarrier split{ .src_pass = it->src_pass };
+				for (; it != split_candidates.end() && it->dst_pass == dst_pass && it->src_pass == split.src_pass; ++it) {
+					if (it->is_image) {
+						auto barrier = dst.pre_image_barriers.to_span(image_barriers)[it->index];
+						split.image_barriers.append(image_barriers, barrier);
+						image_split[it->index] = true;
+					} else {
+						auto barrier = dst.pre_memory_barriers.to_span(mem_barriers)[it->index];
+						split.memory_barriers.append(mem_barriers, barrier);
+						memory_split[it->index] = true;
+					}
+				}
+				auto index = (int32_t)split_barriers.size();
+				get_pass(split.src_pass).event_sets.append(split_barrier_refs, index);
+				dst.event_waits.append(split_barrier_refs, index);
+				split_barriers.push_back(split);
+			}
+
+			// keep the barriers that were not split
+			RelSpan<VkImageMemoryBarrier2KHR> kept_image_barriers;
+			for (size_t i = 0; i < image_split.size(); i++) {
+				if (!image_split[i]) {
+					auto barrier = dst.pre_image_barriers.to_span(image_barriers)[i];
+					kept_image_barriers.append(image_barriers, barrier);
+				}
+			}
+			dst.pre_image_barriers = kept_image_barriers;
+			RelSpan<VkMemoryBarrier2KHR> kept_memory_barriers;
+			for (size_t i = 0; i < memory_split.size(); i++) {
+				if (!memory_split[i]) {
+					auto barrier = dst.pre_memory_barriers.to_span(mem_barriers)[i];
+					kept_memory_barriers.append(mem_barriers, barrier);
+				}
+			}
+			dst.pre_memory_barriers = kept_memory_barriers;
+		}
+
+		return { expected_value };
+	}
+
+	// a barrier that waits on nothing, or that nothing waits on, only matters for its layout or ownership transfer
+	static bool waits_on_nothing(VkPipelineStageFlags2KHR src_stages) {
+		return src_stages == VK_PIPELINE_STAGE_2_NONE_KHR || src_stages == VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT_KHR;
+	}
+
+	static bool nothing_waits(VkPipelineStageFlags2KHR dst_stages) {
+		return dst_stages == VK_PIPELINE_STAGE_2_NONE_KHR || dst_stages == VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT_KHR;
+	}
+
+	// merge b into a, if they make the same transition and their ranges touch along levels (or layers) while covering the same layers (or levels)
+	static bool merge_image_barriers(VkImageMemoryBarrier2KHR& a, const VkImageMemoryBarrier2KHR& b, bool along_levels) {
+		if (a.pNext != b.pNext || a.oldLayout != b.oldLayout || a.newLayout != b.newLayout || a.srcQueueFamilyIndex != b.srcQueueFamilyIndex ||
+		    a.dstQueueFamilyIndex != b.dstQueueFamilyIndex || a.subresourceRange.aspectMask != b.subresourceRange.aspectMask) {
+			return false;
+		}
+		auto& ra = a.subresourceRange;
+		auto& rb = b.subresourceRange;
+		uint32_t* a_base;
+		uint32_t* a_count;
+		uint32_t b_base, b_count;
+		if (along_levels) {
+			if (ra.baseArrayLayer != rb.baseArrayLayer || ra.layerCount != rb.layerCount || ra.levelCount == VK_REMAINING_MIP_LEVELS ||
+			    rb.levelCount == VK_REMAINING_MIP_LEVELS) {
+				return false;
+			}
+			a_base = &ra.baseMipLevel;
+			a_count = &ra.levelCount;
+			b_base = rb.baseMipLevel;
+			b_count = rb.levelCount;
+		} else {
+			if (ra.baseMipLevel != rb.baseMipLevel || ra.levelCount != rb.levelCount || ra.layerCount == VK_REMAINING_ARRAY_LAYERS ||
+			    rb.layerCount == VK_REMAINING_ARRAY_LAYERS) {
+				return false;
+			}
+			a_base = &ra.baseArrayLayer;
+			a_count = &ra.layerCount;
+			b_base = rb.baseArrayLayer;
+			b_count = rb.layerCount;
+		}
+		// barriers are sorted on the base, so b starts within or right after a
+		if (b_base > *a_base + *a_count) {
+			return false;
+		}
+		*a_count = std::max(*a_base + *a_count, b_base + b_count) - *a_base;
+		a.srcStageMask |= b.srcStageMask;
+		a.srcAccessMask |= b.srcAccessMask;
+		a.dstStageMask |= b.dstStageMask;
+		a.dstAccessMask |= b.dstAccessMask;
+		return true;
+	}
+
+	void RGCImpl::coalesce_dependency(RelSpan<VkMemoryBarrier2KHR>& mem_bars, RelSpan<VkImageMemoryBarrier2KHR>& im_bars) {
+		// memory barriers are global, so a single one covering the union of their scopes replaces all of them
+		auto mem_span = mem_bars.to_span(mem_barriers);
+		size_t mem_count = 0;
+		for (auto& bar : mem_span) {
+			if (waits_on_nothing(bar.srcStageMask) || nothing_waits(bar.dstStageMask)) {
+				continue;
+			}
+			if (mem_count == 0) {
+				mem_span[mem_count++] = bar;
+			} else {
+				mem_span[0].srcStageMask |= bar.srcStageMask;
+				mem_span[0].srcAccessMask |= bar.srcAccessMask;
+				mem_span[0].dstStageMask |= bar.dstStageMask;
+				mem_span[0].dstAccessMask |= bar.dstAccessMask;
+			}
+		}
+		mem_bars.offset1 = mem_bars.offset0 + mem_count;
+
+		auto im_span = im_bars.to_span(image_barriers);
+		size_t im_count = 0;
+		for (auto& bar : im_span) {
+			bool transitions = bar.oldLayout != bar.newLayout || bar.srcQueueFamilyIndex != bar.dstQueueFamilyIndex;
+			if (!transitions && (waits_on_nothing(bar.srcStageMask) || nothing_waits(bar.dstStageMask))) {
+				continue;
+			}
+			// subranges of diverged attachments are relative to the attachment they diverged from, so barriers are made against that one
+			int32_t bound_idx;
+			std::memcpy(&bound_idx, &bar.pNext, sizeof(bound_idx));
+			auto& bound = get_bound_attachment(bound_idx);
+			if (bound.parent_attachment < 0) {
+				std::memcpy(&bar.pNext, &bound.parent_attachment, sizeof(bound_idx));
+			}
+			im_span[im_count++] = bar;
+		}
+		im_span = im_span.first(im_count);
+
+		// widen the ranges of the per-level (or per-layer) barriers of diverged subresources into one barrier each
+		for (bool along_levels : { true, false }) {
+			std::sort(im_span.begin(), im_span.end(), [along_levels](const VkImageMemoryBarrier2KHR& a, const VkImageMemoryBarrier2KHR& b) {
+				auto key = [along_levels](const VkImageMemoryBarrier2KHR& bar) {
+					auto& r = bar.subresourceRange;
+					return std::tuple((uintptr_t)bar.pNext,
+					                  r.aspectMask,
+					                  bar.oldLayout,
+					                  bar.newLayout,
+					                  bar.srcQueueFamilyIndex,
+					                  bar.dstQueueFamilyIndex,
+					                  along_levels ? r.baseArrayLayer : r.baseMipLevel,
+					                  along_levels ? r.layerCount : r.levelCount,
+					                  along_levels ? r.baseMipLevel : r.baseArrayLayer);
+				};
+				return key(a) < key(b);
+			});
+			size_t dst_index = 0;
+			for (size_t src_index = 1; src_index < im_span.size(); src_index++) {
+				if (!merge_image_barriers(im_span[dst_index], im_span[src_index], along_levels)) {
+					im_span[++dst_index] = im_span[src_index];
+				}
+			}
+			im_span = im_span.first(im_span.empty() ? 0 : dst_index + 1);
+		}
+		im_bars.offset1 = im_bars.offset0 + im_span.size();
+	}
+
+	Result<void> RGCImpl::coalesce_barriers() {
+		auto before = count_barriers(partitioned_passes);
+		statistics.image_barriers_before_coalescing = before.image_barriers;
+		statistics.memory_barriers_before_coalescing = before.memory_barriers;
+		statistics.pipeline_barrier_calls_before_coalescing = before.pipeline_barrier_calls;
+
+		// the post-barriers of a pass are recorded right before the pre-barriers of the next pass in the same submission, so they can share a dependency
+		// the post-barriers of the first pass of a submission are recorded only if it is the last one too, those are left in place
+		for (auto& domain_passes : { graphics_passes, compute_passes, transfer_passes }) {
+			for (size_t i = 2; i < domain_passes.size(); i++) {
+				auto& first = *domain_passes[i - 2];
+				auto& prev = *domain_passes[i - 1];
+				auto& pass = *domain_passes[i];
+				if (first.batch_index != prev.batch_index || prev.batch_index != pass.batch_index) {
+					continue;
+				}
+				if (prev.post_image_barriers.size() == 0 && prev.post_memory_barriers.size() == 0) {
+					continue;
+				}
+				RelSpan<VkImageMemoryBarrier2KHR> merged_image_barriers;
+				for (size_t k = 0; k < prev.post_image_barriers.size(); k++) {
+					auto barrier = prev.post_image_barriers.to_span(image_barriers)[k];
+					merged_image_barriers.append(image_barriers, barrier);
+				}
+				for (size_t k = 0; k < pass.pre_image_barriers.size(); k++) {
+					auto barrier = pass.pre_image_barriers.to_span(image_barriers)[k];
+					merged_image_barriers.append(image_barriers, barrier);
+				}
+				RelSpan<VkMemoryBarrier2KHR> merged_memory_barriers;
+				for (size_t k = 0; k < prev.post_memory_barriers.size(); k++) {
+					auto barrier = prev.post_memory_barriers.to_span(mem_barriers)[k];
+					merged_memory_barriers.append(mem_barriers, barrier);
+				}
+				for (size_t k = 0; k < pass.pre_memory_barriers.size(); k++) {
+					auto barrier = pass.pre_memory_barriers.to_span(mem_barriers)[k];
+					merged_memory_barriers.append(mem_barriers, barrier);
+				}
+				prev.post_image_barriers = {};
+				prev.post_memory_barriers = {};
+				pass.pre_image_barriers = merged_image_barriers;
+				pass.pre_memory_barriers = merged_memory_barriers;
+			}
+		}
+
+		for (auto& pass : partitioned_passes) {
+			coalesce_dependency(pass->pre_memory_barriers, pass->pre_image_barriers);
+			coalesce_dependency(pass->post_memory_barriers, pass->post_image_barriers);
+		}
+		for (auto& split : split_barriers) {
+			coalesce_dependency(split.memory_barriers, split.image_barriers);
+		}
+
+		return { expected_value };
+	}
+
 	Result<void> RGCImpl::build_renderpasses() {
 		// compile attachments
 		// we have to assign the proper attachments to proper slots
@@ -2000,22 +2858,304 @@ namespace vuk {
 	}
 
 	Result<ExecutableRenderGraph> Compiler::link(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
-		VUK_DO_OR_RETURN(compile(rgs, compile_options));
+		if (compile_options.cache_linked_graphs) {
+			if (!impl->link_cache) {
+				impl->link_cache = std::make_unique<LinkedGraphCache>();
+			}
+			auto& cache = *impl->link_cache;
+			if (cache.staging) {
+				cache.staging->reset();
+			} else {
+				cache.staging.reset(new RGCImpl);
+			}
+			// inlining and linking chains are cheap compared to the rest of compile & link, so we do those to find out if the graph changed shape
+			auto& staging = *cache.staging;
+			auto& times = staging.statistics.phase_times;
+			{
+				PhaseTimer _{ times.inline_rgs };
+				VUK_DO_OR_RETURN(staging.inline_rgs(rgs, compile_options));
+			}
+			{
+				PhaseTimer _{ times.compute_assigned_names };
+				staging.compute_assigned_names();
+				staging.merge_diverge_passes(staging.computed_passes);
+				staging.assign_resource_ids();
+			}
+			{
+				// culling changes the passes and resources, so the staging graph is culled the same way as the compiled one
+				PhaseTimer _{ times.build_links };
+				VUK_DO_OR_RETURN(staging.build_chains(compile_options));
+			}
+			staging.compute_structural_key(cache.incoming_key, cache.unordered_entries, compile_options);
 
-		VUK_DO_OR_RETURN(impl->generate_barriers_and_waits());
+			if (cache.valid && cache.structural_key == cache.incoming_key) {
+				impl->callbacks = compile_options.callbacks;
+				impl->alias_transient_images = compile_options.alias_transient_images;
+				impl->rebind_link(staging);
+				// counts are those of the cached link
+				impl->statistics.phase_times = times;
+				impl->statistics.cache_hit = true;
+				impl->statistics.inference_iterations = 0;
+				return { expected_value, *this };
+			}
+		}
 
-		VUK_DO_OR_RETURN(impl->merge_rps());
+		VUK_DO_OR_RETURN(compile(rgs, compile_options));
 
-		VUK_DO_OR_RETURN(impl->assign_passes_to_batches());
+		auto& times = impl->statistics.phase_times;
+		{
+			PhaseTimer _{ times.generate_barriers_and_waits };
+			VUK_DO_OR_RETURN(impl->generate_barriers_and_waits());
+		}
+		{
+			PhaseTimer _{ times.merge_rps };
+			VUK_DO_OR_RETURN(impl->merge_rps());
+		}
+		{
+			PhaseTimer _{ times.assign_passes_to_batches };
+			VUK_DO_OR_RETURN(impl->assign_passes_to_batches());
+			VUK_DO_OR_RETURN(impl->build_waits());
+		}
+		{
+			PhaseTimer _{ times.split_barriers };
+			VUK_DO_OR_RETURN(impl->split_barriers_with_events());
+		}
+		{
+			PhaseTimer _{ times.coalesce_barriers };
+			VUK_DO_OR_RETURN(impl->coalesce_barriers());
+		}
+		{
+			PhaseTimer _{ times.build_renderpasses };
+			// we now have enough data to build VkRenderPasses and VkFramebuffers
+			VUK_DO_OR_RETURN(impl->build_renderpasses());
+		}
 
-		VUK_DO_OR_RETURN(impl->build_waits());
+		impl->collect_link_statistics();
 
-		// we now have enough data to build VkRenderPasses and VkFramebuffers
-		VUK_DO_OR_RETURN(impl->build_renderpasses());
+		if (compile_options.cache_linked_graphs) {
+			impl->snapshot_link();
+		}
 
 		return { expected_value, *this };
 	}
 
+	void RGCImpl::collect_link_statistics() {
+		statistics.cache_hit = false;
+		statistics.passes = partitioned_passes.size();
+		auto barriers = count_barriers(partitioned_passes);
+		statistics.image_barriers = barriers.image_barriers;
+		statistics.memory_barriers = barriers.memory_barriers;
+		statistics.pipeline_barrier_calls = barriers.pipeline_barrier_calls;
+		for (auto& pass : partitioned_passes) {
+			statistics.event_sets += pass->event_sets.size();
+		}
+		for (auto& rpi : rpis) {
+			if (rpi.attachments.size() > 0) {
+				statistics.render_passes++;
+			}
+		}
+		for (auto& domain_passes : { graphics_passes, compute_passes, transfer_passes }) {
+			if (domain_passes.size() > 0) {
+				statistics.submit_batches += domain_passes.back()->batch_index + 1;
+			}
+		}
+	}
+
+	namespace {
+		struct KeyWriter {
+			std::vector<uint64_t>& key;
+
+			template<class T>
+			void operator()(const T& v) {
+				if constexpr (std::is_enum_v<T>) {
+					key.push_back((uint64_t)v);
+				} else if constexpr (std::is_same_v<T, float>) {
+					key.push_back(std::bit_cast<uint32_t>(v));
+				} else {
+					static_assert(std::is_integral_v<T>);
+					key.push_back((uint64_t)v);
+				}
+			}
+			void operator()(Name n) {
+				key.push_back((uint64_t)(uintptr_t)n.c_str());
+			}
+			void operator()(const QualifiedName& n) {
+				(*this)(n.prefix);
+				(*this)(n.name);
+			}
+			template<class T>
+			void operator()(Flags<T> f) {
+				key.push_back((uint64_t)f.m_mask);
+			}
+			void operator()(const QueueResourceUse& use) {
+				(*this)(use.stages, use.access, use.layout, use.domain);
+			}
+			void operator()(const Subrange::Image& sr) {
+				(*this)(sr.base_layer, sr.base_level, sr.layer_count, sr.level_count);
+			}
+			// every field of the attachment that isn't rebound for each frame
+			void operator()(const ImageAttachment& ia) {
+				(*this)(ia.image_flags, ia.image_type, ia.tiling, ia.usage, ia.format, ia.sample_count.count, ia.allow_srgb_unorm_mutable);
+				(*this)(ia.extent.sizing, ia.extent.extent.width, ia.extent.extent.height, ia.extent.extent.depth);
+				(*this)(ia.extent._relative.width, ia.extent._relative.height, ia.extent._relative.depth);
+				(*this)(ia.image_view_flags, ia.view_type, ia.components.r, ia.components.g, ia.components.b, ia.components.a);
+				(*this)(ia.base_level, ia.level_count, ia.base_layer, ia.layer_count, (bool)ia.image);
+			}
+
+			template<class T, class... Rest>
+			void operator()(const T& v, const Rest&... rest) requires(sizeof...(Rest) > 0) {
+				(*this)(v);
+				(*this)(rest...);
+			}
+		};
+	} // namespace
+
+	void RGCImpl::compute_structural_key(std::vector<uint64_t>& key,
+	                                     std::vector<std::array<uint64_t, 8>>& unordered_entries,
+	                                     const RenderGraphCompileOptions& compile_options) {
+		key.clear();
+		KeyWriter w{ key };
+		w(compile_options.pass_ordering, compile_options.cull_dead_passes, compile_options.alias_transient_images);
+
+		w(computed_passes.size());
+		for (auto& p : computed_passes) {
+			w(p.qualified_name, p.pass->type, p.pass->execute_on, p.resources.size());
+			for (auto& r : p.resources.to_span(resources)) {
+				w(r.name, r.original_name, r.out_name, r.type, r.ia, r.foreign != nullptr);
+			}
+		}
+
+		w(bound_attachments.size());
+		for (auto& att : bound_attachments) {
+			w(att.name, att.type, att.attachment, att.image_subrange, att.parent_attachment);
+			w(att.acquire.src_use, att.acquire.initial_domain, att.acquire.unsynchronized);
+		}
+
+		w(bound_buffers.size());
+		for (auto& buf : bound_buffers) {
+			w(buf.name, (bool)buf.buffer, buf.acquire.src_use, buf.acquire.initial_domain, buf.acquire.unsynchronized);
+		}
+
+		w(releases.size());
+		for (auto& [name, release] : releases) {
+			w(name, release.original, release.dst_use, release.signal != nullptr);
+		}
+
+		w(final_releases.size());
+		for (auto& release : final_releases) {
+			w(release.dst_use);
+		}
+
+		// maps are written in sorted order, so that the key doesn't depend on their iteration order
+		auto write_unordered = [&](auto& map, auto&& to_entry) {
+			unordered_entries.clear();
+			for (auto& [k, v] : map) {
+				unordered_entries.push_back(to_entry(k, v));
+			}
+			std::sort(unordered_entries.begin(), unordered_entries.end());
+			w(unordered_entries.size());
+			key.insert(key.end(), (const uint64_t*)unordered_entries.data(), (const uint64_t*)(unordered_entries.data() + unordered_entries.size()));
+		};
+		auto name_bits = [](Name n) {
+			return (uint64_t)(uintptr_t)n.c_str();
+		};
+		write_unordered(computed_aliases, [&](const QualifiedName& k, const QualifiedName& v) {
+			return std::array<uint64_t, 8>{ name_bits(k.prefix), name_bits(k.name), name_bits(v.prefix), name_bits(v.name) };
+		});
+		write_unordered(diverged_subchain_headers, [&](const QualifiedName& k, const std::pair<QualifiedName, Subrange::Image>& v) {
+			return std::array<uint64_t, 8>{ name_bits(k.prefix),      name_bits(k.name),       name_bits(v.first.prefix),  name_bits(v.first.name),
+				                              v.second.base_layer, v.second.base_level, v.second.layer_count, v.second.level_count };
+		});
+	}
+
+	void RGCImpl::snapshot_link() {
+		auto& cache = *link_cache;
+		cache.structural_key.assign(cache.incoming_key.begin(), cache.incoming_key.end());
+		cache.image_barriers = image_barriers;
+		cache.bound_attachments = bound_attachments;
+		cache.bound_buffers = bound_buffers;
+		cache.fbcis.clear();
+		for (auto& rp : rpis) {
+			cache.fbcis.push_back(rp.fbci);
+		}
+		cache.valid = true;
+	}
+
+	void RGCImpl::rebind_link(RGCImpl& src) {
+		auto& cache = *link_cache;
+		assert(computed_passes.size() == src.computed_passes.size());
+
+		// pass callbacks and owning graphs change every frame
+		for (size_t i = 0; i < computed_passes.size(); i++) {
+			computed_passes[i].pass = src.computed_passes[i].pass;
+		}
+		for (size_t i = 0; i < src.resources.size(); i++) {
+			resources[i].foreign = src.resources[i].foreign;
+		}
+
+		// restore the state that the previous execute consumed
+		std::copy(cache.image_barriers.begin(), cache.image_barriers.end(), image_barriers.begin());
+		std::copy(cache.bound_attachments.begin(), cache.bound_attachments.end(), bound_attachments.begin());
+		std::copy(cache.bound_buffers.begin(), cache.bound_buffers.end(), bound_buffers.begin());
+		attachment_rp_references.clear();
+		for (size_t i = 0; i < rpis.size(); i++) {
+			auto& rp = rpis[i];
+			rp.rpci.attachments.clear();
+			rp.fbci = cache.fbcis[i];
+			rp.handle = VK_NULL_HANDLE;
+			rp.framebuffer = VK_NULL_HANDLE;
+		}
+
+		// rebind per-frame resources
+		// attachments past the incoming ones were made from their parent during compilation, and are in parent order
+		for (size_t i = 0; i < bound_attachments.size(); i++) {
+			auto& dst = bound_attachments[i];
+			auto& s = i < src.bound_attachments.size() ? src.bound_attachments[i] : get_bound_attachment(dst.parent_attachment);
+			dst.attachment = s.attachment;
+			dst.swapchain = s.swapchain;
+			dst.allocator = s.allocator;
+			dst.acquire.initial_visibility = s.acquire.initial_visibility;
+		}
+		for (size_t i = 0; i < src.bound_buffers.size(); i++) {
+			auto& dst = bound_buffers[i];
+			auto& s = src.bound_buffers[i];
+			dst.buffer = s.buffer;
+			dst.allocator = s.allocator;
+			dst.acquire.initial_visibility = s.acquire.initial_visibility;
+		}
+		for (size_t i = 0; i < src.releases.size(); i++) {
+			releases[i].second.signal = src.releases[i].second.signal;
+		}
+		final_releases = src.final_releases;
+		ia_inference_rules = std::move(src.ia_inference_rules);
+		buf_inference_rules = std::move(src.buf_inference_rules);
+
+		// re-derive the values generate_barriers_and_waits baked in
+		for (size_t i = 0; i < absolute_waits.size(); i++) {
+			auto [bound, is_image] = absolute_wait_sources[i];
+			absolute_waits[i].second = is_image ? get_bound_attachment(bound).acquire.initial_visibility : get_bound_buffer(bound).acquire.initial_visibility;
+		}
+		for (size_t i = 0; i < future_signals.size(); i++) {
+			auto& source = future_signal_sources[i];
+			auto* fut = get_release(source.release).signal;
+			fut->last_use = source.last_use;
+			if (source.is_image) {
+				get_bound_attachment(source.bound).attached_future = fut;
+			} else {
+				get_bound_buffer(source.bound).attached_future = fut;
+			}
+			future_signals[i] = fut;
+		}
+	}
+
+	const CompileStatistics& Compiler::get_statistics() const {
+		return impl->statistics;
+	}
+
+	std::span<const QualifiedName> Compiler::get_culled_passes() const {
+		return impl->culled_passes;
+	}
+
 	std::span<ChainLink*> Compiler::get_use_chains() const {
 		return std::span(impl->chains);
 	}
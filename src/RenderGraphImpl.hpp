@@ -6,8 +6,11 @@
 #include "vuk/RenderGraphReflection.hpp"
 #include "vuk/ShortAlloc.hpp"
 #include "vuk/SourceLocation.hpp"
+#include "vuk/resources/DeviceLinearResource.hpp"
 
+#include <array>
 #include <deque>
+#include <mutex>
 #include <robin_hood.h>
 
 namespace vuk {
@@ -19,9 +22,6 @@ namespace vuk {
 		VkFramebuffer framebuffer;
 	};
 
-	using IARule = std::function<void(const struct InferenceContext&, ImageAttachment&)>;
-	using BufferRule = std::function<void(const struct InferenceContext&, Buffer&)>;
-
 	struct IAInference {
 		QualifiedName resource;
 		IARule rule;
@@ -55,6 +55,7 @@ namespace vuk {
 		RelSpan<Resource> resources;
 
 		std::function<void(CommandBuffer&)> execute;
+		std::optional<uint64_t> cache_key;
 		std::byte* arguments; // internal use
 		PassType type;
 		source_location source;
@@ -81,6 +82,8 @@ namespace vuk {
 		RelSpan<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		RelSpan<FutureBase*> future_signals;
 		RelSpan<int32_t> referenced_swapchains; // TODO: maybe not the best place for it
+		// split barriers whose event is set after this pass, and waited on before it
+		RelSpan<int32_t> event_sets, event_waits;
 
 		int32_t is_waited_on = 0;
 	};
@@ -148,18 +151,44 @@ namespace vuk {
 
 	using ResourceLinkMap = robin_hood::unordered_node_map<QualifiedName, ChainLink>;
 
+	// state of the last link, captured before execution so that a structurally identical graph can be rebound onto it
+	struct LinkedGraphCache {
+		bool valid = false;
+		// everything about the graphs and options that the link depends on, a cached link is only reused if this matches exactly
+		std::vector<uint64_t> structural_key;
+		std::vector<uint64_t> incoming_key;
+		std::vector<std::array<uint64_t, 8>> unordered_entries;
+		std::unique_ptr<struct RGCImpl> staging; // incoming graphs are inlined here for computing the key
+
+		std::vector<VkImageMemoryBarrier2KHR> image_barriers; // execute compacts these in place
+		std::vector<AttachmentInfo> bound_attachments;
+		std::vector<BufferInfo> bound_buffers;
+		std::vector<FramebufferCreateInfo> fbcis;
+	};
+
 	struct RGCImpl {
-		RGCImpl() : arena_(new arena(4 * 1024 * 1024)), INIT(computed_passes), INIT(ordered_passes), INIT(partitioned_passes), INIT(rpis) {}
-		RGCImpl(arena* a) : arena_(a), INIT(computed_passes), INIT(ordered_passes), INIT(partitioned_passes), INIT(rpis) {}
+		RGCImpl() : arena_(new arena(4 * 1024 * 1024)), INIT(computed_passes), INIT(ordered_passes), INIT(partitioned_passes), INIT(helper_links), INIT(rpis) {}
+		RGCImpl(arena* a) : arena_(a), INIT(computed_passes), INIT(ordered_passes), INIT(partitioned_passes), INIT(helper_links), INIT(rpis) {}
 		std::unique_ptr<arena> arena_;
 
+		// clears all state for the next compile, keeping the storage of the containers
+		void reset();
+
 		// per PassInfo
 		std::vector<Resource> resources;
 
 		std::vector<std::pair<DomainFlagBits, uint64_t>> waits;
 		std::vector<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		std::vector<FutureBase*> future_signals;
-		std::deque<QualifiedName> qfname_references;
+		// where the per-frame values in absolute_waits and future_signals came from, so a cached link can be rebound
+		struct FutureSignalSource {
+			int32_t release;
+			int32_t bound;
+			bool is_image;
+			QueueResourceUse last_use;
+		};
+		std::vector<std::pair<int32_t, bool>> absolute_wait_sources;
+		std::vector<FutureSignalSource> future_signal_sources;
 		// /per PassInfo
 
 		std::vector<PassInfo, short_alloc<PassInfo, 64>> computed_passes;
@@ -172,13 +201,39 @@ namespace vuk {
 		robin_hood::unordered_flat_map<QualifiedName, QualifiedName> computed_aliases; // maps resource names to resource names
 		robin_hood::unordered_flat_map<QualifiedName, QualifiedName> assigned_names;   // maps resource names to attachment names
 		robin_hood::unordered_flat_map<Name, uint64_t> sg_name_counter;
-		robin_hood::unordered_flat_map<const RenderGraph*, std::string> sg_prefixes;
+		robin_hood::unordered_flat_map<const RenderGraph*, Name> sg_prefixes;
 
 		std::vector<VkImageMemoryBarrier2KHR> image_barriers;
 		std::vector<VkMemoryBarrier2KHR> mem_barriers;
 
-		ResourceLinkMap res_to_links;
+		// resource names are numbered densely once they are resolved, so that the compile phases can index arrays instead of hashing names
+		robin_hood::unordered_flat_map<QualifiedName, int32_t> resource_ids;
+		struct ResourceIds {
+			int32_t name = -1;
+			int32_t out_name = -1;
+			int32_t assigned = -1; // the name of the attachment this resource resolves to
+		};
+		std::vector<ResourceIds> ids_per_resource; // parallel to resources
+		void assign_resource_ids();
+
+		ResourceIds& get_ids(const Resource& res) {
+			return ids_per_resource[&res - resources.data()];
+		}
+
+		// per resource id
+		std::vector<ChainLink> links;
 		std::vector<ChainAccess> pass_reads;
+		Result<void> build_links();
+
+		ChainLink& get_link(const Resource& res) {
+			assert(get_ids(res).name >= 0);
+			return links[get_ids(res).name];
+		}
+
+		ChainLink* find_link(const QualifiedName& name) {
+			auto it = resource_ids.find(name);
+			return it == resource_ids.end() ? nullptr : &links[it->second];
+		}
 		Resource& get_resource(ChainAccess& ca) {
 			return resources[computed_passes[ca.pass].resources.offset0 + ca.resource];
 		}
@@ -198,7 +253,7 @@ namespace vuk {
 
 		std::vector<ChainLink*> chains;
 		std::vector<ChainLink*> child_chains;
-		std::deque<ChainLink> helper_links;
+		std::deque<ChainLink, short_alloc<ChainLink, 64>> helper_links;
 		std::vector<int32_t> swapchain_references;
 		std::vector<AttachmentRPInfo> rp_infos;
 		std::array<size_t, 3> last_ordered_pass_idx_in_domain_array;
@@ -235,8 +290,8 @@ namespace vuk {
 			return releases[-1 * (idx)-1].second;
 		}
 
-		std::unordered_map<QualifiedName, IAInferences> ia_inference_rules;
-		std::unordered_map<QualifiedName, BufferInferences> buf_inference_rules;
+		robin_hood::unordered_flat_map<QualifiedName, IAInferences> ia_inference_rules;
+		robin_hood::unordered_flat_map<QualifiedName, BufferInferences> buf_inference_rules;
 
 		robin_hood::unordered_flat_map<QualifiedName, std::pair<QualifiedName, Subrange::Image>> diverged_subchain_headers;
 
@@ -272,17 +327,62 @@ namespace vuk {
 		std::vector<RenderPassInfo, short_alloc<RenderPassInfo, 64>> rpis;
 		std::span<PassInfo*> transfer_passes, compute_passes, graphics_passes;
 
-		void append(Name subgraph_name, const RenderGraph& other);
+		// a graph to be inlined, with its passes and resources resolved
+		struct InlinedGraph {
+			Name joiner;
+			const RenderGraph* rg;
+			std::vector<PassInfo> passes;
+			std::vector<Resource> resources;
+		};
+		size_t inlined_count = 0;
+
+		void resolve_resource(Name joiner, Resource& r, bool add_foreign_aliases);
+		void enqueue_inline(Name subgraph_name, const RenderGraph& other);
+		void resolve_passes(InlinedGraph& inlined);
+		void append(InlinedGraph& inlined);
 
 		void merge_diverge_passes(std::vector<PassInfo, short_alloc<PassInfo, 64>>& passes);
 
+		// scratch space of the compile phases, kept so that their storage is reused between compiles
+		struct Scratch {
+			robin_hood::unordered_flat_set<RenderGraph*> consumed_rgs;
+			std::string prefix;
+			std::vector<InlinedGraph> inlined;
+			robin_hood::unordered_flat_map<QualifiedName, QualifiedName> name_map;
+			std::vector<QualifiedName> walked;
+			std::vector<std::pair<ChainLink*, ChainAccess>> reads;
+			std::vector<char> external_links; // per resource id
+			std::vector<char> live;
+			std::vector<int32_t> work_queue;
+			std::vector<char> dead_uses; // per resource id
+			std::vector<size_t> indegrees;
+			std::vector<std::pair<uint32_t, uint32_t>> edges;
+			std::vector<uint32_t> offsets;
+			std::vector<uint32_t> successors;
+			std::vector<uint32_t> fill;
+			std::vector<int64_t> latest_producer;
+			std::vector<size_t> process_queue;
+			std::vector<int64_t> priority;
+			std::vector<size_t> group;
+			std::vector<uint32_t> shared_count;
+			std::vector<size_t> touched;
+			std::vector<size_t> topo_order;
+			std::vector<size_t> remaining;
+		} scratch;
+
 		void compute_prefixes(const RenderGraph& rg, std::string& prefix);
 		void inline_subgraphs(const RenderGraph& rg, robin_hood::unordered_flat_set<RenderGraph*>& consumed_rgs);
+		Result<void> inline_rgs(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options);
 
 		Result<void> terminate_chains();
 		Result<void> diagnose_unheaded_chains();
+		// builds the use chains from the computed passes, then culls dead passes if enabled
+		Result<void> build_chains(const RenderGraphCompileOptions& compile_options);
 		Result<void> schedule_intra_queue(std::span<struct PassInfo> passes, const RenderGraphCompileOptions& compile_options);
 
+		std::vector<QualifiedName> culled_passes;
+		Result<void> cull_dead_passes();
+
 		std::vector<ChainLink*> div_subchains;
 		std::vector<ChainLink**> conv_subchains;
 		Result<void> relink_subchains();
@@ -297,6 +397,24 @@ namespace vuk {
 		                        bool is_release = false);
 		void emit_memory_barrier(RelSpan<VkMemoryBarrier2KHR>&, QueueResourceUse last_use, QueueResourceUse current_use);
 
+		// a pre-barrier that synchronizes against a single earlier pass on the same queue
+		struct SplitCandidate {
+			int32_t src_pass; // ordered pass indices
+			int32_t dst_pass;
+			bool is_image;
+			size_t index; // into the pre-barriers of dst_pass
+		};
+		std::vector<SplitCandidate> split_candidates;
+		// barriers moved out of the pre-barriers of a pass, into an event set after src_pass and waited on before the pass
+		struct SplitBarrier {
+			int32_t src_pass;
+			RelSpan<VkImageMemoryBarrier2KHR> image_barriers;
+			RelSpan<VkMemoryBarrier2KHR> memory_barriers;
+		};
+		std::vector<SplitBarrier> split_barriers;
+		std::vector<int32_t> split_barrier_refs;
+		std::span<const VkEvent> split_events; // of the current execution, parallel to split_barriers
+
 		// opt passes
 		Result<void> merge_rps();
 
@@ -304,17 +422,90 @@ namespace vuk {
 		Result<void> generate_barriers_and_waits();
 		Result<void> assign_passes_to_batches();
 		Result<void> build_waits();
+		Result<void> split_barriers_with_events();
+		Result<void> coalesce_barriers();
+		void coalesce_dependency(RelSpan<VkMemoryBarrier2KHR>& mem_bars, RelSpan<VkImageMemoryBarrier2KHR>& im_bars);
 		Result<void> build_renderpasses();
 
+		CompileStatistics statistics;
+		void collect_link_statistics();
+
+		// transient aliasing
+		bool alias_transient_images = false;
+		struct TransientLifetime {
+			int32_t first_pass = INT32_MAX; // ordered pass indices
+			int32_t last_pass = -1;
+			DomainFlags domain;
+			QueueResourceUse uses; // union of all uses, which must complete before the memory can be reused
+			bool escapes = false;  // external, released or returned through a future
+		};
+		// indexed by bound attachment
+		std::vector<TransientLifetime> compute_transient_lifetimes();
+
 		void emit_barriers(Context& ctx,
 		                   VkCommandBuffer cbuf,
 		                   vuk::DomainFlagBits domain,
 		                   RelSpan<VkMemoryBarrier2KHR> mem_bars,
 		                   RelSpan<VkImageMemoryBarrier2KHR> im_bars);
+		// sets or waits on the events of split barriers
+		void emit_events(Context& ctx, VkCommandBuffer cbuf, vuk::DomainFlagBits domain, RelSpan<int32_t> split_barrier_indices, bool wait);
+		bool resolve_image_barrier(Context& ctx, VkImageMemoryBarrier2KHR& dep, vuk::DomainFlagBits domain);
 
 		ImageUsageFlags compute_usage(const ChainLink* head);
 
 		ProfilingCallbacks callbacks;
+
+		// linked graph caching
+		std::unique_ptr<LinkedGraphCache> link_cache;
+		void compute_structural_key(std::vector<uint64_t>& key, std::vector<std::array<uint64_t, 8>>& unordered_entries, const RenderGraphCompileOptions& compile_options);
+		void snapshot_link();
+		void rebind_link(RGCImpl& src);
+
+		// recordings of passes with a cache key, kept across executions
+		struct CachedRecordings {
+			struct Recording {
+				size_t key = 0;
+				uint64_t last_use = 0;
+				// what the pass allocated while recording
+				std::unique_ptr<DeviceLinearResource> resource;
+				// allocated from the cache resource directly, as the DeviceLinearResource resets its pools when freed
+				CommandPool command_pool = {};
+				CommandBufferAllocation command_buffer = {};
+
+				Recording() = default;
+				Recording(const Recording&) = delete;
+				~Recording() {
+					release();
+				}
+
+				// deallocates into the cache resource, which defers it until the GPU is done
+				void release() {
+					if (!resource) {
+						return;
+					}
+					auto& upstream = *resource->upstream;
+					if (command_buffer.command_buffer != VK_NULL_HANDLE) {
+						upstream.deallocate_command_buffers(std::span{ &command_buffer, 1 });
+					}
+					if (command_pool.command_pool != VK_NULL_HANDLE) {
+						upstream.deallocate_command_pools(std::span{ &command_pool, 1 });
+					}
+					command_buffer = {};
+					command_pool = {};
+					resource.reset();
+				}
+			};
+			// a few per pass, so that a pass alternating between resources (like the images of a swapchain) keeps hitting
+			std::array<Recording, 4> recordings;
+			uint64_t uses = 0;
+		};
+		DeviceResource* recording_cache_resource = nullptr; // of the current execution
+		std::mutex recording_cache_mutex;
+		robin_hood::unordered_node_map<QualifiedName, CachedRecordings> recording_cache;
+
+		bool is_cached(const PassInfo& pass) const {
+			return recording_cache_resource && pass.pass->cache_key && !pass.qualified_name.is_invalid();
+		}
 	};
 #undef INIT
 
@@ -347,15 +538,6 @@ namespace vuk {
 			return nullptr;
 	}
 
-	template<typename Iterator, typename Compare>
-	void topological_sort(Iterator begin, Iterator end, Compare cmp) {
-		while (begin != end) {
-			auto const new_begin = std::partition(begin, end, [&](auto const& a) { return std::none_of(begin, end, [&](auto const& b) { return cmp(b, a); }); });
-			assert(new_begin != begin && "not a partial ordering");
-			begin = new_begin;
-		}
-	}
-
 	namespace errors {
 		RenderGraphException make_unattached_resource_exception(PassInfo& pass_info, Resource& resource);
 		RenderGraphException make_cbuf_references_unknown_resource(PassInfo& pass_info, Resource::Type type, Name name);
@@ -0,0 +1,158 @@
+#include "vuk/TaskPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace vuk {
+	namespace {
+		struct Job {
+			void (*fn)(void*, size_t);
+			void* user;
+			std::atomic<size_t> remaining;
+			// the last chunk to finish signals under the mutex, so that the job can't be destroyed while being signalled
+			std::mutex mutex;
+			std::condition_variable finished;
+			bool done = false;
+		};
+
+		struct Task {
+			Job* job;
+			size_t begin;
+			size_t end;
+		};
+
+		struct WorkQueue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+	} // namespace
+
+	struct TaskPoolImpl {
+		// one queue per worker and one for the submitting threads, which is queues[0]
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+
+		std::atomic<size_t> queued = 0;
+		std::mutex sleep_mutex;
+		std::condition_variable wake;
+		bool stop = false;
+
+		// own queue is used as a stack, others are stolen from the other end
+		std::optional<Task> pop(size_t own) {
+			for (size_t k = 0; k < queues.size(); k++) {
+				auto& q = *queues[(own + k) % queues.size()];
+				std::unique_lock _(q.mutex);
+				if (q.tasks.empty()) {
+					continue;
+				}
+				Task t;
+				if (k == 0) {
+					t = q.tasks.back();
+					q.tasks.pop_back();
+				} else {
+					t = q.tasks.front();
+					q.tasks.pop_front();
+				}
+				queued.fetch_sub(1, std::memory_order_relaxed);
+				return t;
+			}
+			return {};
+		}
+
+		static void execute(const Task& t) {
+			for (size_t i = t.begin; i < t.end; i++) {
+				t.job->fn(t.job->user, i);
+			}
+			auto count = t.end - t.begin;
+			if (t.job->remaining.fetch_sub(count, std::memory_order_acq_rel) == count) {
+				std::unique_lock _(t.job->mutex);
+				t.job->done = true;
+				t.job->finished.notify_all();
+			}
+		}
+
+		void worker_loop(size_t own) {
+			while (true) {
+				if (auto t = pop(own)) {
+					execute(*t);
+					continue;
+				}
+				std::unique_lock lock(sleep_mutex);
+				wake.wait(lock, [&] { return stop || queued.load(std::memory_order_relaxed) > 0; });
+				if (stop) {
+					return;
+				}
+			}
+		}
+	};
+
+	TaskPool::TaskPool(size_t thread_count) : impl(new TaskPoolImpl) {
+		if (thread_count == 0) {
+			thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		for (size_t i = 0; i < thread_count + 1; i++) {
+			impl->queues.emplace_back(std::make_unique<WorkQueue>());
+		}
+		for (size_t i = 0; i < thread_count; i++) {
+			impl->workers.emplace_back([impl = impl, own = i + 1] { impl->worker_loop(own); });
+		}
+	}
+
+	TaskPool::~TaskPool() {
+		{
+			std::unique_lock _(impl->sleep_mutex);
+			impl->stop = true;
+		}
+		impl->wake.notify_all();
+		for (auto& w : impl->workers) {
+			w.join();
+		}
+		delete impl;
+	}
+
+	size_t TaskPool::concurrency() const noexcept {
+		return impl->workers.size() + 1;
+	}
+
+	void TaskPool::run(size_t count, void (*fn)(void*, size_t), void* user) {
+		Job job{ fn, user, count };
+
+		// a few chunks per thread, so that stealing can even out uneven invocations
+		auto chunk_count = std::min(count, concurrency() * 4);
+		auto chunk_size = count / chunk_count;
+		auto leftover = count % chunk_count;
+		{
+			std::unique_lock _(impl->sleep_mutex);
+			impl->queued.fetch_add(chunk_count, std::memory_order_relaxed);
+		}
+		size_t begin = 0;
+		for (size_t c = 0; c < chunk_count; c++) {
+			auto end = begin + chunk_size + (c < leftover ? 1 : 0);
+			auto& q = *impl->queues[c % impl->queues.size()];
+			{
+				std::unique_lock _(q.mutex);
+				q.tasks.push_back(Task{ &job, begin, end });
+			}
+			begin = end;
+		}
+		impl->wake.notify_all();
+
+		// help out while there is work left - this might run chunks of other jobs too
+		while (job.remaining.load(std::memory_order_acquire) > 0) {
+			if (auto t = impl->pop(0)) {
+				TaskPoolImpl::execute(*t);
+			} else {
+				break;
+			}
+		}
+		std::unique_lock lock(job.mutex);
+		job.finished.wait(lock, [&] { return job.done; });
+	}
+} // namespace vuk
@@ -5,12 +5,15 @@
 #include "vuk/RenderGraph.hpp"
 #include "vuk/SampledImage.hpp"
 
+#include <algorithm>
 #include <atomic>
 #ifndef DOCTEST_CONFIG_DISABLE
 #include <doctest/doctest.h>
 #endif
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
 
 namespace vuk {
@@ -25,17 +28,102 @@ namespace vuk {
 		std::atomic<uint64_t> last_host_wait;
 		uint32_t family_index;
 
+		// submissions handed over to the submission thread, in the slot of the timeline value they signal
+		struct PendingSubmit {
+			std::atomic<uint64_t> value = 0; // stored once the rest is filled in
+			std::vector<VkCommandBufferSubmitInfoKHR> command_buffers;
+			std::vector<VkSemaphoreSubmitInfoKHR> waits;
+			std::vector<VkSemaphoreSubmitInfoKHR> signals;
+		};
+		static constexpr uint64_t ring_size = 256;
+		std::unique_ptr<PendingSubmit[]> ring;
+		// all the values up to this one were submitted
+		std::atomic<uint64_t> submitted;
+		std::atomic<VkResult> submit_result = VK_SUCCESS;
+		std::atomic<bool> stop = false;
+		std::thread submission_thread;
+
 		QueueImpl(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
 		    queueSubmit(fn1),
 		    queueSubmit2KHR(fn2),
 		    submit_sync(ts),
 		    queue(queue),
 		    family_index(queue_family_index) {}
+
+		void start_submission_thread() {
+			ring.reset(new PendingSubmit[ring_size]);
+			submitted = *submit_sync.value;
+			submission_thread = std::thread([this] { submission_loop(); });
+		}
+
+		void stop_submission_thread() {
+			if (!submission_thread.joinable()) {
+				return;
+			}
+			stop = true;
+			// wake the thread by changing the slot it waits on
+			auto& next = ring[(submitted.load() + 1) % ring_size];
+			next.value = ~0ull;
+			next.value.notify_all();
+			submission_thread.join();
+		}
+
+		void submission_loop() {
+			std::vector<VkSubmitInfo2KHR> sis;
+			uint64_t last = submitted.load();
+			while (true) {
+				auto& next = ring[(last + 1) % ring_size];
+				for (auto v = next.value.load(std::memory_order_acquire); v != last + 1; v = next.value.load(std::memory_order_acquire)) {
+					if (stop) {
+						return;
+					}
+					next.value.wait(v, std::memory_order_acquire);
+				}
+
+				// everything handed over in timeline order since the last wakeup goes into one call
+				sis.clear();
+				uint64_t end = last + 1;
+				for (; end <= last + ring_size; end++) {
+					auto& pending = ring[end % ring_size];
+					if (pending.value.load(std::memory_order_acquire) != end) {
+						break;
+					}
+					sis.push_back(VkSubmitInfo2KHR{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR,
+					                                .waitSemaphoreInfoCount = (uint32_t)pending.waits.size(),
+					                                .pWaitSemaphoreInfos = pending.waits.data(),
+					                                .commandBufferInfoCount = (uint32_t)pending.command_buffers.size(),
+					                                .pCommandBufferInfos = pending.command_buffers.data(),
+					                                .signalSemaphoreInfoCount = (uint32_t)pending.signals.size(),
+					                                .pSignalSemaphoreInfos = pending.signals.data() });
+				}
+				VkResult result;
+				{
+					std::lock_guard _(queue_lock);
+					result = queueSubmit2KHR(queue, (uint32_t)sis.size(), sis.data(), VK_NULL_HANDLE);
+				}
+				// the first error is kept, later submissions are still made
+				VkResult expected = VK_SUCCESS;
+				if (result != VK_SUCCESS) {
+					submit_result.compare_exchange_strong(expected, result);
+				}
+				last = end - 1;
+				submitted.store(last, std::memory_order_release);
+				submitted.notify_all();
+			}
+		}
 	};
 
-	Queue::Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
-	    impl(new QueueImpl(fn1, fn2, queue, queue_family_index, ts)) {}
+	Queue::Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts, bool submission_thread) :
+	    impl(new QueueImpl(fn1, fn2, queue, queue_family_index, ts)) {
+		if (submission_thread) {
+			impl->start_submission_thread();
+		}
+	}
+
 	Queue::~Queue() {
+		if (impl) {
+			impl->stop_submission_thread();
+		}
 		delete impl;
 	}
 
@@ -55,6 +143,7 @@ namespace vuk {
 	}
 
 	Result<void> Queue::submit(std::span<VkSubmitInfo2KHR> sis, VkFence fence) {
+		std::lock_guard _(impl->queue_lock);
 		VkResult result = impl->queueSubmit2KHR(impl->queue, (uint32_t)sis.size(), sis.data(), fence);
 		if (result != VK_SUCCESS) {
 			return { expected_error, VkException{ result } };
@@ -71,6 +160,45 @@ namespace vuk {
 		return { expected_value };
 	}
 
+	uint64_t Queue::reserve_timeline_values(uint64_t count) {
+		return std::atomic_ref(*impl->submit_sync.value).fetch_add(count) + 1;
+	}
+
+	bool Queue::has_submission_thread() const noexcept {
+		return impl->submission_thread.joinable();
+	}
+
+	void Queue::submit_async(uint64_t value, const VkSubmitInfo2KHR& si) {
+		assert(has_submission_thread());
+		// the slot is free once the submission that used it before was made
+		for (auto s = impl->submitted.load(std::memory_order_acquire); s + QueueImpl::ring_size < value; s = impl->submitted.load(std::memory_order_acquire)) {
+			impl->submitted.wait(s, std::memory_order_acquire);
+		}
+		auto& pending = impl->ring[value % QueueImpl::ring_size];
+		pending.command_buffers.assign(si.pCommandBufferInfos, si.pCommandBufferInfos + si.commandBufferInfoCount);
+		pending.waits.assign(si.pWaitSemaphoreInfos, si.pWaitSemaphoreInfos + si.waitSemaphoreInfoCount);
+		pending.signals.assign(si.pSignalSemaphoreInfos, si.pSignalSemaphoreInfos + si.signalSemaphoreInfoCount);
+		pending.value.store(value, std::memory_order_release);
+		pending.value.notify_one();
+	}
+
+	Result<void> Queue::get_async_submit_result() const {
+		if (auto result = impl->submit_result.load(); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value };
+	}
+
+	void Queue::flush() {
+		if (!has_submission_thread()) {
+			return;
+		}
+		auto target = std::atomic_ref(*impl->submit_sync.value).load();
+		for (auto s = impl->submitted.load(std::memory_order_acquire); s < target; s = impl->submitted.load(std::memory_order_acquire)) {
+			impl->submitted.wait(s, std::memory_order_acquire);
+		}
+	}
+
 	Result<void> Context::wait_for_domains(std::span<std::pair<DomainFlags, uint64_t>> queue_waits) {
 		std::array<uint32_t, 3> domain_to_sema_index = { ~0u, ~0u, ~0u };
 		std::array<VkSemaphore, 3> queue_timeline_semaphores;
@@ -113,10 +241,11 @@ namespace vuk {
 	}
 
 	Result<std::vector<SubmitBundle>> execute(std::span<std::pair<Allocator*, ExecutableRenderGraph*>> ergs,
-	                                          std::vector<std::pair<SwapchainRef, size_t>> swapchains_with_indexes) {
+	                                          std::vector<std::pair<SwapchainRef, size_t>> swapchains_with_indexes,
+	                                          RenderGraphExecuteOptions options) {
 		std::vector<SubmitBundle> bundles;
 		for (auto& [alloc, rg] : ergs) {
-			auto sbundle = rg->execute(*alloc, swapchains_with_indexes);
+			auto sbundle = rg->execute(*alloc, swapchains_with_indexes, options);
 			if (!sbundle) {
 				return Result<std::vector<SubmitBundle>>(std::move(sbundle));
 			}
@@ -298,6 +427,18 @@ namespace vuk {
 	}
 #endif
 
+	namespace {
+		// the arrays submissions are built in, kept between calls on the same thread so that submitting does not allocate
+		struct SubmitScratch {
+			std::vector<uint64_t> first_values;
+			std::vector<VkSubmitInfo2KHR> sis;
+			std::vector<VkCommandBufferSubmitInfoKHR> cbufsis;
+			std::vector<VkSemaphoreSubmitInfoKHR> wait_semas;
+			std::vector<VkSemaphoreSubmitInfoKHR> signal_semas;
+		};
+		thread_local SubmitScratch submit_scratch;
+	} // namespace
+
 	Result<void> submit(Allocator& allocator, SubmitBundle bundle, VkSemaphore present_rdy, VkSemaphore render_complete) {
 		Context& ctx = allocator.get_context();
 
@@ -306,20 +447,20 @@ namespace vuk {
 			used_domains |= batch.domain;
 		}
 
-		std::array<uint64_t, 3> queue_progress_references;
+		// queues with a submission thread make the submissions in timeline order, so they don't need to be locked while we submit
+		auto needs_lock = [&](DomainFlagBits domain) {
+			return (used_domains & domain) && !ctx.domain_to_queue(domain).has_submission_thread();
+		};
 		std::unique_lock<std::recursive_mutex> gfx_lock;
-		if (used_domains & DomainFlagBits::eGraphicsQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue)] = *ctx.graphics_queue->impl->submit_sync.value;
+		if (needs_lock(DomainFlagBits::eGraphicsQueue)) {
 			gfx_lock = std::unique_lock{ ctx.graphics_queue->impl->queue_lock };
 		}
 		std::unique_lock<std::recursive_mutex> compute_lock;
-		if (used_domains & DomainFlagBits::eComputeQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eComputeQueue)] = *ctx.compute_queue->impl->submit_sync.value;
+		if (needs_lock(DomainFlagBits::eComputeQueue)) {
 			compute_lock = std::unique_lock{ ctx.compute_queue->impl->queue_lock };
 		}
 		std::unique_lock<std::recursive_mutex> transfer_lock;
-		if (used_domains & DomainFlagBits::eTransferQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eTransferQueue)] = *ctx.transfer_queue->impl->submit_sync.value;
+		if (needs_lock(DomainFlagBits::eTransferQueue)) {
 			transfer_lock = std::unique_lock{ ctx.transfer_queue->impl->queue_lock };
 		}
 		bool needs_flatten = ((used_domains & DomainFlagBits::eTransferQueue) &&
@@ -341,11 +482,25 @@ namespace vuk {
 				std::swap(bundle.batches[0], bundle.batches[1]); // FIXME: silence some false positive validation
 			}
 		}
+
+		// reserve the timeline values signalled by the batches up front, relative waits are made against the value before them
+		std::array<uint64_t, 3> queue_progress_references;
+		auto& first_values = submit_scratch.first_values;
+		first_values.clear();
 		for (SubmitBatch& batch : bundle.batches) {
+			uint64_t count = (uint64_t)std::count_if(batch.submits.begin(), batch.submits.end(), [](SubmitInfo& si) { return si.command_buffers.size() > 0; });
+			auto first_value = ctx.domain_to_queue(batch.domain).reserve_timeline_values(count);
+			queue_progress_references[ctx.domain_to_queue_index(batch.domain)] = first_value - 1;
+			first_values.push_back(first_value);
+		}
+
+		// every reserved value is handed over to submission threads even after an error, so that they don't wait for it forever
+		Result<void> result = { expected_value };
+		for (size_t b = 0; b < bundle.batches.size(); b++) {
+			SubmitBatch& batch = bundle.batches[b];
 			auto domain = batch.domain;
 			Queue& queue = ctx.domain_to_queue(domain);
-			Unique<VkFence> fence(allocator);
-			VUK_DO_OR_RETURN(allocator.allocate_fences({ &*fence, 1 }));
+			auto next_value = first_values[b];
 
 			uint64_t num_cbufs = 0;
 			uint64_t num_waits = 1; // 1 extra for present_rdy
@@ -356,12 +511,17 @@ namespace vuk {
 				num_waits += submit_info.absolute_waits.size();
 			}
 
-			std::vector<VkSubmitInfo2KHR> sis;
-			std::vector<VkCommandBufferSubmitInfoKHR> cbufsis;
+			// the submit infos point into these, so they are reserved up front
+			auto& sis = submit_scratch.sis;
+			sis.clear();
+			auto& cbufsis = submit_scratch.cbufsis;
+			cbufsis.clear();
 			cbufsis.reserve(num_cbufs);
-			std::vector<VkSemaphoreSubmitInfoKHR> wait_semas;
+			auto& wait_semas = submit_scratch.wait_semas;
+			wait_semas.clear();
 			wait_semas.reserve(num_waits);
-			std::vector<VkSemaphoreSubmitInfoKHR> signal_semas;
+			auto& signal_semas = submit_scratch.signal_semas;
+			signal_semas.clear();
 			signal_semas.reserve(batch.submits.size() + 1); // 1 extra for render_complete
 
 			for (uint64_t i = 0; i < batch.submits.size(); i++) {
@@ -409,7 +569,7 @@ namespace vuk {
 
 				VkSemaphoreSubmitInfoKHR ssi{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR };
 				ssi.semaphore = queue.impl->submit_sync.semaphore;
-				ssi.value = ++(*queue.impl->submit_sync.value);
+				ssi.value = next_value++;
 
 				ssi.stageMask = (VkPipelineStageFlagBits2KHR)PipelineStageFlagBits::eAllCommands;
 
@@ -442,10 +602,28 @@ namespace vuk {
 				si.signalSemaphoreInfoCount = signal_sema_count;
 			}
 
-			VUK_DO_OR_RETURN(queue.submit(std::span{ sis }, *fence));
+			// completion is tracked through the queue timeline only, the allocator keeps its resources until the last value of the batch is reached
+			TimelineValue batch_done{ queue.impl->submit_sync.semaphore, next_value - 1 };
+			if (queue.has_submission_thread()) {
+				for (uint64_t i = 0; i < sis.size(); i++) {
+					queue.submit_async(first_values[b] + i, sis[i]);
+				}
+				if (sis.size() > 0) {
+					allocator.track_timeline_values(std::span{ &batch_done, 1 });
+				}
+				if (result) {
+					result = queue.get_async_submit_result();
+				}
+			} else if (result && sis.size() > 0) {
+				if (auto r = queue.submit(std::span{ sis }, VK_NULL_HANDLE); !r) {
+					result = std::move(r);
+				} else {
+					allocator.track_timeline_values(std::span{ &batch_done, 1 });
+				}
+			}
 		}
 
-		return { expected_value };
+		return result;
 	}
 
 	// assume rgs are independent - they don't reference eachother
@@ -453,8 +631,9 @@ namespace vuk {
 	                            std::span<std::pair<Allocator*, ExecutableRenderGraph*>> rgs,
 	                            std::vector<std::pair<SwapchainRef, size_t>> swapchains_with_indexes,
 	                            VkSemaphore present_rdy,
-	                            VkSemaphore render_complete) {
-		auto bundles = execute(rgs, swapchains_with_indexes);
+	                            VkSemaphore render_complete,
+	                            RenderGraphExecuteOptions options) {
+		auto bundles = execute(rgs, swapchains_with_indexes, options);
 		if (!bundles) {
 			return bundles;
 		}
@@ -467,6 +646,9 @@ namespace vuk {
 	}
 
 	Result<VkResult> present_to_one(Context& ctx, SingleSwapchainRenderBundle&& bundle) {
+		// the submission signalling render_complete has to be made before the present waits on it
+		ctx.graphics_queue->flush();
+		std::lock_guard _(ctx.graphics_queue->get_queue_lock());
 		VkPresentInfoKHR pi{ .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
 		pi.swapchainCount = 1;
 		pi.pSwapchains = &bundle.swapchain->swapchain;
@@ -510,11 +692,12 @@ namespace vuk {
 		return { expected_value, SingleSwapchainRenderBundle{ swapchain, image_index, present_ready, render_complete, acq_result } };
 	}
 
-	Result<SingleSwapchainRenderBundle> execute_submit(Allocator& allocator, ExecutableRenderGraph&& rg, SingleSwapchainRenderBundle&& bundle) {
+	Result<SingleSwapchainRenderBundle>
+	execute_submit(Allocator& allocator, ExecutableRenderGraph&& rg, SingleSwapchainRenderBundle&& bundle, RenderGraphExecuteOptions options) {
 		std::vector<std::pair<SwapchainRef, size_t>> swapchains_with_indexes = { { bundle.swapchain, bundle.image_index } };
 
 		std::pair v = { &allocator, &rg };
-		VUK_DO_OR_RETURN(execute_submit(allocator, std::span{ &v, 1 }, swapchains_with_indexes, bundle.present_ready, bundle.render_complete));
+		VUK_DO_OR_RETURN(execute_submit(allocator, std::span{ &v, 1 }, swapchains_with_indexes, bundle.present_ready, bundle.render_complete, options));
 
 		return { expected_value, std::move(bundle) };
 	}
@@ -667,6 +850,56 @@ namespace vuk {
 		}
 	}
 
+	Result<void> submit_all(Allocator& allocator, Compiler& compiler, std::span<Future> futures, RenderGraphCompileOptions options) {
+		std::vector<std::shared_ptr<RenderGraph>> rgs_to_run;
+		for (auto& future : futures) {
+			auto control = future.get_control();
+			if (control->status == FutureBase::Status::eInitial && !future.get_render_graph()) {
+				return { expected_error, RenderGraphException{} };
+			} else if (control->status == FutureBase::Status::eHostAvailable || control->status == FutureBase::Status::eSubmitted) {
+				continue;
+			}
+			// several futures can reference the same graph, it is only linked once
+			auto rg = future.get_render_graph();
+			if (std::find(rgs_to_run.begin(), rgs_to_run.end(), rg) == rgs_to_run.end()) {
+				rgs_to_run.emplace_back(std::move(rg));
+			}
+		}
+		if (rgs_to_run.size() == 0) {
+			return { expected_value };
+		}
+
+		// one link for all graphs, which then execute into one bundle
+		VUK_DO_OR_RETURN(link_execute_submit(allocator, compiler, std::span(rgs_to_run), options));
+		for (auto& future : futures) {
+			auto control = future.get_control();
+			if (control->status == FutureBase::Status::eInitial) {
+				control->status = FutureBase::Status::eSubmitted;
+			}
+		}
+		return { expected_value };
+	}
+
+	Result<void> wait_all(Allocator& allocator, Compiler& compiler, std::span<Future> futures, RenderGraphCompileOptions options) {
+		VUK_DO_OR_RETURN(submit_all(allocator, compiler, futures, options));
+
+		std::vector<std::pair<DomainFlags, uint64_t>> waits;
+		for (auto& future : futures) {
+			auto control = future.get_control();
+			if (control->status != FutureBase::Status::eSubmitted) {
+				continue;
+			}
+			waits.emplace_back(control->initial_domain, control->initial_visibility);
+		}
+		if (waits.size() > 0) {
+			VUK_DO_OR_RETURN(allocator.get_context().wait_for_domains(std::span(waits)));
+		}
+		for (auto& future : futures) {
+			future.get_control()->status = FutureBase::Status::eHostAvailable;
+		}
+		return { expected_value };
+	}
+
 	template Result<Buffer> Future::get(Allocator&, Compiler&);
 	template Result<ImageAttachment> Future::get(Allocator&, Compiler&);
 
@@ -1,6 +1,7 @@
 #include "TestContext.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Partials.hpp"
+#include <array>
 #include <doctest/doctest.h>
 
 using namespace vuk;
@@ -45,4 +46,67 @@ TEST_CASE("test buffer upload/download") {
 		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
 		CHECK(std::span((uint32_t*)res->mapped_ptr, 5) == std::span(data));
 	}
-}
\ No newline at end of file
+}
+TEST_CASE("test buffer upload/download with linked graph caching") {
+	REQUIRE(test_context.prepare());
+	Compiler compiler;
+	for (uint32_t i = 0; i < 3; i++) {
+		auto data = { i, i + 1, i + 2 };
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+
+		auto download = download_buffer(fut);
+		REQUIRE((bool)download.wait(*test_context.allocator, compiler, { .cache_linked_graphs = true }));
+		auto res = download.get<Buffer>(*test_context.allocator, compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+}
+
+TEST_CASE("test linked graph caching misses when attachments or options change") {
+	REQUIRE(test_context.prepare());
+	auto make_graph = [](Samples samples, uint32_t width) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("cached");
+		rg->attach_image("img",
+		                 ImageAttachment{ .extent = Dimension3D::absolute(width, 64),
+		                                  .format = Format::eR8G8B8A8Unorm,
+		                                  .sample_count = samples,
+		                                  .level_count = 1,
+		                                  .layer_count = 1 });
+		rg->add_pass({ .name = "draw", .resources = { "img"_image >> eColorWrite >> "img+" } });
+		return rg;
+	};
+	Compiler compiler;
+	auto link = [&](std::shared_ptr<RenderGraph> rg, RenderGraphCompileOptions options) {
+		Future out{ rg, "img+" };
+		options.cache_linked_graphs = true;
+		REQUIRE((bool)compiler.link(std::span{ &rg, 1 }, options));
+		return compiler.get_statistics().cache_hit;
+	};
+	CHECK(!link(make_graph(Samples::e1, 64), {}));
+	CHECK(link(make_graph(Samples::e1, 64), {}));
+	CHECK(!link(make_graph(Samples::e4, 64), {}));
+	CHECK(!link(make_graph(Samples::e4, 128), {}));
+	CHECK(!link(make_graph(Samples::e4, 128), { .cull_dead_passes = false }));
+	CHECK(link(make_graph(Samples::e4, 128), { .cull_dead_passes = false }));
+}
+
+TEST_CASE("test waiting for many futures at once") {
+	REQUIRE(test_context.prepare());
+	Compiler compiler;
+	std::vector<std::array<uint32_t, 3>> datas;
+	std::vector<Unique<Buffer>> bufs;
+	std::vector<Future> downloads;
+	for (uint32_t i = 0; i < 16; i++) {
+		datas.push_back({ i, i + 1, i + 2 });
+	}
+	for (auto& data : datas) {
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span<uint32_t>(data));
+		bufs.push_back(std::move(buf));
+		downloads.push_back(download_buffer(std::move(fut)));
+	}
+	REQUIRE((bool)wait_all(*test_context.allocator, compiler, std::span(downloads)));
+	for (size_t i = 0; i < downloads.size(); i++) {
+		CHECK(downloads[i].get_status() == FutureBase::Status::eHostAvailable);
+		auto& res = downloads[i].get_result<Buffer>();
+		CHECK(std::span((uint32_t*)res.mapped_ptr, 3) == std::span<const uint32_t>(datas[i]));
+	}
+}
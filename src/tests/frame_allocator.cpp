@@ -1,7 +1,14 @@
 #include "TestContext.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Partials.hpp"
+#include "vuk/resources/DeviceLinearResource.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <doctest/doctest.h>
+#include <memory>
+#include <thread>
+#include <tuple>
 
 using namespace vuk;
 
@@ -29,6 +36,12 @@ struct AllocatorChecker : DeviceNestedResource {
 		counter -= src.size();
 		upstream->deallocate_images(src);
 	}
+
+	Result<void, AllocateException>
+	allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override {
+		counter += cis.size();
+		return upstream->allocate_aliased_images(dst, cis, loc);
+	}
 };
 
 TEST_CASE("superframe allocator, uncached resource") {
@@ -177,4 +190,369 @@ TEST_CASE("multiframe allocator, cached resource identity for different MFAs") {
 	REQUIRE(im3 != im4);
 	REQUIRE((im3 != im1 && im3 != im2));
 	REQUIRE((im4 != im1 && im4 != im2));
-}
\ No newline at end of file
+}
+TEST_CASE("frame allocator, aliased images") {
+	REQUIRE(test_context.prepare());
+
+	AllocatorChecker ac(*test_context.sfa_resource);
+	DeviceSuperFrameResource sfr(ac, 2);
+
+	ImageCreateInfo ici{ .format = vuk::Format::eR8G8B8A8Srgb, .extent = vuk::Extent3D{ 100, 100, 1 }, .usage = vuk::ImageUsageFlagBits::eColorAttachment };
+	// first two are used one after the other, the third overlaps both
+	AliasedImageCreateInfo cis[3] = { { ici, 0, 1 }, { ici, 2, 3 }, { ici, 1, 2 } };
+	Image ims[3];
+	auto& fa = sfr.get_next_frame();
+	REQUIRE(fa.allocate_aliased_images(std::span{ ims }, std::span{ cis }, {}));
+	REQUIRE(ac.counter == 3);
+	// images owning their memory have an allocation - disjoint images share one
+	auto owners = std::count_if(std::begin(ims), std::end(ims), [](const Image& im) { return im.allocation != nullptr; });
+	REQUIRE(owners == 2);
+	sfr.get_next_frame();
+	REQUIRE(ac.counter == 3);
+	sfr.get_next_frame();
+	REQUIRE(ac.counter == 0);
+}
+
+struct AliasRecorder : DeviceNestedResource {
+	std::vector<Image> aliased;
+
+	AliasRecorder(DeviceResource& upstream) : DeviceNestedResource(upstream) {}
+
+	Result<void, AllocateException>
+	allocate_aliased_images(std::span<Image> dst, std::span<const AliasedImageCreateInfo> cis, SourceLocationAtFrame loc) override {
+		auto result = upstream->allocate_aliased_images(dst, cis, loc);
+		if (result) {
+			aliased.insert(aliased.end(), dst.begin(), dst.end());
+		}
+		return result;
+	}
+};
+
+TEST_CASE("frame allocator, transients with disjoint lifetimes share memory in a graph") {
+	REQUIRE(test_context.prepare());
+
+	AliasRecorder recorder(*test_context.sfa_resource);
+	Allocator alloc(recorder);
+	auto dst = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = 2 * sizeof(uint32_t) });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("aliased_transients");
+	auto transient = ImageAttachment{ .extent = Dimension3D::absolute(1, 1), .format = Format::eR32Uint, .sample_count = Samples::e1, .level_count = 1, .layer_count = 1 };
+	rg->attach_image("t1", transient);
+	rg->attach_image("t2", transient);
+	rg->attach_buffer("dst", *dst);
+	auto copy_to = [](Name src, Name dst, uint32_t index) {
+		return [=](CommandBuffer& cbuf) {
+			cbuf.copy_image_to_buffer(src,
+			                          dst,
+			                          BufferImageCopy{ .bufferOffset = index * sizeof(uint32_t),
+			                                           .imageSubresource = { .aspectMask = ImageAspectFlagBits::eColor },
+			                                           .imageExtent = { 1, 1, 1 } });
+		};
+	};
+	rg->clear_image("t1", "t1+", Clear(ClearColor(7u, 7u, 7u, 7u)));
+	rg->add_pass({ .name = "copy_t1", .resources = { "t1+"_image >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = copy_to("t1+", "dst", 0) });
+	// reading dst+ orders the lifetime of t2 after that of t1
+	rg->add_pass({ .name = "clear_t2",
+	               .resources = { "t2"_image >> eClear >> "t2+", "dst+"_buffer >> eTransferRead },
+	               .execute = [](CommandBuffer& cbuf) { cbuf.clear_image("t2", Clear(ClearColor(9u, 9u, 9u, 9u))); } });
+	rg->add_pass({ .name = "copy_t2", .resources = { "t2+"_image >> eTransferRead, "dst+"_buffer >> eTransferWrite >> "dst++" }, .execute = copy_to("t2+", "dst+", 1) });
+
+	Compiler compiler;
+	Future out{ rg, "dst++" };
+	REQUIRE((bool)out.wait(alloc, compiler, { .alias_transient_images = true }));
+
+	// both transients were placed into one block of memory
+	REQUIRE(recorder.aliased.size() == 2);
+	auto owners = std::count_if(recorder.aliased.begin(), recorder.aliased.end(), [](const Image& im) { return im.allocation != nullptr; });
+	CHECK(owners == 1);
+
+	// the second clear went through the aliasing barrier after the first copy
+	auto values = std::span(reinterpret_cast<uint32_t*>(dst->mapped_ptr), 2);
+	CHECK(values[0] == 7);
+	CHECK(values[1] == 9);
+}
+
+TEST_CASE("frame allocator, command pools and buffers are recycled") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	VkCommandPoolCreateInfo cpci{ .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .queueFamilyIndex = test_context.context->graphics_queue_family_index };
+	auto allocate = [&](DeviceFrameResource& fa) {
+		CommandPool pools[2];
+		VkCommandPoolCreateInfo cis[2] = { cpci, cpci };
+		REQUIRE(fa.allocate_command_pools(std::span{ pools }, std::span{ cis }, {}));
+		// held pools are not handed out twice
+		REQUIRE(pools[0].command_pool != pools[1].command_pool);
+		CommandBufferAllocation cba;
+		CommandBufferAllocationCreateInfo ci{ .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .command_pool = pools[0] };
+		REQUIRE(fa.allocate_command_buffers(std::span{ &cba, 1 }, std::span{ &ci, 1 }, {}));
+		fa.deallocate_command_pools(std::span{ pools });
+		return std::pair{ pools[0].command_pool, cba.command_buffer };
+	};
+	auto first = allocate(sfr.get_next_frame());
+	sfr.get_next_frame();
+	auto recycled = allocate(sfr.get_next_frame());
+	REQUIRE(first == recycled);
+}
+
+struct SubmitChecker : DeviceNestedResource {
+	size_t fences = 0;
+	std::vector<TimelineValue> tracked;
+
+	SubmitChecker(DeviceResource& upstream) : DeviceNestedResource(upstream) {}
+
+	Result<void, AllocateException> allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) override {
+		fences += dst.size();
+		return upstream->allocate_fences(dst, loc);
+	}
+
+	void track_timeline_values(std::span<const TimelineValue> src) override {
+		tracked.insert(tracked.end(), src.begin(), src.end());
+		upstream->track_timeline_values(src);
+	}
+};
+
+TEST_CASE("frame allocator, submissions are tracked by timeline value") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	SubmitChecker sc(sfr.get_next_frame());
+	Allocator alloc(sc);
+	auto buf = *allocate_buffer(alloc, { .mem_usage = MemoryUsage::eGPUonly, .size = sizeof(uint32_t) });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("tracked");
+	rg->attach_buffer("dst", *buf);
+	rg->add_pass({ .name = "fill", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+		               cbuf.fill_buffer("dst", sizeof(uint32_t), 1u);
+	               } });
+	Compiler compiler;
+	Future out{ rg, "dst+" };
+	REQUIRE((bool)out.wait(alloc, compiler));
+
+	CHECK(sc.fences == 0);
+	REQUIRE(sc.tracked.size() == 1);
+	// the future was waited on, so the value is reached already
+	VkSemaphoreWaitInfo swi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, .semaphoreCount = 1, .pSemaphores = &sc.tracked[0].semaphore, .pValues = &sc.tracked[0].value };
+	CHECK(test_context.context->vkWaitSemaphores(test_context.context->device, &swi, 0) == VK_SUCCESS);
+	// recycling the frame waits for the tracked value
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+}
+
+TEST_CASE("frame allocator, small buffers from many threads") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	constexpr size_t allocations_per_thread = 4096;
+	for (size_t thread_count = 1; thread_count <= 32; thread_count *= 2) {
+		auto& fa = sfr.get_next_frame();
+		std::vector<Buffer> bufs(thread_count * allocations_per_thread);
+		std::atomic<size_t> failures = 0;
+		std::vector<std::thread> threads;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t t = 0; t < thread_count; t++) {
+			threads.emplace_back([&, t] {
+				BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUtoGPU, .size = 256 };
+				for (size_t i = 0; i < allocations_per_thread; i++) {
+					if (!fa.allocate_buffers(std::span{ &bufs[t * allocations_per_thread + i], 1 }, std::span{ &bci, 1 }, {})) {
+						failures++;
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		MESSAGE(thread_count << " threads: " << bufs.size() / elapsed.count() << " allocations/s");
+		REQUIRE(failures == 0);
+
+		// no two allocations overlap
+		std::sort(bufs.begin(), bufs.end(), [](const Buffer& a, const Buffer& b) { return std::tie(a.buffer, a.offset) < std::tie(b.buffer, b.offset); });
+		for (size_t i = 1; i < bufs.size(); i++) {
+			if (bufs[i].buffer == bufs[i - 1].buffer) {
+				REQUIRE(bufs[i - 1].offset + bufs[i - 1].size <= bufs[i].offset);
+			}
+		}
+	}
+}
+
+TEST_CASE("frame allocator, small buffers interleaved between linear allocators on one thread") {
+	REQUIRE(test_context.prepare());
+
+	AllocatorChecker checker(*test_context.sfa_resource);
+	{
+		// a linear resource has an allocator per memory usage, so the first and the last of these are 16 generations apart
+		std::vector<DeviceLinearResource> linears;
+		linears.reserve(5);
+		for (size_t i = 0; i < 5; i++) {
+			linears.emplace_back(checker);
+		}
+		DeviceLinearResource* interleaved[] = { &linears.front(), &linears.back() };
+		BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUtoGPU, .size = 256 };
+		std::vector<Buffer> bufs[2];
+		for (size_t i = 0; i < 1024; i++) {
+			for (size_t j = 0; j < 2; j++) {
+				Buffer buf;
+				REQUIRE(interleaved[j]->allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, {}));
+				bufs[j].push_back(buf);
+			}
+		}
+		// switching allocators does not throw away sub-blocks, so 256 KiB per allocator stays within its first block
+		CHECK(checker.counter == 2);
+		for (auto& per_allocator : bufs) {
+			CHECK(std::all_of(per_allocator.begin(), per_allocator.end(), [&](const Buffer& b) { return b.buffer == per_allocator[0].buffer; }));
+			CHECK(per_allocator.back().offset - per_allocator.front().offset < 2 * 1024 * 256);
+		}
+	}
+	CHECK(checker.counter == 0);
+}
+
+TEST_CASE("frame allocator, sub-blocks of destroyed linear allocators are evicted") {
+	REQUIRE(test_context.prepare());
+
+	BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUtoGPU, .size = 256 };
+	// more short-lived allocators than a thread caches sub-blocks for, each leaving a partly used one behind
+	for (size_t i = 0; i < 32; i++) {
+		DeviceLinearResource linear(*test_context.sfa_resource);
+		Buffer buf;
+		REQUIRE(linear.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, {}));
+	}
+
+	// with a sub-block this thread keeps allocating next to its previous allocation, even when another thread allocated in between
+	DeviceLinearResource linear(*test_context.sfa_resource);
+	Buffer a, b, c;
+	REQUIRE(linear.allocate_buffers(std::span{ &a, 1 }, std::span{ &bci, 1 }, {}));
+	bool other_allocated = false;
+	std::thread other([&] { other_allocated = (bool)linear.allocate_buffers(std::span{ &b, 1 }, std::span{ &bci, 1 }, {}); });
+	other.join();
+	REQUIRE(other_allocated);
+	REQUIRE(linear.allocate_buffers(std::span{ &c, 1 }, std::span{ &bci, 1 }, {}));
+	CHECK(c.buffer == a.buffer);
+	CHECK(c.offset == a.offset + bci.size);
+	CHECK((b.buffer != a.buffer || b.offset >= c.offset + bci.size));
+}
+
+TEST_CASE("superframe allocator, small persistent buffers come from slabs") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	constexpr size_t thread_count = 8;
+	constexpr size_t buffers_per_thread = 4096;
+	std::vector<Buffer> bufs(thread_count * buffers_per_thread);
+	std::atomic<size_t> failures = 0;
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t t = 0; t < thread_count; t++) {
+		threads.emplace_back([&, t] {
+			for (size_t i = 0; i < buffers_per_thread; i++) {
+				// mesh-sized buffers of a few different size classes
+				BufferCreateInfo bci{ .mem_usage = MemoryUsage::eGPUonly, .size = 256u << (i % 4) };
+				auto& buf = bufs[t * buffers_per_thread + i];
+				if (!sfr.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, {})) {
+					failures++;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	MESSAGE(thread_count << " threads: " << bufs.size() / elapsed.count() << " persistent allocations/s");
+	REQUIRE(failures == 0);
+
+	auto stats = sfr.get_buffer_statistics(MemoryUsage::eGPUonly);
+	CHECK(stats.allocation_count == bufs.size());
+	CHECK(stats.slab_bytes_in_use >= bufs.size() * 256);
+	CHECK(stats.slab_bytes_in_use <= stats.slab_bytes);
+	CHECK(stats.block_bytes_in_use >= stats.slab_bytes);
+	MESSAGE("slab fragmentation: " << 1.0 - double(stats.slab_bytes_in_use) / double(stats.slab_bytes));
+
+	// no two buffers overlap
+	auto sorted = bufs;
+	std::sort(sorted.begin(), sorted.end(), [](const Buffer& a, const Buffer& b) { return std::tie(a.buffer, a.offset) < std::tie(b.buffer, b.offset); });
+	for (size_t i = 1; i < sorted.size(); i++) {
+		if (sorted[i].buffer == sorted[i - 1].buffer) {
+			REQUIRE(sorted[i - 1].offset + sorted[i - 1].size <= sorted[i].offset);
+		}
+	}
+
+	sfr.deallocate_buffers(std::span{ bufs });
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+	stats = sfr.get_buffer_statistics(MemoryUsage::eGPUonly);
+	CHECK(stats.deallocation_count == bufs.size());
+	CHECK(stats.slab_bytes_in_use == 0);
+}
+
+TEST_CASE("device resource, pooled images go past the memory allocation count limit") {
+	REQUIRE(test_context.prepare());
+
+	auto& ctx = *test_context.context;
+	VkPhysicalDeviceProperties properties;
+	ctx.vkGetPhysicalDeviceProperties(ctx.physical_device, &properties);
+	// separate allocations would fail once there are more images than this - only go past it if the limit is low enough to test
+	auto limit = properties.limits.maxMemoryAllocationCount;
+	size_t count = limit <= 8192 ? limit + 64 : 1024;
+
+	auto& resource = ctx.get_vk_resource();
+	std::vector<Image> images(count);
+	std::vector<ImageCreateInfo> icis(count);
+	for (size_t i = 0; i < count; i++) {
+		// alternate between render targets and sampled textures, so that more than one pool is used
+		icis[i] = ImageCreateInfo{ .format = vuk::Format::eR8G8B8A8Unorm,
+			                         .extent = vuk::Extent3D{ 16, 16, 1 },
+			                         .usage = i % 2 == 0 ? vuk::ImageUsageFlagBits::eColorAttachment : vuk::ImageUsageFlagBits::eSampled };
+	}
+	auto start = std::chrono::steady_clock::now();
+	auto result = resource.allocate_images(images, icis, {});
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	REQUIRE((bool)result);
+	MESSAGE(count << " images: " << count / elapsed.count() << " image allocations/s");
+	resource.deallocate_images(images);
+}
+
+TEST_CASE("device resource, memory budget and pressure callbacks") {
+	REQUIRE(test_context.prepare());
+
+	auto& resource = test_context.context->get_vk_resource();
+	auto before = resource.get_allocated_bytes(MemoryUsage::eCPUonly);
+	Buffer buf;
+	BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUonly, .size = 1024 * 1024 };
+	REQUIRE((bool)resource.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, {}));
+	CHECK(resource.get_allocated_bytes(MemoryUsage::eCPUonly) >= before + bci.size);
+
+	// a watermark of 0 is crossed by every heap with a budget, the first time the budget is queried after adding the callback
+	std::atomic<size_t> crossed = 0;
+	auto id = resource.add_memory_pressure_callback(0.f, [&crossed](uint32_t heap_index, const MemoryHeapBudget& budget, bool over_watermark) {
+		if (over_watermark && budget.budget > 0) {
+			crossed++;
+		}
+	});
+	DeviceSuperFrameResource sfr(*test_context.context, 2);
+	sfr.get_next_frame();
+	auto budgets = resource.get_memory_budget();
+	REQUIRE(budgets.size() > 0);
+	size_t crossings = crossed;
+	CHECK(crossings > 0);
+	CHECK(crossings <= budgets.size());
+	sfr.get_next_frame();
+	CHECK(crossed == crossings);
+
+	// a removed callback is not invoked again, even when the watermark is crossed by a new callback
+	resource.remove_memory_pressure_callback(id);
+	std::atomic<size_t> crossed_after = 0;
+	auto id_after = resource.add_memory_pressure_callback(0.f, [&crossed_after](uint32_t, const MemoryHeapBudget&, bool over_watermark) {
+		if (over_watermark) {
+			crossed_after++;
+		}
+	});
+	sfr.get_next_frame();
+	CHECK(crossed == crossings);
+	CHECK(crossed_after > 0);
+	resource.remove_memory_pressure_callback(id_after);
+
+	resource.deallocate_buffers(std::span{ &buf, 1 });
+	CHECK(resource.get_allocated_bytes(MemoryUsage::eCPUonly) == before);
+}
@@ -0,0 +1,64 @@
+#include "TestContext.hpp"
+#include <cstdlib>
+#include <doctest/doctest.h>
+#include <new>
+#include <string>
+
+using namespace vuk;
+
+// counts the heap allocations made on this thread while enabled
+namespace {
+	thread_local bool count_allocations = false;
+	thread_local size_t allocation_count = 0;
+} // namespace
+
+void* operator new(std::size_t size) {
+	if (count_allocations) {
+		allocation_count++;
+	}
+	if (auto p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+TEST_CASE("compiling a graph of the same shape again does not allocate") {
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("steady");
+	rg->attach_buffer("scratch", Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+	rg->attach_buffer("out", Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+	Name last = "out";
+	for (size_t i = 0; i < 64; i++) {
+		Name next = Name(std::string("out") + std::to_string(i));
+		rg->add_pass({ .name = Name(std::string("pass") + std::to_string(i)),
+		               .resources = { Resource{ last, Resource::Type::eBuffer, eComputeRW, next }, "scratch"_buffer >> eComputeRead } });
+		last = next;
+	}
+	// a pass nothing observes, so that culling runs too
+	rg->add_pass({ .name = "dead", .resources = { "scratch"_buffer >> eComputeWrite >> "scratch+" } });
+	Future out{ rg, last };
+
+	Compiler compiler;
+	auto counted_compile = [&] {
+		allocation_count = 0;
+		count_allocations = true;
+		auto result = compiler.compile(std::span{ &rg, 1 }, {});
+		count_allocations = false;
+		REQUIRE(result);
+		return allocation_count;
+	};
+	auto first = counted_compile();
+	counted_compile();
+	auto steady = counted_compile();
+	MESSAGE("first compile: " << first << " allocations, steady state: " << steady << " allocations");
+	CHECK(first > 0);
+	CHECK(steady == 0);
+	CHECK(compiler.get_culled_passes().size() == 1);
+}
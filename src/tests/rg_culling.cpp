@@ -0,0 +1,45 @@
+#include "TestContext.hpp"
+#include <doctest/doctest.h>
+
+using namespace vuk;
+
+TEST_CASE("culling: passes whose results are not observed are removed") {
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("culling");
+	rg->attach_buffer("scratch", Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+	rg->attach_buffer("out", Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+	rg->add_pass({ .name = "dead", .resources = { "scratch"_buffer >> eComputeWrite >> "scratch+" } });
+	rg->add_pass({ .name = "live", .resources = { "out"_buffer >> eComputeWrite >> "out+" } });
+	Future out{ rg, "out+" };
+
+	Compiler compiler;
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, {}));
+	auto culled = compiler.get_culled_passes();
+	REQUIRE(culled.size() == 1);
+	CHECK(culled[0].name == Name("dead"));
+
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, { .cull_dead_passes = false }));
+	CHECK(compiler.get_culled_passes().size() == 0);
+}
+
+TEST_CASE("culling: a cached link of a graph with dead passes runs the live passes") {
+	REQUIRE(test_context.prepare());
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) });
+
+	Compiler compiler;
+	for (uint32_t i = 0; i < 3; i++) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("cached_culling");
+		rg->attach_buffer("scratch", Buffer{ .size = sizeof(uint32_t), .memory_usage = MemoryUsage::eGPUonly });
+		rg->attach_buffer("out", *buf);
+		rg->add_pass({ .name = "dead",
+		               .resources = { "scratch"_buffer >> eTransferWrite >> "scratch+" },
+		               .execute = [](CommandBuffer& cbuf) { cbuf.fill_buffer("scratch", sizeof(uint32_t), 0xdead); } });
+		rg->add_pass({ .name = "live",
+		               .resources = { "out"_buffer >> eTransferWrite >> "out+" },
+		               .execute = [i](CommandBuffer& cbuf) { cbuf.fill_buffer("out", sizeof(uint32_t), i + 1); } });
+		Future out{ rg, "out+" };
+		REQUIRE((bool)out.wait(*test_context.allocator, compiler, { .cache_linked_graphs = true }));
+		CHECK(compiler.get_statistics().cache_hit == (i > 0));
+		CHECK(compiler.get_culled_passes().size() == 1);
+		CHECK(*reinterpret_cast<uint32_t*>(buf->mapped_ptr) == i + 1);
+	}
+}
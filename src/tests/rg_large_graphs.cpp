@@ -0,0 +1,135 @@
+#include "TestContext.hpp"
+#include "vuk/RenderGraphReflection.hpp"
+#include "vuk/TaskPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <doctest/doctest.h>
+#include <string>
+
+using namespace vuk;
+
+// chain_count independent chains of compute passes, all reading a shared buffer, with periodic reads across chains
+static std::shared_ptr<RenderGraph> make_synthetic_graph(size_t pass_count, size_t chain_count) {
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("synthetic");
+	rg->attach_buffer("params", Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+
+	auto versioned = [](size_t chain, size_t version) {
+		return Name(std::string("c") + std::to_string(chain) + "_" + std::to_string(version));
+	};
+	std::vector<size_t> versions(chain_count);
+	for (size_t k = 0; k < chain_count; k++) {
+		rg->attach_buffer(versioned(k, 0), Buffer{ .size = 256, .memory_usage = MemoryUsage::eGPUonly });
+	}
+
+	for (size_t i = 0; i < pass_count; i++) {
+		auto k = i % chain_count;
+		Pass p{ .name = Name(std::string("pass") + std::to_string(i)), .execute_on = DomainFlagBits::eComputeQueue };
+		p.resources.emplace_back(Resource{ versioned(k, versions[k]), Resource::Type::eBuffer, eComputeRW, versioned(k, versions[k] + 1) });
+		p.resources.emplace_back(Resource{ "params", Resource::Type::eBuffer, eComputeRead });
+		if (i % 8 == 0 && chain_count > 1) {
+			auto n = (k + 1) % chain_count;
+			p.resources.emplace_back(Resource{ versioned(n, versions[n]), Resource::Type::eBuffer, eComputeRead });
+		}
+		versions[k]++;
+		rg->add_pass(std::move(p));
+	}
+
+	return rg;
+}
+
+static std::chrono::duration<double> time_compile(size_t pass_count) {
+	auto rg = make_synthetic_graph(pass_count, 64);
+	Compiler compiler;
+	auto start = std::chrono::steady_clock::now();
+	// nothing observes the synthetic graph, so culling would leave no passes to schedule
+	auto result = compiler.compile(std::span{ &rg, 1 }, { .cull_dead_passes = false });
+	auto end = std::chrono::steady_clock::now();
+	REQUIRE((bool)result);
+	REQUIRE(compiler.get_culled_passes().size() == 0);
+	auto& stats = compiler.get_statistics();
+	CHECK(stats.chains >= 64);
+	CHECK(stats.phase_times.schedule_intra_queue.count() > 0);
+	CHECK(stats.phase_times.schedule_intra_queue <= end - start);
+	return end - start;
+}
+
+TEST_CASE("large graph: 10k and 100k pass graphs compile in linear time") {
+	// a dense adjacency for 100k passes would be 10 GB, so compiling at all bounds memory
+	auto t10k = time_compile(10'000);
+	auto t100k = time_compile(100'000);
+	MESSAGE("10k passes: " << t10k.count() << "s, 100k passes: " << t100k.count() << "s");
+	// 10x the passes should cost about 10x the time - quadratic scheduling would be 100x
+	CHECK(t100k.count() < 30 * t10k.count());
+}
+
+TEST_CASE("large graph: inlining on a task pool matches serial inlining") {
+	std::vector<std::shared_ptr<RenderGraph>> rgs;
+	for (size_t i = 0; i < 32; i++) {
+		auto rg = make_synthetic_graph(256, 8);
+		// observe the end of the first chain, so that the linked graph has a final use to reach
+		rg->release("c0_32", eComputeRead);
+		rgs.push_back(std::move(rg));
+	}
+	Compiler serial;
+	Compiler parallel;
+	TaskPool pool(4);
+	REQUIRE(serial.link(rgs, { .cull_dead_passes = false }));
+	REQUIRE(parallel.link(rgs, { .cull_dead_passes = false, .task_pool = &pool }));
+
+	// same passes scheduled in the same order, with the same barriers between them
+	auto& a = serial.get_statistics();
+	auto& b = parallel.get_statistics();
+	CHECK(a.passes == 32 * 256);
+	CHECK(a.passes == b.passes);
+	CHECK(a.chains == b.chains);
+	CHECK(a.subgraphs_inlined == b.subgraphs_inlined);
+	CHECK(a.memory_barriers == b.memory_barriers);
+	CHECK(a.memory_barriers_before_coalescing == b.memory_barriers_before_coalescing);
+	CHECK(a.pipeline_barrier_calls == b.pipeline_barrier_calls);
+	CHECK(a.event_sets == b.event_sets);
+	CHECK(a.submit_batches == b.submit_batches);
+
+	// every resource is used by the same scheduled passes, and resolves to the same final name
+	auto serial_chains = serial.get_use_chains();
+	auto parallel_chains = parallel.get_use_chains();
+	REQUIRE(serial_chains.size() == parallel_chains.size());
+	auto same_access = [](const std::optional<ChainAccess>& x, const std::optional<ChainAccess>& y) {
+		return x.has_value() == y.has_value() && (!x || (x->pass == y->pass && x->resource == y->resource));
+	};
+	for (size_t i = 0; i < serial_chains.size(); i++) {
+		auto sc = serial_chains[i];
+		auto pc = parallel_chains[i];
+		CHECK(sc->type == pc->type);
+		CHECK(same_access(sc->def, pc->def));
+		CHECK(same_access(sc->undef, pc->undef));
+		CHECK(sc->reads.size() == pc->reads.size());
+		CHECK(serial.get_last_use_name(sc) == parallel.get_last_use_name(pc));
+	}
+	CHECK(serial.get_bound_buffers().size() == parallel.get_bound_buffers().size());
+	CHECK(serial.get_culled_passes().size() == 0);
+	CHECK(parallel.get_culled_passes().size() == 0);
+}
+
+TEST_CASE("large graph: inference with declared sources takes one iteration") {
+	REQUIRE(test_context.prepare());
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("inference_chain");
+	// attached back to front, so that evaluating in attachment order would take one iteration per link
+	constexpr size_t length = 32;
+	auto name = [](size_t i) {
+		return Name(std::string("b") + std::to_string(i));
+	};
+	Pass p{ .name = "write_all" };
+	for (size_t i = length; i-- > 0;) {
+		rg->attach_buffer(name(i), Buffer{ .size = i == 0 ? 1024 : ~(0u), .memory_usage = MemoryUsage::eGPUonly });
+		if (i > 0) {
+			rg->inference_rule(name(i), same_size_as(name(i - 1)));
+		}
+		p.resources.emplace_back(Resource{ name(i), Resource::Type::eBuffer, eTransferWrite, name(i).append("+") });
+	}
+	rg->add_pass(std::move(p));
+
+	Compiler compiler;
+	Future out{ rg, name(length - 1).append("+") };
+	REQUIRE((bool)out.wait(*test_context.allocator, compiler));
+	CHECK(compiler.get_statistics().inference_iterations == 1);
+}
@@ -0,0 +1,342 @@
+#include "TestContext.hpp"
+#include "vuk/TaskPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <doctest/doctest.h>
+#include <string>
+
+using namespace vuk;
+
+TEST_CASE("recording: passes recorded on a task pool execute in order") {
+	REQUIRE(test_context.prepare());
+	constexpr size_t pass_count = 64;
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * pass_count });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("parallel_recording");
+	rg->attach_buffer("dst0", *buf);
+	for (size_t i = 0; i < pass_count; i++) {
+		auto name = Name(std::string("dst") + std::to_string(i));
+		auto out_name = Name(std::string("dst") + std::to_string(i + 1));
+		// each pass overwrites the tail of the buffer, so the result depends on the order the passes execute in
+		rg->add_pass({ .name = Name(std::string("fill") + std::to_string(i)),
+		               .execute_on = DomainFlagBits::eGraphicsQueue,
+		               .resources = { Resource{ name, Resource::Type::eBuffer, eTransferWrite, out_name } },
+		               .execute = [=](CommandBuffer& cbuf) {
+			               Buffer dst = *cbuf.get_resource_buffer(name);
+			               dst.offset += i * sizeof(uint32_t);
+			               cbuf.fill_buffer(dst, (pass_count - i) * sizeof(uint32_t), static_cast<uint32_t>(i));
+		               } });
+	}
+
+	TaskPool pool(4);
+	Compiler compiler;
+	auto erg = compiler.link(std::span{ &rg, 1 }, {});
+	REQUIRE((bool)erg);
+	std::pair v = { &*test_context.allocator, &*erg };
+	REQUIRE((bool)execute_submit(*test_context.allocator, std::span{ &v, 1 }, {}, {}, {}, { .task_pool = &pool }));
+	REQUIRE((bool)test_context.context->wait_idle());
+
+	auto values = std::span(reinterpret_cast<uint32_t*>(buf->mapped_ptr), pass_count);
+	for (size_t j = 0; j < pass_count; j++) {
+		CHECK(values[j] == j);
+	}
+}
+
+// a chain of passes on one domain, where pass i fills the tail of the buffer from slot i with i, repeat times over
+static void add_fill_chain(RenderGraph& rg, std::string prefix, DomainFlagBits domain, size_t pass_count, size_t repeat) {
+	for (size_t i = 0; i < pass_count; i++) {
+		auto name = Name(prefix + std::to_string(i));
+		auto out_name = Name(prefix + std::to_string(i + 1));
+		rg.add_pass({ .name = Name(prefix + "_fill" + std::to_string(i)),
+		              .execute_on = domain,
+		              .resources = { Resource{ name, Resource::Type::eBuffer, eTransferWrite, out_name } },
+		              .execute = [=](CommandBuffer& cbuf) {
+			              Buffer dst = *cbuf.get_resource_buffer(name);
+			              dst.offset += i * sizeof(uint32_t);
+			              for (size_t r = 0; r < repeat; r++) {
+				              cbuf.fill_buffer(dst, (pass_count - i) * sizeof(uint32_t), static_cast<uint32_t>(i));
+			              }
+		              } });
+	}
+}
+
+TEST_CASE("recording: domains recorded on a task pool match serial recording") {
+	REQUIRE(test_context.prepare());
+	// heavy async compute next to a light graphics and transfer load
+	struct Chain {
+		const char* prefix;
+		DomainFlagBits domain;
+		size_t pass_count;
+	};
+	Chain chains[] = { { "gfx", DomainFlagBits::eGraphicsQueue, 16 }, { "cmp", DomainFlagBits::eComputeQueue, 64 }, { "xfer", DomainFlagBits::eTransferQueue, 16 } };
+	constexpr size_t repeat = 256;
+	std::vector<Unique<Buffer>> bufs;
+	for (auto& c : chains) {
+		bufs.push_back(*allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * c.pass_count }));
+	}
+
+	auto run = [&](TaskPool* pool) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("domain_recording");
+		for (size_t k = 0; k < std::size(chains); k++) {
+			std::memset(bufs[k]->mapped_ptr, 0xff, bufs[k]->size);
+			rg->attach_buffer(Name(std::string(chains[k].prefix) + "0"), *bufs[k]);
+			add_fill_chain(*rg, chains[k].prefix, chains[k].domain, chains[k].pass_count, repeat);
+		}
+		Compiler compiler;
+		auto erg = compiler.link(std::span{ &rg, 1 }, {});
+		REQUIRE((bool)erg);
+		std::pair v = { &*test_context.allocator, &*erg };
+		auto start = std::chrono::steady_clock::now();
+		REQUIRE((bool)execute_submit(*test_context.allocator, std::span{ &v, 1 }, {}, {}, {}, { .task_pool = pool }));
+		auto end = std::chrono::steady_clock::now();
+		REQUIRE((bool)test_context.context->wait_idle());
+		for (size_t k = 0; k < std::size(chains); k++) {
+			auto values = std::span(reinterpret_cast<uint32_t*>(bufs[k]->mapped_ptr), chains[k].pass_count);
+			for (size_t j = 0; j < values.size(); j++) {
+				CHECK(values[j] == j);
+			}
+		}
+		return std::chrono::duration<double>(end - start);
+	};
+
+	TaskPool pool(4);
+	auto serial = run(nullptr);
+	auto parallel = run(&pool);
+	MESSAGE("serial recording: " << serial.count() << "s, on a task pool: " << parallel.count() << "s");
+}
+
+TEST_CASE("recording: jobs of a pass recorded in parallel execute in order") {
+	REQUIRE(test_context.prepare());
+	constexpr size_t job_count = 64;
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * job_count });
+
+	TaskPool pool(4);
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("parallel_jobs");
+	rg->attach_buffer("dst", *buf);
+	rg->add_pass({ .name = "fill",
+	               .resources = { "dst"_buffer >> eTransferWrite >> "dst+" },
+	               .execute = [&pool](CommandBuffer& cbuf) {
+		               Buffer dst = *cbuf.get_resource_buffer("dst");
+		               // each job overwrites the tail of the buffer, so the result depends on the order the jobs execute in
+		               cbuf.record_parallel(
+		                   job_count,
+		                   [dst](CommandBuffer& job_cbuf, size_t i) {
+			                   Buffer tail = dst;
+			                   tail.offset += i * sizeof(uint32_t);
+			                   job_cbuf.fill_buffer(tail, (job_count - i) * sizeof(uint32_t), static_cast<uint32_t>(i));
+		                   },
+		                   &pool);
+	               } });
+
+	Compiler compiler;
+	Future out{ rg, "dst+" };
+	REQUIRE((bool)out.wait(*test_context.allocator, compiler));
+
+	auto values = std::span(reinterpret_cast<uint32_t*>(buf->mapped_ptr), job_count);
+	for (size_t j = 0; j < job_count; j++) {
+		CHECK(values[j] == j);
+	}
+}
+
+TEST_CASE("recording: jobs recorded in parallel inside a render pass recorded on a task pool") {
+	REQUIRE(test_context.prepare());
+	// every row is drawn by its own pass of one render pass, every pixel of the row by its own job
+	constexpr uint32_t width = 16;
+	constexpr uint32_t rows = 8;
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * width * rows });
+
+	TaskPool pool(4);
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("parallel_jobs_in_render_pass");
+	rg->attach_image("img0",
+	                 ImageAttachment{ .extent = Dimension3D::absolute(width, rows), .format = Format::eR32Uint, .sample_count = Samples::e1, .level_count = 1, .layer_count = 1 });
+	rg->attach_buffer("dst", *buf);
+	auto version = [](uint32_t row) {
+		return Name(std::string("img") + std::to_string(row));
+	};
+	for (uint32_t row = 0; row < rows; row++) {
+		rg->add_pass({ .name = Name(std::string("row") + std::to_string(row)),
+		               .resources = { Resource{ version(row), Resource::Type::eImage, eColorWrite, version(row + 1) } },
+		               .execute = [&pool, row](CommandBuffer& cbuf) {
+			               cbuf.record_parallel(
+			                   width,
+			                   [row](CommandBuffer& job_cbuf, size_t i) {
+				                   VkClearAttachment clear{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .colorAttachment = 0 };
+				                   clear.clearValue.color.uint32[0] = row * width + (uint32_t)i;
+				                   VkClearRect rect{ .rect = { .offset = { (int32_t)i, (int32_t)row }, .extent = { 1, 1 } }, .baseArrayLayer = 0, .layerCount = 1 };
+				                   job_cbuf.get_context().vkCmdClearAttachments(job_cbuf.get_underlying(), 1, &clear, 1, &rect);
+			                   },
+			                   &pool);
+		               } });
+	}
+	rg->add_pass({ .name = "copy",
+	               .resources = { Resource{ version(rows), Resource::Type::eImage, eTransferRead }, "dst"_buffer >> eTransferWrite >> "dst+" },
+	               .execute = [&](CommandBuffer& cbuf) {
+		               cbuf.copy_image_to_buffer(
+		                   version(rows), "dst", BufferImageCopy{ .imageSubresource = { .aspectMask = ImageAspectFlagBits::eColor }, .imageExtent = { width, rows, 1 } });
+	               } });
+
+	Compiler compiler;
+	Future out{ rg, "dst+" };
+	auto erg = compiler.link(std::span{ &rg, 1 }, {});
+	REQUIRE((bool)erg);
+	std::pair v = { &*test_context.allocator, &*erg };
+	REQUIRE((bool)execute_submit(*test_context.allocator, std::span{ &v, 1 }, {}, {}, {}, { .task_pool = &pool }));
+	REQUIRE((bool)test_context.context->wait_idle());
+
+	auto values = std::span(reinterpret_cast<uint32_t*>(buf->mapped_ptr), width * rows);
+	for (uint32_t j = 0; j < values.size(); j++) {
+		CHECK(values[j] == j);
+	}
+}
+
+TEST_CASE("recording: cached passes are recorded again only when their key changes") {
+	REQUIRE(test_context.prepare());
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) });
+
+	Compiler compiler;
+	size_t recordings = 0;
+	auto run = [&](uint32_t value) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("cached");
+		rg->attach_buffer("dst", *buf);
+		rg->add_pass({ .name = "fill",
+		               .resources = { "dst"_buffer >> eTransferWrite >> "dst+" },
+		               .execute =
+		                   [&recordings, value](CommandBuffer& cbuf) {
+			                   recordings++;
+			                   cbuf.fill_buffer(*cbuf.get_resource_buffer("dst"), sizeof(uint32_t), value);
+		                   },
+		               .cache_key = value });
+		auto erg = compiler.link(std::span{ &rg, 1 }, {});
+		REQUIRE((bool)erg);
+		std::pair v = { &*test_context.allocator, &*erg };
+		REQUIRE((bool)execute_submit(*test_context.allocator, std::span{ &v, 1 }, {}, {}, {}, { .recording_cache_resource = &*test_context.sfa_resource }));
+		REQUIRE((bool)test_context.context->wait_idle());
+		CHECK(*reinterpret_cast<uint32_t*>(buf->mapped_ptr) == value);
+	};
+
+	run(1);
+	run(1);
+	CHECK(recordings == 1);
+	run(2);
+	CHECK(recordings == 2);
+	run(1);
+	CHECK(recordings == 2);
+}
+
+TEST_CASE("recording: barriers with passes in between are split into events") {
+	REQUIRE(test_context.prepare());
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * 3 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("split_barriers");
+	rg->attach_buffer("dst", *buf);
+	const char* srcs[] = { "a", "b", "c" };
+	for (uint32_t i = 0; i < 3; i++) {
+		rg->attach_buffer(srcs[i], Buffer{ .size = sizeof(uint32_t), .memory_usage = MemoryUsage::eGPUonly });
+		rg->add_pass({ .name = Name(std::string("fill_") + srcs[i]),
+		               .resources = { Resource{ srcs[i], Resource::Type::eBuffer, eTransferWrite, Name(srcs[i]).append("+") } },
+		               .execute = [name = Name(srcs[i]), i](CommandBuffer& cbuf) {
+			               cbuf.fill_buffer(*cbuf.get_resource_buffer(name), sizeof(uint32_t), i + 1);
+		               } });
+	}
+	// however the fills are ordered, the first one to execute has another one between it and the copy
+	rg->add_pass({ .name = "gather",
+	               .resources = { "a+"_buffer >> eTransferRead, "b+"_buffer >> eTransferRead, "c+"_buffer >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+	               .execute = [](CommandBuffer& cbuf) {
+		               Buffer dst = *cbuf.get_resource_buffer("dst");
+		               for (auto src : { "a+", "b+", "c+" }) {
+			               cbuf.copy_buffer(*cbuf.get_resource_buffer(src), dst, sizeof(uint32_t));
+			               dst.offset += sizeof(uint32_t);
+		               }
+	               } });
+
+	Compiler compiler;
+	Future out{ rg, "dst+" };
+	REQUIRE((bool)out.wait(*test_context.allocator, compiler));
+	CHECK(compiler.get_statistics().event_sets >= 1);
+
+	auto values = std::span(reinterpret_cast<uint32_t*>(buf->mapped_ptr), 3);
+	for (uint32_t j = 0; j < 3; j++) {
+		CHECK(values[j] == j + 1);
+	}
+}
+
+TEST_CASE("recording: barriers of a pass are coalesced into one dependency") {
+	REQUIRE(test_context.prepare());
+	auto buf = *allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUtoCPU, .size = sizeof(uint32_t) * 2 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("coalesced_barriers");
+	rg->attach_buffer("dst", *buf);
+	rg->attach_buffer("a", Buffer{ .size = sizeof(uint32_t), .memory_usage = MemoryUsage::eGPUonly });
+	rg->attach_buffer("b", Buffer{ .size = sizeof(uint32_t), .memory_usage = MemoryUsage::eGPUonly });
+	rg->add_pass({ .name = "fill",
+	               .resources = { "a"_buffer >> eTransferWrite >> "a+", "b"_buffer >> eTransferWrite >> "b+" },
+	               .execute = [](CommandBuffer& cbuf) {
+		               cbuf.fill_buffer(*cbuf.get_resource_buffer("a"), sizeof(uint32_t), 1);
+		               cbuf.fill_buffer(*cbuf.get_resource_buffer("b"), sizeof(uint32_t), 2);
+	               } });
+	// one memory barrier per buffer read, which make a single one together
+	rg->add_pass({ .name = "gather",
+	               .resources = { "a+"_buffer >> eTransferRead, "b+"_buffer >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+	               .execute = [](CommandBuffer& cbuf) {
+		               Buffer dst = *cbuf.get_resource_buffer("dst");
+		               cbuf.copy_buffer(*cbuf.get_resource_buffer("a+"), dst, sizeof(uint32_t));
+		               dst.offset += sizeof(uint32_t);
+		               cbuf.copy_buffer(*cbuf.get_resource_buffer("b+"), dst, sizeof(uint32_t));
+	               } });
+
+	Compiler compiler;
+	Future out{ rg, "dst+" };
+	REQUIRE((bool)out.wait(*test_context.allocator, compiler));
+	auto& stats = compiler.get_statistics();
+	MESSAGE("memory barriers: " << stats.memory_barriers_before_coalescing << " generated, " << stats.memory_barriers << " after coalescing");
+	CHECK(stats.memory_barriers < stats.memory_barriers_before_coalescing);
+	CHECK(stats.pipeline_barrier_calls <= stats.pipeline_barrier_calls_before_coalescing);
+
+	auto values = std::span(reinterpret_cast<uint32_t*>(buf->mapped_ptr), 2);
+	CHECK(values[0] == 1);
+	CHECK(values[1] == 2);
+}
+
+TEST_CASE("recording: minimizing barriers keeps the uses of a resource back to back") {
+	REQUIRE(test_context.prepare());
+	std::vector<Unique<Buffer>> bufs;
+	for (size_t i = 0; i < 4; i++) {
+		bufs.push_back(*allocate_buffer(*test_context.allocator, { .mem_usage = MemoryUsage::eGPUonly, .size = sizeof(uint32_t) }));
+	}
+
+	// all three passes are ready at once - "read_a" and "read_c" share a resource, "write_b" doesn't
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("minimize_barriers");
+	rg->attach_buffer("shared", *bufs[0]);
+	rg->attach_buffer("a", *bufs[1]);
+	rg->attach_buffer("b", *bufs[2]);
+	rg->attach_buffer("c", *bufs[3]);
+	std::vector<Name> order;
+	auto record = [&order](Name name) {
+		return [&order, name](CommandBuffer&) {
+			order.push_back(name);
+		};
+	};
+	rg->add_pass({ .name = "read_a",
+	               .execute_on = DomainFlagBits::eGraphicsQueue,
+	               .resources = { "shared"_buffer >> eTransferRead, "a"_buffer >> eTransferWrite >> "a+" },
+	               .execute = record("read_a") });
+	rg->add_pass({ .name = "write_b", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "b"_buffer >> eTransferWrite >> "b+" }, .execute = record("write_b") });
+	rg->add_pass({ .name = "read_c",
+	               .execute_on = DomainFlagBits::eGraphicsQueue,
+	               .resources = { "shared"_buffer >> eTransferRead, "c"_buffer >> eTransferWrite >> "c+" },
+	               .execute = record("read_c") });
+
+	Compiler compiler;
+	auto erg = compiler.link(std::span{ &rg, 1 }, { .pass_ordering = PassOrdering::eMinimizeBarriers });
+	REQUIRE((bool)erg);
+	std::pair v = { &*test_context.allocator, &*erg };
+	REQUIRE((bool)execute_submit(*test_context.allocator, std::span{ &v, 1 }, {}, {}, {}));
+	REQUIRE((bool)test_context.context->wait_idle());
+
+	REQUIRE(order.size() == 3);
+	auto a = std::find(order.begin(), order.end(), Name("read_a"));
+	auto c = std::find(order.begin(), order.end(), Name("read_c"));
+	CHECK(std::abs(std::distance(a, c)) == 1);
+}